@@ -58,6 +58,11 @@ void AuthService::queryIdentities(const IdentityFilter &filter)
     impl->queryIdentities(filter);
 }
 
+void AuthService::getIdentities(const QList<quint32> &ids)
+{
+    impl->getIdentities(ids);
+}
+
 void AuthService::clear()
 {
     impl->clear();
@@ -182,6 +182,19 @@ public:
      */
     void queryIdentities(const IdentityFilter &filter = IdentityFilter());
 
+    /*!
+     * Requests the information on several identities at once.
+     * The information is emitted with signal identitiesInfo(); identities
+     * which don't exist or which the application is not allowed to use are
+     * not included in it.
+     * Error is reported by emitting signal error().
+     *
+     * @see AuthService::identitiesInfo()
+     * @see AuthService::error()
+     * @param ids The IDs of the identities
+     */
+    void getIdentities(const QList<quint32> &ids);
+
     /*!
      * Clears credentials database. All identity entries are removed from database.
      * Signal cleared() is emitted when operation is completed.
@@ -234,6 +247,14 @@ Q_SIGNALS:
      */
     void identities(const QList<SignOn::IdentityInfo> &identityList);
 
+    /*!
+     * Lists the information on the identities requested with
+     * getIdentities().
+     *
+     * @param identityList list of identities information
+     */
+    void identitiesInfo(const QList<SignOn::IdentityInfo> &identityList);
+
     /*!
      * Database is cleared and reset to initial state.
      * This signal is emitted in response to clear().
@@ -134,6 +134,18 @@ void AuthServiceImpl::queryIdentities(const AuthService::IdentityFilter &filter)
                 args);
 }
 
+void AuthServiceImpl::getIdentities(const QList<quint32> &ids)
+{
+    QVariantList args;
+    args << QVariant::fromValue(ids);
+    /* TODO: implement the application security context */
+    args << QLatin1String("*");
+
+    sendRequest(QLatin1String("getIdentities"),
+                SLOT(getIdentitiesReply(QDBusPendingCallWatcher*)),
+                args);
+}
+
 void AuthServiceImpl::clear()
 {
     sendRequest(QLatin1String("clear"),
@@ -180,26 +192,43 @@ void AuthServiceImpl::queryMechanismsError(const QDBusError &err)
     errorReply(err);
 }
 
-void AuthServiceImpl::queryIdentitiesReply(QDBusPendingCallWatcher *call)
+QList<IdentityInfo>
+AuthServiceImpl::infoListFromReply(QDBusPendingCallWatcher *call)
 {
+    QList<IdentityInfo> infoList;
+
     QDBusMessage msg = call->reply();
     QList<QVariant> args = msg.arguments();
     if (args.isEmpty()) {
         BLAME() << "Invalid reply: no arguments";
-        return;
+        return infoList;
     }
 
     QDBusArgument arg = args[0].value<QDBusArgument>();
     MapList identitiesData = qdbus_cast<MapList>(arg);
 
-    QList<IdentityInfo> infoList;
     foreach (const QVariantMap &map, identitiesData) {
         IdentityInfo info;
         info.impl->updateFromMap(map);
         infoList.append(info);
     }
+    return infoList;
+}
+
+void AuthServiceImpl::queryIdentitiesReply(QDBusPendingCallWatcher *call)
+{
+    QDBusMessage msg = call->reply();
+    if (msg.arguments().isEmpty()) {
+        BLAME() << "Invalid reply: no arguments";
+        return;
+    }
 
-    emit m_parent->identities(infoList);
+    emit m_parent->identities(infoListFromReply(call));
+}
+
+void AuthServiceImpl::getIdentitiesReply(QDBusPendingCallWatcher *call)
+{
+    emit m_parent->identitiesInfo(infoListFromReply(call));
 }
 
 void AuthServiceImpl::clearReply()
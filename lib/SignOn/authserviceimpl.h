@@ -60,6 +60,7 @@ public:
     void queryMethods();
     void queryMechanisms(const QString &method);
     void queryIdentities(const AuthService::IdentityFilter &filter);
+    void getIdentities(const QList<quint32> &ids);
     void clear();
 
 public Q_SLOTS:
@@ -67,10 +68,12 @@ public Q_SLOTS:
     void queryMechanismsReply(QDBusPendingCallWatcher *call);
     void queryMechanismsError(const QDBusError &err);
     void queryIdentitiesReply(QDBusPendingCallWatcher *call);
+    void getIdentitiesReply(QDBusPendingCallWatcher *call);
     void queryMethodsReply(QDBusPendingCallWatcher *call);
     void clearReply();
 
 private:
+    QList<IdentityInfo> infoListFromReply(QDBusPendingCallWatcher *call);
     void sendRequest(const QString &operation,
                      const char *replySlot,
                      const QList<QVariant> &args = QList<QVariant>());
@@ -156,6 +156,10 @@ public:
      * with Identity::storeCredentials, then the username is overriden from database.
      * Stored secret is used as a default value.
      *
+     * A time limit for this call can be set with SessionData::setTimeout(); if
+     * the request is not completed in time, the error() signal is emitted
+     * with Error::TimedOut.
+     *
      * @see AuthSession::response()
      * @see AuthSession::error()
      * @param sessionData Information for authentication session
@@ -28,16 +28,28 @@
 
 #include <QDBusPendingCallWatcher>
 #include <QDBusPendingReply>
+#include <QMetaMethod>
 
 using namespace SignOn;
 
+static inline bool isEmptyValue(const QVariant &value)
+{
+    return value.isNull() || !value.isValid();
+}
+
 static QVariantMap sessionData2VariantMap(const SessionData &data)
 {
-    QVariantMap result;
+    QVariantMap map = data.toMap();
+
+    /* Only copy the map if some values must be dropped */
+    QVariantMap::const_iterator it = map.constBegin();
+    while (it != map.constEnd() && !isEmptyValue(it.value())) it++;
+    if (it == map.constEnd()) return map;
 
-    foreach(QString key, data.propertyNames()) {
-        if (!data.getProperty(key).isNull() && data.getProperty(key).isValid())
-            result[key] = data.getProperty(key);
+    QVariantMap result;
+    for (it = map.constBegin(); it != map.constEnd(); it++) {
+        if (!isEmptyValue(it.value()))
+            result.insert(it.key(), it.value());
     }
 
     return result;
@@ -55,16 +67,20 @@ AuthSessionImpl::AuthSessionImpl(AuthSession *parent,
     m_applicationContext(applicationContext),
     m_methodName(methodName),
     m_isAuthInProcessing(false),
+    m_hasSessionObject(false),
+    m_isOneShot(false),
+    m_isOneShotSupported(true),
+    m_oneShotOperation(QLatin1String("processOneShot")),
     m_processCall(0)
 {
     m_dbusProxy.connect("stateChanged", this,
                         SLOT(stateSlot(int, const QString&)));
     m_dbusProxy.connect("unregistered", this,
                         SLOT(unregisteredSlot()));
+    /* The session object is registered when the first operation is queued:
+     * process() might not need it at all */
     QObject::connect(&m_dbusProxy, SIGNAL(objectPathNeeded()),
                      this, SLOT(initInterface()));
-
-    initInterface();
 }
 
 AuthSessionImpl::~AuthSessionImpl()
@@ -149,26 +165,81 @@ void AuthSessionImpl::process(const SessionData &sessionData,
     }
 
     QVariantMap sessionDataVa = sessionData2VariantMap(sessionData);
-    QString remoteFunctionName;
-
-    QVariantList arguments;
-    arguments += sessionDataVa;
-    arguments += mechanism;
 
-    remoteFunctionName = QLatin1String("process");
+    m_isOneShot = canProcessOneShot();
+    if (m_isOneShot) {
+        m_processCall = processOneShot(sessionDataVa, mechanism);
+    } else {
+        QVariantList arguments;
+        arguments += sessionDataVa;
+        arguments += mechanism;
 
-    m_processCall = send2interface(remoteFunctionName,
-                   SLOT(responseSlot(QDBusPendingCallWatcher*)), arguments);
+        m_processCall = send2interface(QLatin1String("process"),
+                       SLOT(responseSlot(QDBusPendingCallWatcher*)), arguments);
+    }
     Q_EMIT m_parent->stateChanged(AuthSession::ProcessPending,
                                   QLatin1String("The request is added "
                                                 "to queue."));
 }
 
+bool AuthSessionImpl::canProcessOneShot() const
+{
+    /* Without a session object, the daemon cannot report the state changes
+     * of the request: only go without it if nobody is listening to them */
+    if (m_hasSessionObject || m_isAuthInProcessing ||
+        !m_isOneShotSupported) return false;
+
+    static const QMetaMethod stateChangedSignal =
+        QMetaMethod::fromSignal(&AuthSession::stateChanged);
+    return !m_parent->isSignalConnected(stateChangedSignal);
+}
+
+PendingCall *AuthSessionImpl::processOneShot(const QVariantMap &sessionDataVa,
+                                             const QString &mechanism)
+{
+    TRACE() << "Processing without a session object";
+
+    QVariantList arguments;
+    arguments += m_id;
+    arguments += m_methodName;
+    arguments += mechanism;
+    arguments += sessionDataVa;
+
+    /* Kept in case the daemon turns out not to implement processOneShot */
+    m_oneShotArguments.clear();
+    m_oneShotArguments += sessionDataVa;
+    m_oneShotArguments += mechanism;
+
+    SignondAsyncDBusProxy *authService =
+        new SignondAsyncDBusProxy(SIGNOND_DAEMON_INTERFACE_C, this);
+    authService->setObjectPath(QDBusObjectPath(SIGNOND_DAEMON_OBJECTPATH));
+
+    PendingCall *call =
+        authService->queueCall(m_oneShotOperation,
+                               arguments,
+                               SLOT(responseSlot(QDBusPendingCallWatcher*)),
+                               SLOT(oneShotErrorSlot(const QDBusError&)));
+    QObject::connect(call, SIGNAL(finished(QDBusPendingCallWatcher*)),
+                     this, SLOT(deleteServiceProxy()));
+    return call;
+}
+
 void AuthSessionImpl::cancel()
 {
     if (m_processCall && m_processCall->cancel()) {
         emit m_parent->error(Error(Error::SessionCanceled,
                                    QLatin1String("Process is canceled.")));
+    } else if (m_processCall && m_isOneShot) {
+        /* The daemon cannot be reached for this request: just drop its
+         * reply, and let it be destroyed with the proxy */
+        QObject::disconnect(m_processCall,
+                            SIGNAL(success(QDBusPendingCallWatcher*)),
+                            this, 0);
+        QObject::disconnect(m_processCall,
+                            SIGNAL(error(const QDBusError&)),
+                            this, 0);
+        emit m_parent->error(Error(Error::SessionCanceled,
+                                   QLatin1String("Process is canceled.")));
     } else {
         send2interface(QLatin1String("cancel"), 0, QVariantList());
     }
@@ -181,11 +252,30 @@ void AuthSessionImpl::ignoreError(const QDBusError &err)
     TRACE() << err;
 }
 
+void AuthSessionImpl::oneShotErrorSlot(const QDBusError &err)
+{
+    if (err.type() != QDBusError::UnknownMethod) {
+        errorSlot(err);
+        return;
+    }
+
+    /* An older daemon: go through a session object from now on */
+    TRACE() << "processOneShot not supported, falling back to process";
+    m_isOneShotSupported = false;
+    m_isOneShot = false;
+
+    QVariantList arguments = m_oneShotArguments;
+    m_oneShotArguments.clear();
+    m_processCall = send2interface(QLatin1String("process"),
+                       SLOT(responseSlot(QDBusPendingCallWatcher*)), arguments);
+}
+
 void AuthSessionImpl::errorSlot(const QDBusError &err)
 {
     TRACE() << err;
 
     m_processCall = 0;
+    m_oneShotArguments.clear();
     int errCode = Error::Unknown;
     QString errMessage;
 
@@ -266,6 +356,7 @@ void AuthSessionImpl::authenticationSlot(QDBusPendingCallWatcher *call)
     m_dbusProxy.setObjectPath(reply.argumentAt<0>());
 
     m_isAuthInProcessing = false;
+    m_hasSessionObject = true;
 }
 
 void AuthSessionImpl::deleteServiceProxy()
@@ -286,6 +377,7 @@ void AuthSessionImpl::mechanismsAvailableSlot(QDBusPendingCallWatcher *call)
 void AuthSessionImpl::responseSlot(QDBusPendingCallWatcher *call)
 {
     m_processCall = 0;
+    m_oneShotArguments.clear();
 
     QDBusPendingReply<QVariantMap> reply = *call;
     QVariantMap sessionDataVa = reply.argumentAt<0>();
@@ -299,5 +391,6 @@ void AuthSessionImpl::stateSlot(int state, const QString &message)
 
 void AuthSessionImpl::unregisteredSlot()
 {
+    m_hasSessionObject = false;
     m_dbusProxy.setObjectPath(QDBusObjectPath());
 }
@@ -38,6 +38,8 @@
 #include "authsession.h"
 #include "dbusinterface.h"
 
+class TestAuthSession;
+
 namespace SignOn {
 
 /*!
@@ -52,6 +54,7 @@ class AuthSessionImpl: public QObject
 
     friend class AuthSession;
     friend class IdentityImpl;
+    friend class ::TestAuthSession;
 
 public:
     AuthSessionImpl(AuthSession *parent, quint32 id,
@@ -69,6 +72,7 @@ private Q_SLOTS:
     bool initInterface();
     void ignoreError(const QDBusError &err);
     void errorSlot(const QDBusError &err);
+    void oneShotErrorSlot(const QDBusError &err);
     void authenticationSlot(QDBusPendingCallWatcher *call);
     void deleteServiceProxy();
     void mechanismsAvailableSlot(QDBusPendingCallWatcher *call);
@@ -80,6 +84,9 @@ private:
     PendingCall *send2interface(const QString &operation,
                                 const char *slot,
                                 const QVariantList &arguments);
+    bool canProcessOneShot() const;
+    PendingCall *processOneShot(const QVariantMap &sessionDataVa,
+                                const QString &mechanism);
     void setId(quint32 id);
 
 private:
@@ -94,6 +101,23 @@ private:
      */
     bool m_isAuthInProcessing;
 
+    /*
+     * the daemon has registered a session object for us
+     */
+    bool m_hasSessionObject;
+
+    /*
+     * the process operation is served without a session object
+     */
+    bool m_isOneShot;
+
+    /*
+     * cleared when the daemon does not implement processOneShot
+     */
+    bool m_isOneShotSupported;
+    QString m_oneShotOperation;
+    QVariantList m_oneShotArguments;
+
     /*
      * Handle to process operation
      */
@@ -234,6 +234,15 @@ public:
      */
     SIGNON_SESSION_DECLARE_PROPERTY(bool, RenewToken)
 
+    /*!
+     * Declares the property Timeout setter and getter.
+     * Maximum time, in milliseconds, that the authentication service can
+     * take to process the request, including the time spent waiting for
+     * other requests to complete. When it expires, the request is canceled
+     * and fails with Error::TimedOut. If not set or 0, there is no limit.
+     */
+    SIGNON_SESSION_DECLARE_PROPERTY(quint32, Timeout)
+
 protected:
     QVariantMap m_data;
 };
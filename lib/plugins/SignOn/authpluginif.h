@@ -139,6 +139,34 @@ public:
     virtual void process(const SignOn::SessionData &inData,
                          const QString &mechanism = QString()) = 0;
 
+    /*!
+     * Allows signond to call process() again before the previous requests
+     * have been completed. Plugins enabling this must emit the reply
+     * (result() or error()) to each request in the same order as the
+     * requests were received; all the other signals are assumed to refer to
+     * the oldest request which has not been replied to yet.
+     * This is meant for plugins implementing stateless mechanisms, and
+     * should be called from the plugin constructor.
+     * @see maxConcurrentRequests
+     *
+     * @param count Maximum number of requests being processed at once
+     */
+    void setMaxConcurrentRequests(int count) {
+        setProperty("maxConcurrentRequests", count);
+    }
+
+    /*!
+     * Gets the maximum number of requests which the plugin can process at
+     * once.
+     * @see setMaxConcurrentRequests
+     *
+     * @return Maximum number of concurrent requests; 1 by default
+     */
+    int maxConcurrentRequests() const {
+        QVariant value = property("maxConcurrentRequests");
+        return value.isValid() ? qMax(value.toInt(), 1) : 1;
+    }
+
 Q_SIGNALS:
     /*!
      * Emitted when authentication process has been completed for given data
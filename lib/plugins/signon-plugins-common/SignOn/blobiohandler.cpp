@@ -23,18 +23,65 @@
 
 #include "blobiohandler.h"
 
-#include <QDBusArgument>
-#include <QBuffer>
 #include <QDataStream>
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QTimer>
 
 #include "SignOn/signonplugincommon.h"
+#include "frameiohandler.h"
+#include "ipc.h"
 
 #define SIGNON_IPC_BUFFER_PAGE_SIZE 16384
+/* How long to wait for the next page of a BLOB before giving up */
+#define SIGNON_IPC_READ_TIMEOUT 10000
 
 using namespace SignOn;
 
+namespace SignOn {
+
+class BlobIOHandlerPrivate;
+
+/* The class has no room for a private pointer, so the private objects are
+ * looked up by the address of their owner. */
+typedef QHash<const BlobIOHandler *, BlobIOHandlerPrivate *> PrivateHash;
+Q_GLOBAL_STATIC(PrivateHash, privateObjects)
+Q_GLOBAL_STATIC(QMutex, privateObjectsMutex)
+
+/* A child of the BlobIOHandler, so that it's destroyed together with it
+ * even by binaries built against the inline implicit destructor. */
+class BlobIOHandlerPrivate: public QObject
+{
+public:
+    BlobIOHandlerPrivate(BlobIOHandler *q):
+        QObject(q),
+        m_q(q),
+        m_bytesReceived(0)
+    {
+        m_readTimer.setSingleShot(true);
+        m_readTimer.setInterval(SIGNON_IPC_READ_TIMEOUT);
+        QObject::connect(&m_readTimer, SIGNAL(timeout()),
+                         q, SLOT(onReadTimeout()));
+
+        QMutexLocker locker(privateObjectsMutex());
+        privateObjects()->insert(q, this);
+    }
+
+    ~BlobIOHandlerPrivate()
+    {
+        QMutexLocker locker(privateObjectsMutex());
+        privateObjects()->remove(m_q);
+    }
+
+    const BlobIOHandler *m_q;
+    int m_bytesReceived;
+    QTimer m_readTimer;
+};
+
+} // namespace
+
 BlobIOHandler::BlobIOHandler(QIODevice *readChannel,
                              QIODevice *writeChannel,
                              QObject *parent):
@@ -45,6 +92,23 @@ BlobIOHandler::BlobIOHandler(QIODevice *readChannel,
     m_blobSize(-1),
     m_isReading(false)
 {
+    new BlobIOHandlerPrivate(this);
+}
+
+BlobIOHandlerPrivate *BlobIOHandler::d_func() const
+{
+    QMutexLocker locker(privateObjectsMutex());
+    return privateObjects()->value(this);
+}
+
+void BlobIOHandler::setReadTimeout(int timeout)
+{
+    d_func()->m_readTimer.setInterval(timeout);
+}
+
+int BlobIOHandler::readTimeout() const
+{
+    return d_func()->m_readTimer.interval();
 }
 
 void BlobIOHandler::setReadChannelSocketNotifier(QSocketNotifier *notifier)
@@ -66,15 +130,26 @@ bool BlobIOHandler::sendData(const QVariantMap &map)
     QByteArray ba = variantMapToByteArray(map);
     stream << ba.size();
 
-    QVector<QByteArray> pages = pageByteArray(ba);
-    for (int i = 0; i < pages.count(); ++i)
-        stream << pages[i];
+    /* Write the pages straight out of the serialized buffer: writeBytes()
+     * produces the same encoding as streaming a QByteArray, without having
+     * to copy each page first. */
+    const char *data = ba.constData();
+    int remaining = ba.size();
+    while (remaining > 0) {
+        int pageSize = qMin(remaining, SIGNON_IPC_BUFFER_PAGE_SIZE);
+        stream.writeBytes(data, pageSize);
+        data += pageSize;
+        remaining -= pageSize;
+    }
 
-    return true;
+    return stream.status() == QDataStream::Ok;
 }
 
 void BlobIOHandler::setReadNotificationEnabled(bool enabled)
 {
+    if (enabled == m_isReading)
+        return;
+
     m_isReading = enabled;
     if (enabled) {
         if (m_readNotifier != 0) {
@@ -97,156 +172,120 @@ void BlobIOHandler::setReadNotificationEnabled(bool enabled)
 
 void BlobIOHandler::receiveData(int expectedDataSize)
 {
-    m_blobBuffer.clear();
+    BlobIOHandlerPrivate *d = d_func();
     m_blobSize = expectedDataSize;
+    d->m_bytesReceived = 0;
+
+    /* Don't let a garbled or hostile header make us allocate an arbitrary
+     * amount of memory */
+    if (m_blobSize < 0 || m_blobSize > SIGNON_IPC_MAX_FRAME_SIZE) {
+        BLAME() << "Invalid BLOB size:" << m_blobSize;
+        m_blobSize = -1;
+        emit error();
+        return;
+    }
+
+    /* The pages are read straight into their final position, so that the
+     * whole BLOB is decoded only once it's complete. */
+    m_blobBuffer.resize(m_blobSize);
 
     //Enable read notification only if more than 1 BLOB page is to be received
     //This does not allow duplicate read attempts if only 1 page is available
     if (m_blobSize > SIGNON_IPC_BUFFER_PAGE_SIZE)
         setReadNotificationEnabled(true);
 
+    d->m_readTimer.start();
     readBlob();
 }
 
 void BlobIOHandler::readBlob()
 {
+    BlobIOHandlerPrivate *d = d_func();
     QDataStream in(m_readChannel);
 
-    in.startTransaction();
-    QByteArray fractionBa;
-    in >> fractionBa;
+    while (d->m_bytesReceived < m_blobSize) {
+        in.startTransaction();
+
+        /* This is the encoding of a QByteArray: the length, followed by the
+         * raw bytes (0xffffffff denotes a null array) */
+        quint32 pageSize = 0;
+        in >> pageSize;
+        if (pageSize == 0xffffffff)
+            pageSize = 0;
+
+        if (in.status() == QDataStream::Ok &&
+            pageSize > quint32(m_blobSize - d->m_bytesReceived)) {
+            in.abortTransaction();
+            BLAME() << "BLOB page exceeds the announced size";
+            finishReading();
+            emit error();
+            return;
+        }
 
-    if (!in.commitTransaction()) {
-        setReadNotificationEnabled(true);
-        // FIXME: with next ABI break, add a timer to prevent infinite waiting
-        // if the other party behaves badly
-        return;
-    }
+        if (pageSize > 0)
+            in.readRawData(m_blobBuffer.data() + d->m_bytesReceived,
+                           pageSize);
 
-    m_blobBuffer.append(fractionBa);
+        if (!in.commitTransaction()) {
+            setReadNotificationEnabled(true);
+            return;
+        }
 
-    //Avoid infinite loops if the other party behaves badly
-    if ((fractionBa.size() == 0) && (m_blobBuffer.size() < m_blobSize)) {
-        setReadNotificationEnabled(false);
-        emit error();
-        return;
-    }
+        //Avoid infinite loops if the other party behaves badly
+        if (pageSize == 0) {
+            finishReading();
+            emit error();
+            return;
+        }
 
-    if (m_blobBuffer.size() == m_blobSize) {
-        QVariantMap sessionDataMap;
-        sessionDataMap = byteArrayToVariantMap(m_blobBuffer);
+        d->m_bytesReceived += pageSize;
+        d->m_readTimer.start();
+    }
 
-        setReadNotificationEnabled(false);
+    QVariantMap sessionDataMap = byteArrayToVariantMap(m_blobBuffer);
+    finishReading();
 
-        emit dataReceived(sessionDataMap);
-    } else if (m_readChannel->bytesAvailable() > 0) {
-        // more data available already, schedule a read attempt for the next fraction
-        QTimer::singleShot(0, this, &BlobIOHandler::readBlob);
-    }
+    emit dataReceived(sessionDataMap);
 }
 
-QVariantMap expandDBusArgumentValue(const QVariant &value, bool *success)
+void BlobIOHandler::onReadTimeout()
 {
-    // first, convert the QDBusArgument to a map
-    QDBusArgument dbusValue = value.value<QDBusArgument>();
-    QVariantMap converted;
-    if (dbusValue.currentType() == QDBusArgument::MapType &&
-        // We only care about a{sv}
-        dbusValue.currentSignature() == "a{sv}") {
-        converted = qdbus_cast<QVariantMap>(dbusValue);
-    } else {
-        *success = false;
-        return QVariantMap();
-    }
-
-    // Then, check each value of the converted map
-    // and if any QDBusArgument is a value, convert that.
-    QVariantMap returnValue;
-    QVariantMap::const_iterator i;
-    for (i = converted.constBegin(); i != converted.constEnd(); ++i) {
-        if (qstrcmp(i.value().typeName(), "QDBusArgument") == 0) {
-            QVariantMap convertedValue = expandDBusArgumentValue(i.value(), success);
-            if (*success == false) {
-                //bail out to prevent error in serialization
-                return QVariantMap();
-            }
-            returnValue.insert(i.key(), convertedValue);
-        } else {
-            returnValue.insert(i.key(), i.value());
-        }
-    }
+    BlobIOHandlerPrivate *d = d_func();
+    if (d->m_bytesReceived >= m_blobSize)
+        return;
 
-    return returnValue;
+    BLAME() << "Timeout while reading BLOB:" << d->m_bytesReceived <<
+        "bytes of" << m_blobSize << "received";
+    finishReading();
+    emit error();
 }
 
-static QVariantMap filterOutComplexTypes(const QVariantMap &map)
+void BlobIOHandler::finishReading()
 {
-    QVariantMap filteredMap;
-    QVariantMap::const_iterator i;
-    for (i = map.constBegin(); i != map.constEnd(); i++) {
-        if (qstrcmp(i.value().typeName(), "QDBusArgument") == 0) {
-            bool success = true;
-            QVariantMap convertedMap = expandDBusArgumentValue(i.value(), &success);
-            if (success == false) {
-                /* QDBusArgument are complex types; there is no QDataStream
-                 * serialization for them, so keeping them in the map would
-                 * make the serialization fail for the whole map, if we are
-                 * unable to convert to a QVariantMap.
-                 * Therefore, skip them. */
-                BLAME() << "Found non-map QDBusArgument in data; skipping.";
-                continue;
-            }
-            filteredMap.insert(i.key(), convertedMap);
-        } else {
-            filteredMap.insert(i.key(), i.value());
-        }
-    }
-    return filteredMap;
+    BlobIOHandlerPrivate *d = d_func();
+    d->m_readTimer.stop();
+    setReadNotificationEnabled(false);
+    m_blobSize = -1;
+    d->m_bytesReceived = 0;
+    m_blobBuffer.clear();
 }
 
 QByteArray BlobIOHandler::variantMapToByteArray(const QVariantMap &map)
 {
-    QBuffer buffer;
-    if (!buffer.open(QIODevice::WriteOnly))
-        BLAME() << "Buffer opening failed.";
-
-    QDataStream stream(&buffer);
+    QByteArray array;
+    QDataStream stream(&array, QIODevice::WriteOnly);
     stream << filterOutComplexTypes(map);
-    buffer.close();
-
-    return buffer.data();
+    return array;
 }
 
 QVariantMap BlobIOHandler::byteArrayToVariantMap(const QByteArray &array)
 {
-    QByteArray nonConst = array;
-    QBuffer buffer(&nonConst);
-    if (!buffer.open(QIODevice::ReadOnly))
-        BLAME() << "Buffer opening failed.";
-
-    buffer.reset();
-    QDataStream stream(&buffer);
+    /* A read-only QDataStream operates on the array in place */
+    QDataStream stream(array);
     QVariantMap map;
     stream >> map;
-    buffer.close();
+    if (stream.status() != QDataStream::Ok)
+        BLAME() << "BLOB decoding failed.";
 
     return map;
 }
-
-QVector<QByteArray> BlobIOHandler::pageByteArray(const QByteArray &array)
-{
-    QVector<QByteArray> dataPages;
-    QByteArray ba = array;
-    QBuffer pagingBuffer(&ba);
-
-    if (!pagingBuffer.open(QIODevice::ReadOnly))
-        BLAME() << "Error while paging BLOB. Buffer opening failed.";
-
-    while (!pagingBuffer.atEnd()) {
-        QByteArray page = pagingBuffer.read(SIGNON_IPC_BUFFER_PAGE_SIZE);
-        dataPages.append(page);
-    }
-    pagingBuffer.close();
-
-    return dataPages;
-}
@@ -31,6 +31,8 @@
 
 namespace SignOn {
 
+class BlobIOHandlerPrivate;
+
 class BlobIOHandler: public QObject
 {
     Q_OBJECT
@@ -47,9 +49,17 @@ public:
     void setReadChannelSocketNotifier(QSocketNotifier *notifier);
     bool isReading() const { return m_isReading; }
 
+    /* Maximum time (in milliseconds) to wait for the next page of a BLOB
+     * before giving up and emitting error(). */
+    void setReadTimeout(int timeout);
+    int readTimeout() const;
+
 public Q_SLOTS:
     void readBlob();
 
+private Q_SLOTS:
+    void onReadTimeout();
+
 Q_SIGNALS:
     void dataReceived(const QVariantMap &map);
     void error();
@@ -59,7 +69,12 @@ private:
 
     QByteArray variantMapToByteArray(const QVariantMap &map);
     QVariantMap byteArrayToVariantMap(const QByteArray &array);
-    QVector<QByteArray> pageByteArray(const QByteArray &array);
+    void finishReading();
+
+    /* The reading state which is not part of the original layout of the
+     * class lives in a child object, so that the ABI stays unchanged; it's
+     * found through a hash keyed by the owner's address. */
+    BlobIOHandlerPrivate *d_func() const;
 
 public:
     QIODevice *m_readChannel;
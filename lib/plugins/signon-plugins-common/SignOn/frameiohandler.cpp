@@ -0,0 +1,221 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "frameiohandler.h"
+
+#include <QDBusArgument>
+#include <QDebug>
+#include <QtEndian>
+
+#include "SignOn/signonplugincommon.h"
+#include "ipc.h"
+
+using namespace SignOn;
+
+FrameIOHandler::FrameIOHandler(QIODevice *readChannel,
+                               QIODevice *writeChannel,
+                               quint8 version):
+    m_readChannel(readChannel),
+    m_writeChannel(writeChannel),
+    m_readOffset(0),
+    m_hasError(false),
+    m_version(version)
+{
+}
+
+FrameIOHandler::~FrameIOHandler()
+{
+}
+
+bool FrameIOHandler::sendFrame(quint16 opcode, quint32 requestId,
+                               const QByteArray &payload, quint8 flags)
+{
+    if (m_writeChannel == 0) {
+        TRACE() << "NULL write channel.";
+        return false;
+    }
+
+    QByteArray frame;
+    frame.reserve(SIGNON_IPC_FRAME_HEADER_SIZE + payload.size());
+    QDataStream stream(&frame, QIODevice::WriteOnly);
+    stream << quint32(SIGNON_IPC_FRAME_HEADER_SIZE - 4 + payload.size());
+    stream << m_version;
+    stream << flags;
+    stream << opcode;
+    stream << requestId;
+    frame.append(payload);
+
+    /* Write the frame in one go, so that it cannot be interleaved with
+     * other data */
+    return m_writeChannel->write(frame) == frame.size();
+}
+
+qint64 FrameIOHandler::readAvailableData()
+{
+    qint64 total = 0;
+    char chunk[16384];
+    forever {
+        qint64 bytesRead = m_readChannel->read(chunk, sizeof(chunk));
+        if (bytesRead <= 0) break;
+        m_buffer.append(chunk, int(bytesRead));
+        total += bytesRead;
+    }
+    return total;
+}
+
+bool FrameIOHandler::takeFrame(Frame &frame)
+{
+    if (m_hasError) return false;
+
+    int available = m_buffer.size() - m_readOffset;
+    if (available < 4) return false;
+
+    const uchar *data =
+        reinterpret_cast<const uchar *>(m_buffer.constData()) + m_readOffset;
+    quint32 size = qFromBigEndian<quint32>(data);
+    if (size < SIGNON_IPC_FRAME_HEADER_SIZE - 4 ||
+        size > SIGNON_IPC_MAX_FRAME_SIZE) {
+        BLAME() << "Invalid frame size:" << size;
+        m_hasError = true;
+        return false;
+    }
+
+    if (quint32(available) - 4 < size) return false;
+
+    frame.version = data[4];
+    frame.flags = data[5];
+    frame.opcode = qFromBigEndian<quint16>(data + 6);
+    frame.requestId = qFromBigEndian<quint32>(data + 8);
+    frame.payload =
+        m_buffer.mid(m_readOffset + SIGNON_IPC_FRAME_HEADER_SIZE,
+                     size - (SIGNON_IPC_FRAME_HEADER_SIZE - 4));
+    m_readOffset += 4 + size;
+
+    /* Drop the consumed data only once in a while, to avoid moving the
+     * buffer contents for every frame */
+    if (m_readOffset == m_buffer.size()) {
+        m_buffer.clear();
+        m_readOffset = 0;
+    } else if (m_readOffset > m_buffer.size() / 2) {
+        m_buffer.remove(0, m_readOffset);
+        m_readOffset = 0;
+    }
+
+    if (frame.version != m_version) {
+        BLAME() << "Unsupported frame version:" << frame.version;
+        m_hasError = true;
+        return false;
+    }
+
+    return true;
+}
+
+QByteArray FrameIOHandler::encodeMap(const QVariantMap &map)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << filterOutComplexTypes(map);
+    return payload;
+}
+
+QVariantMap FrameIOHandler::decodeMap(const QByteArray &payload)
+{
+    QDataStream stream(payload);
+    QVariantMap map;
+    stream >> map;
+    if (stream.status() != QDataStream::Ok)
+        BLAME() << "Session data decoding failed.";
+    return map;
+}
+
+QVariantMap expandDBusArgumentValue(const QVariant &value, bool *success)
+{
+    // first, convert the QDBusArgument to a map
+    QDBusArgument dbusValue = value.value<QDBusArgument>();
+    QVariantMap converted;
+    if (dbusValue.currentType() == QDBusArgument::MapType &&
+        // We only care about a{sv}
+        dbusValue.currentSignature() == "a{sv}") {
+        converted = qdbus_cast<QVariantMap>(dbusValue);
+    } else {
+        *success = false;
+        return QVariantMap();
+    }
+
+    // Then, check each value of the converted map
+    // and if any QDBusArgument is a value, convert that.
+    QVariantMap returnValue;
+    QVariantMap::const_iterator i;
+    for (i = converted.constBegin(); i != converted.constEnd(); ++i) {
+        if (qstrcmp(i.value().typeName(), "QDBusArgument") == 0) {
+            QVariantMap convertedValue = expandDBusArgumentValue(i.value(), success);
+            if (*success == false) {
+                //bail out to prevent error in serialization
+                return QVariantMap();
+            }
+            returnValue.insert(i.key(), convertedValue);
+        } else {
+            returnValue.insert(i.key(), i.value());
+        }
+    }
+
+    return returnValue;
+}
+
+static inline bool isComplexType(const QVariant &value)
+{
+    return qstrcmp(value.typeName(), "QDBusArgument") == 0;
+}
+
+QVariantMap SignOn::filterOutComplexTypes(const QVariantMap &map)
+{
+    /* Most maps don't contain any complex types: avoid copying them */
+    QVariantMap::const_iterator i = map.constBegin();
+    while (i != map.constEnd() && !isComplexType(i.value())) i++;
+    if (i == map.constEnd()) return map;
+
+    QVariantMap filteredMap = map;
+    QVariantMap::iterator j = filteredMap.find(i.key());
+    while (j != filteredMap.end()) {
+        if (!isComplexType(j.value())) {
+            j++;
+            continue;
+        }
+
+        bool success = true;
+        QVariantMap convertedMap = expandDBusArgumentValue(j.value(), &success);
+        if (success == false) {
+            /* QDBusArgument are complex types; there is no QDataStream
+             * serialization for them, so keeping them in the map would
+             * make the serialization fail for the whole map, if we are
+             * unable to convert to a QVariantMap.
+             * Therefore, skip them. */
+            BLAME() << "Found non-map QDBusArgument in data; skipping.";
+            j = filteredMap.erase(j);
+            continue;
+        }
+        j.value() = convertedMap;
+        j++;
+    }
+    return filteredMap;
+}
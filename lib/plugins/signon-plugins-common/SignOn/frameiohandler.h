@@ -0,0 +1,103 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef FRAMEIOHANDLER_H
+#define FRAMEIOHANDLER_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QIODevice>
+#include <QVariantMap>
+
+namespace SignOn {
+
+/*!
+ * @class FrameIOHandler
+ * Reads and writes the frames of the plugin IPC protocol, version 2 or later
+ * (see ipc.h). Incoming data is accumulated in a single buffer, out of which
+ * complete frames can then be taken one by one.
+ */
+class FrameIOHandler
+{
+public:
+    struct Frame {
+        Frame(): version(0), flags(0), opcode(0), requestId(0) {}
+
+        quint8 version;
+        quint8 flags;
+        quint16 opcode;
+        quint32 requestId;
+        QByteArray payload;
+    };
+
+    /*!
+     * @param version the negotiated protocol version, written in the header
+     * of the outgoing frames and expected in the incoming ones.
+     */
+    FrameIOHandler(QIODevice *readChannel, QIODevice *writeChannel,
+                   quint8 version);
+    ~FrameIOHandler();
+
+    bool sendFrame(quint16 opcode, quint32 requestId,
+                   const QByteArray &payload = QByteArray(),
+                   quint8 flags = 0);
+
+    /*!
+     * Moves all the data which can be read without blocking from the read
+     * channel into the buffer.
+     * @returns the number of bytes read.
+     */
+    qint64 readAvailableData();
+
+    /*!
+     * Takes the next complete frame out of the buffer.
+     * @returns false if no complete frame is available, or if the buffer
+     * contents are invalid (in which case hasError() returns true).
+     */
+    bool takeFrame(Frame &frame);
+
+    bool hasError() const { return m_hasError; }
+
+    static QByteArray encodeMap(const QVariantMap &map);
+    static QVariantMap decodeMap(const QByteArray &payload);
+
+private:
+    QIODevice *m_readChannel;
+    QIODevice *m_writeChannel;
+    QByteArray m_buffer;
+    int m_readOffset;
+    bool m_hasError;
+    quint8 m_version;
+};
+
+/*!
+ * Returns a copy of @map where QDBusArgument values have been converted to
+ * QVariantMap, or dropped if that's not possible: the QDataStream
+ * serialization would fail on them. If there's nothing to convert, @map
+ * itself is returned, without any copying.
+ */
+QVariantMap filterOutComplexTypes(const QVariantMap &map);
+
+} // namespace SignOn
+
+#endif // FRAMEIOHANDLER_H
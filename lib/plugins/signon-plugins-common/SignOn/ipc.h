@@ -28,6 +28,70 @@
 #ifndef SIGNON_PLUGINS_COMMON_IPC_H
 #define SIGNON_PLUGINS_COMMON_IPC_H
 
+/*
+ * Handshake
+ *
+ * Once the plugin is loaded, signonpluginprocess writes
+ * SIGNON_IPC_READY_MESSAGE on its standard output; newer versions append
+ * SIGNON_IPC_PROTOCOL_TAG followed by the highest protocol version they
+ * support (for instance, "process started ipc:2"). signond picks the lowest
+ * of that version and of its own SIGNON_IPC_PROTOCOL_VERSION; if the result
+ * is at least SIGNON_IPC_FRAMED_PROTOCOL_VERSION, it sends PLUGIN_OP_PROTOCOL
+ * (encoded as in version 1) followed by the quint32 version to use.
+ * The plugin process accepts any version from
+ * SIGNON_IPC_FRAMED_PROTOCOL_VERSION up to the one it advertised, and replies
+ * with PLUGIN_RESPONSE_PROTOCOL (again encoded as in version 1) followed by
+ * the quint32 accepted version, or 0 if it refuses the request and stays on
+ * version 1. Only once the acknowledgement has been sent, by the plugin, and
+ * received, by signond, do both sides switch to the accepted protocol for
+ * all the subsequent traffic. If no acknowledgement arrives in time, signond
+ * stops the plugin process.
+ * Processes which don't advertise a version only speak version 1.
+ *
+ * Version 1
+ *
+ * Each message starts with a quint32 operation (or response) code, followed
+ * by operation specific data; session data is sent as an int size followed by
+ * QByteArray pages (see BlobIOHandler).
+ *
+ * Version 2
+ *
+ * Each message is a frame, made of a header followed by the payload:
+ *   quint32 size       size of the rest of the frame (header included)
+ *   quint8  version    the negotiated protocol version
+ *   quint8  flags      reserved, must be 0
+ *   quint16 opcode     a PluginOperation or a PluginResponse
+ *   quint32 requestId  the request the frame belongs to
+ * All integers are big endian. The payload is QDataStream-encoded:
+ *   PLUGIN_OP_PROCESS              QString mechanism, QVariantMap data
+ *   PLUGIN_OP_PROCESS_UI,
+ *   PLUGIN_OP_REFRESH              QVariantMap data
+ *   PLUGIN_RESPONSE_RESULT,
+ *   PLUGIN_RESPONSE_STORE,
+ *   PLUGIN_RESPONSE_UI,
+ *   PLUGIN_RESPONSE_REFRESHED      QVariantMap data
+ *   PLUGIN_RESPONSE_ERROR          quint32 error, QString message
+ *   PLUGIN_RESPONSE_SIGNAL         quint32 state, QString message
+ *   PLUGIN_RESPONSE_TYPE           QString type
+ *   PLUGIN_RESPONSE_MECHANISMS     QStringList mechanisms
+ *   PLUGIN_RESPONSE_CONCURRENCY    quint32 maximum number of requests
+ * Other frames have an empty payload. Responses carry the requestId of the
+ * operation they refer to.
+ * If the plugin supports it (see PLUGIN_OP_CONCURRENCY), several
+ * PLUGIN_OP_PROCESS requests can be sent without waiting for the previous
+ * ones to complete; the replies are sent in the same order. signond treats
+ * a reply to any other than the oldest pending request as a protocol error
+ * and restarts the plugin process.
+ */
+#define SIGNON_IPC_READY_MESSAGE "process started"
+#define SIGNON_IPC_PROTOCOL_TAG " ipc:"
+#define SIGNON_IPC_PROTOCOL_VERSION 2
+/* The first protocol version which uses frames */
+#define SIGNON_IPC_FRAMED_PROTOCOL_VERSION 2
+
+#define SIGNON_IPC_FRAME_HEADER_SIZE 12
+#define SIGNON_IPC_MAX_FRAME_SIZE (64 * 1024 * 1024)
+
 enum PluginOperation {
     PLUGIN_OP_TYPE = 1,
     PLUGIN_OP_MECHANISMS,
@@ -36,6 +100,8 @@ enum PluginOperation {
     PLUGIN_OP_REFRESH,
     PLUGIN_OP_CANCEL,
     PLUGIN_OP_STOP,
+    PLUGIN_OP_PROTOCOL,
+    PLUGIN_OP_CONCURRENCY,
     PLUGIN_OP_LAST
 };
 
@@ -46,6 +112,10 @@ enum PluginResponse {
     PLUGIN_RESPONSE_SIGNAL,
     PLUGIN_RESPONSE_UI,
     PLUGIN_RESPONSE_REFRESHED,
+    PLUGIN_RESPONSE_TYPE,
+    PLUGIN_RESPONSE_MECHANISMS,
+    PLUGIN_RESPONSE_CONCURRENCY,
+    PLUGIN_RESPONSE_PROTOCOL,
     PLUGIN_RESPONSE_LAST
 };
 
@@ -14,9 +14,11 @@ INCLUDEPATH += ../ \
 DEFINES += SIGNON_PLUGIN_TRACE
 
 SOURCES += \
-    SignOn/blobiohandler.cpp
+    SignOn/blobiohandler.cpp \
+    SignOn/frameiohandler.cpp
 HEADERS += \
     SignOn/blobiohandler.h \
+    SignOn/frameiohandler.h \
     SignOn/ipc.h
 
 headers.files = \
@@ -34,6 +34,7 @@
 
 #include <QSharedDataPointer>
 #include <QString>
+#include <QStringList>
 
 class QDBusConnection;
 class QDBusMessage;
@@ -157,6 +158,38 @@ public:
     virtual AccessReply *handleRequest(const AccessRequest &request);
 };
 
+/*!
+ * @class BulkAccessControlInterface
+ * Optional interface for AbstractAccessControlManager implementations which
+ * can check a whole list of security contexts in one go (for instance, by
+ * fetching the security label of the peer only once). Implementations must
+ * inherit from it and list it in their Q_INTERFACES(); otherwise, signond
+ * calls AbstractAccessControlManager::isPeerAllowedToAccess() on each
+ * security context.
+ * @ingroup Accounts_and_SSO_Framework
+ */
+class SIGNON_EXPORT BulkAccessControlInterface
+{
+public:
+    virtual ~BulkAccessControlInterface() {}
+
+    /*!
+     * Checks which of the given security contexts a client process is allowed
+     * to access.
+     * @param peerConnection the connection over which the message was sent.
+     * @param peerMessage, the request message sent over DBUS by the process.
+     * @param securityContexts, the securityContexts to be checked against.
+     * @returns the subset of securityContexts which the peer is allowed to
+     * access, in the same order.
+     */
+    virtual QStringList allowedContexts(const QDBusConnection &peerConnection,
+                                        const QDBusMessage &peerMessage,
+                                        const QStringList &securityContexts) = 0;
+};
+
 } // namespace
 
+Q_DECLARE_INTERFACE(SignOn::BulkAccessControlInterface,
+                    "com.nokia.SingleSignOn.BulkAccessControlInterface/1.0")
+
 #endif // SIGNON_ABSTRACT_ACCESS_CONTROL_MANAGER_H
@@ -249,6 +249,11 @@
 #define SIGNOND_INCORRECT_DATE_ERR_NAME \
     SIGNOND_STRING(SIGNOND_ERR_PREFIX "IncorrectDate")
 
+#define SIGNOND_TOO_MANY_REQUESTS_ERR_STR \
+    SIGNOND_STRING("Too many requests from this client.")
+#define SIGNOND_TOO_MANY_REQUESTS_ERR_NAME \
+    SIGNOND_STRING(SIGNOND_ERR_PREFIX "TooManyRequests")
+
 #define SIGNOND_USER_ERROR_ERR_NAME SIGNOND_STRING(SIGNOND_ERR_PREFIX "User")
 
 
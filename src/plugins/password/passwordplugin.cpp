@@ -29,9 +29,11 @@ using namespace SignOn;
 namespace PasswordPluginNS {
 
 PasswordPlugin::PasswordPlugin(QObject *parent):
-    AuthPluginInterface(parent)
+    AuthPluginInterface(parent),
+    m_isWaitingForUser(false)
 {
     TRACE();
+    setMaxConcurrentRequests(16);
 }
 
 PasswordPlugin::~PasswordPlugin()
@@ -54,6 +56,17 @@ QStringList PasswordPlugin::mechanisms() const
 void PasswordPlugin::cancel()
 {
     emit error(Error(Error::SessionCanceled));
+
+    if (m_isWaitingForUser) {
+        m_isWaitingForUser = false;
+        processPendingRequests();
+    }
+}
+
+void PasswordPlugin::processPendingRequests()
+{
+    while (!m_isWaitingForUser && !m_pendingRequests.isEmpty())
+        process(m_pendingRequests.dequeue());
 }
 
 /*
@@ -64,6 +77,12 @@ void PasswordPlugin::process(const SignOn::SessionData &inData,
 {
     TRACE();
     Q_UNUSED(mechanism);
+
+    if (m_isWaitingForUser) {
+        m_pendingRequests.enqueue(inData);
+        return;
+    }
+
     SignOn::SessionData response;
 
     if (!inData.UserName().isEmpty())
@@ -83,6 +102,7 @@ void PasswordPlugin::process(const SignOn::SessionData &inData,
         data.setUserName(inData.UserName());
 
     data.setQueryPassword(true);
+    m_isWaitingForUser = true;
     emit userActionRequired(data);
 
     return;
@@ -91,23 +111,22 @@ void PasswordPlugin::process(const SignOn::SessionData &inData,
 void PasswordPlugin::userActionFinished(const SignOn::UiSessionData &data)
 {
     TRACE();
+    m_isWaitingForUser = false;
 
     if (data.QueryErrorCode() == QUERY_ERROR_NONE) {
         SignOn::SessionData response;
         response.setUserName(data.UserName());
         response.setSecret(data.Secret());
         emit result(response);
-        return;
-    }
-
-    if (data.QueryErrorCode() == QUERY_ERROR_CANCELED)
+    } else if (data.QueryErrorCode() == QUERY_ERROR_CANCELED) {
         emit error(Error::SessionCanceled);
-    else
+    } else {
         emit error(Error(Error::UserInteraction,
                    QLatin1String("userActionFinished error: ")
                    + QString::number(data.QueryErrorCode())));
+    }
 
-    return;
+    processPendingRequests();
 }
 
 SIGNON_DECL_AUTH_PLUGIN(PasswordPlugin)
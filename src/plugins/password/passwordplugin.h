@@ -54,6 +54,15 @@ public Q_SLOTS:
                  const QString &mechanism = 0);
     void userActionFinished(const SignOn::UiSessionData &data);
 //    void refresh(const SignOn::UiSessionData &data);
+
+private:
+    void processPendingRequests();
+
+private:
+    /* Requests received while waiting for the user: since replies must be
+     * sent in order, they are processed afterwards */
+    QQueue<SignOn::SessionData> m_pendingRequests;
+    bool m_isWaitingForUser;
 };
 
 } //namespace PasswordPluginNS
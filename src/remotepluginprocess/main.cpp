@@ -35,6 +35,9 @@ extern "C" {
 #include "debug.h"
 #include "remotepluginprocess.h"
 
+// signon-plugins-common
+#include "SignOn/ipc.h"
+
 #include <QDebug>
 
 using namespace RemotePluginProcessNS;
@@ -95,7 +98,10 @@ int main(int argc, char *argv[])
     if (!process)
         return 1;
 
-    fprintf(stdout, "process started");
+    /* Let signond know that we are ready, and which version of the
+     * protocol we support */
+    fprintf(stdout, SIGNON_IPC_READY_MESSAGE SIGNON_IPC_PROTOCOL_TAG "%d",
+            SIGNON_IPC_PROTOCOL_VERSION);
     fflush(stdout);
 
     QObject::connect(process, SIGNAL(processStopped()), &app, SLOT(quit()));
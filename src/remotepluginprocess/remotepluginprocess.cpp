@@ -45,11 +45,14 @@ namespace RemotePluginProcessNS {
 
 RemotePluginProcess::RemotePluginProcess(QObject *parent):
     QObject(parent),
-    m_currentOperation(PLUGIN_OP_STOP)
+    m_currentOperation(PLUGIN_OP_STOP),
+    m_currentRequestId(0)
 {
     m_plugin = NULL;
     m_readnotifier = NULL;
     m_errnotifier = NULL;
+    m_blobIOHandler = NULL;
+    m_frameIOHandler = NULL;
 
     qRegisterMetaType<SignOn::SessionData>("SignOn::SessionData");
     qRegisterMetaType<QString>("QString");
@@ -60,6 +63,7 @@ RemotePluginProcess::~RemotePluginProcess()
     delete m_plugin;
     delete m_readnotifier;
     delete m_errnotifier;
+    delete m_frameIOHandler;
 }
 
 RemotePluginProcess *
@@ -192,89 +196,116 @@ void RemotePluginProcess::blobIOError()
         QLatin1String("Failed to I/O session data to/from the signon daemon.")));
 }
 
+void RemotePluginProcess::sendSessionData(quint32 response,
+                                          const QVariantMap &data)
+{
+    if (m_frameIOHandler) {
+        m_frameIOHandler->sendFrame(response, m_currentRequestId,
+                                    FrameIOHandler::encodeMap(data));
+    } else {
+        QDataStream out(&m_outFile);
+        out << response;
+        m_blobIOHandler->sendData(data);
+    }
+
+    m_outFile.flush();
+}
+
 void RemotePluginProcess::result(const SignOn::SessionData &data)
 {
-    QDataStream out(&m_outFile);
     QVariantMap resultDataMap;
 
     foreach(QString key, data.propertyNames())
         resultDataMap[key] = data.getProperty(key);
 
-    out << (quint32)PLUGIN_RESPONSE_RESULT;
-
-    m_blobIOHandler->sendData(resultDataMap);
-
-    m_outFile.flush();
+    sendSessionData(PLUGIN_RESPONSE_RESULT, resultDataMap);
+    requestFinished();
 }
 
 void RemotePluginProcess::store(const SignOn::SessionData &data)
 {
-    QDataStream out(&m_outFile);
     QVariantMap storeDataMap;
 
     foreach(QString key, data.propertyNames())
         storeDataMap[key] = data.getProperty(key);
 
-    out << (quint32)PLUGIN_RESPONSE_STORE;
-
-    m_blobIOHandler->sendData(storeDataMap);
-
-    m_outFile.flush();
+    sendSessionData(PLUGIN_RESPONSE_STORE, storeDataMap);
 }
 
 void RemotePluginProcess::error(const SignOn::Error &err)
 {
-    QDataStream out(&m_outFile);
+    if (m_frameIOHandler) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << (quint32)err.type();
+        out << err.message();
+        m_frameIOHandler->sendFrame(PLUGIN_RESPONSE_ERROR, m_currentRequestId,
+                                    payload);
+    } else {
+        QDataStream out(&m_outFile);
 
-    out << (quint32)PLUGIN_RESPONSE_ERROR;
-    out << (quint32)err.type();
-    out << err.message();
+        out << (quint32)PLUGIN_RESPONSE_ERROR;
+        out << (quint32)err.type();
+        out << err.message();
+    }
     m_outFile.flush();
+    requestFinished();
 
     TRACE() << "error is sent" << err.type() << " " << err.message();
 }
 
+void RemotePluginProcess::requestFinished()
+{
+    if (m_requestIds.isEmpty())
+        return;
+
+    /* Plugins reply to concurrent requests in order */
+    m_requestIds.dequeue();
+    m_currentRequestId = m_requestIds.isEmpty() ? 0 : m_requestIds.head();
+}
+
 void RemotePluginProcess::userActionRequired(const SignOn::UiSessionData &data)
 {
     TRACE();
 
-    QDataStream out(&m_outFile);
     QVariantMap resultDataMap;
 
     foreach(QString key, data.propertyNames())
         resultDataMap[key] = data.getProperty(key);
 
-    out << (quint32)PLUGIN_RESPONSE_UI;
-    m_blobIOHandler->sendData(resultDataMap);
-    m_outFile.flush();
+    sendSessionData(PLUGIN_RESPONSE_UI, resultDataMap);
 }
 
 void RemotePluginProcess::refreshed(const SignOn::UiSessionData &data)
 {
     TRACE();
 
-    QDataStream out(&m_outFile);
     QVariantMap resultDataMap;
 
     foreach(QString key, data.propertyNames())
         resultDataMap[key] = data.getProperty(key);
 
-    out << (quint32)PLUGIN_RESPONSE_REFRESHED;
-
-    m_blobIOHandler->sendData(resultDataMap);
-
-    m_outFile.flush();
+    sendSessionData(PLUGIN_RESPONSE_REFRESHED, resultDataMap);
 }
 
 void RemotePluginProcess::statusChanged(const AuthPluginState state,
                                         const QString &message)
 {
     TRACE();
-    QDataStream out(&m_outFile);
+    if (m_frameIOHandler) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << (quint32)state;
+        out << message;
+        m_frameIOHandler->sendFrame(PLUGIN_RESPONSE_SIGNAL, m_currentRequestId,
+                                    payload);
+    } else {
+        QDataStream out(&m_outFile);
 
-    out << (quint32)PLUGIN_RESPONSE_SIGNAL;
-    out << (quint32)state;
-    out << message;
+        out << (quint32)PLUGIN_RESPONSE_SIGNAL;
+        out << (quint32)state;
+        out << message;
+    }
 
     m_outFile.flush();
 }
@@ -340,6 +371,140 @@ void RemotePluginProcess::refresh()
     m_blobIOHandler->receiveData(processBlobSize);
 }
 
+void RemotePluginProcess::setupProtocol()
+{
+    QDataStream in(&m_inFile);
+    quint32 version = 0;
+    in >> version;
+
+    bool accepted = version >= SIGNON_IPC_FRAMED_PROTOCOL_VERSION &&
+        version <= SIGNON_IPC_PROTOCOL_VERSION;
+    if (!accepted)
+        qCritical() << "Unsupported protocol version:" << version;
+
+    /* The acknowledgement is the last message encoded with the old
+     * protocol; signond won't switch until it has received it */
+    QDataStream out(&m_outFile);
+    out << (quint32)PLUGIN_RESPONSE_PROTOCOL;
+    out << (accepted ? version : quint32(0));
+    if (!m_outFile.flush() || !accepted)
+        return;
+
+    TRACE() << "Switching to protocol version" << version;
+    m_frameIOHandler = new FrameIOHandler(&m_inFile, &m_outFile,
+                                          quint8(version));
+
+    /* The first frames might have been buffered already */
+    m_frameIOHandler->readAvailableData();
+    processFrames();
+}
+
+void RemotePluginProcess::readFrames()
+{
+    if (m_frameIOHandler->readAvailableData() == 0) {
+        /* We have been notified, but there's nothing to read: the daemon
+         * has closed the channel */
+        TRACE() << "No more data from signond";
+        m_plugin->abort();
+        emit processStopped();
+        return;
+    }
+
+    processFrames();
+}
+
+void RemotePluginProcess::processFrames()
+{
+    FrameIOHandler::Frame frame;
+    bool isStopped = false;
+
+    while (!isStopped && m_frameIOHandler->takeFrame(frame))
+        isStopped = !handleFrame(frame);
+
+    if (m_frameIOHandler->hasError()) {
+        qCritical() << "Invalid data received from signond";
+        isStopped = true;
+    }
+
+    if (!isStopped && !m_outFile.flush())
+        isStopped = true;
+
+    if (isStopped) {
+        m_plugin->abort();
+        emit processStopped();
+    }
+}
+
+bool RemotePluginProcess::handleFrame(const FrameIOHandler::Frame &frame)
+{
+    QDataStream in(frame.payload);
+
+    switch (frame.opcode) {
+    case PLUGIN_OP_CANCEL:
+        m_plugin->cancel();
+        break;
+    case PLUGIN_OP_TYPE:
+        {
+            QByteArray payload;
+            QDataStream out(&payload, QIODevice::WriteOnly);
+            out << m_plugin->type();
+            m_frameIOHandler->sendFrame(PLUGIN_RESPONSE_TYPE, frame.requestId,
+                                        payload);
+        }
+        break;
+    case PLUGIN_OP_MECHANISMS:
+        {
+            QByteArray payload;
+            QDataStream out(&payload, QIODevice::WriteOnly);
+            out << m_plugin->mechanisms();
+            m_frameIOHandler->sendFrame(PLUGIN_RESPONSE_MECHANISMS,
+                                        frame.requestId, payload);
+        }
+        break;
+    case PLUGIN_OP_CONCURRENCY:
+        {
+            QByteArray payload;
+            QDataStream out(&payload, QIODevice::WriteOnly);
+            out << quint32(m_plugin->maxConcurrentRequests());
+            m_frameIOHandler->sendFrame(PLUGIN_RESPONSE_CONCURRENCY,
+                                        frame.requestId, payload);
+        }
+        break;
+    case PLUGIN_OP_PROCESS:
+        {
+            QString mechanism;
+            QVariantMap sessionDataMap;
+            in >> mechanism;
+            in >> sessionDataMap;
+            if (m_requestIds.count() >= m_plugin->maxConcurrentRequests()) {
+                qCritical() << "Too many concurrent requests";
+                return false;
+            }
+            m_requestIds.enqueue(frame.requestId);
+            m_currentRequestId = m_requestIds.head();
+            m_plugin->process(SessionData(sessionDataMap), mechanism);
+        }
+        break;
+    case PLUGIN_OP_PROCESS_UI:
+        m_currentRequestId = frame.requestId;
+        m_plugin->userActionFinished(
+            UiSessionData(FrameIOHandler::decodeMap(frame.payload)));
+        break;
+    case PLUGIN_OP_REFRESH:
+        m_currentRequestId = frame.requestId;
+        m_plugin->refresh(
+            UiSessionData(FrameIOHandler::decodeMap(frame.payload)));
+        break;
+    case PLUGIN_OP_STOP:
+        return false;
+    default:
+        qCritical() << " unknown operation code: " << frame.opcode;
+        return false;
+    }
+
+    return true;
+}
+
 void RemotePluginProcess::sessionDataReceived(const QVariantMap &sessionDataMap)
 {
     if (m_currentOperation == PLUGIN_OP_PROCESS) {
@@ -366,6 +531,11 @@ void RemotePluginProcess::sessionDataReceived(const QVariantMap &sessionDataMap)
 
 void RemotePluginProcess::startTask()
 {
+    if (m_frameIOHandler) {
+        readFrames();
+        return;
+    }
+
     if (m_blobIOHandler->isReading()) {
         /* A data blob is being read; there's nothing for us here */
         return;
@@ -408,6 +578,10 @@ void RemotePluginProcess::startTask()
     case PLUGIN_OP_STOP:
         is_stopped = true;
         break;
+    case PLUGIN_OP_PROTOCOL:
+        setupProtocol();
+        /* The frames have been handled, output flushed already */
+        return;
     default:
         {
             qCritical() << " unknown operation code: " << opcode;
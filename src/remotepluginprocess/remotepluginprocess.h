@@ -35,12 +35,16 @@
 #include <QFile>
 #include <QDir>
 #include <QLibrary>
+#include <QQueue>
 #include <QSocketNotifier>
 #include <QThread>
 
 #include "SignOn/uisessiondata.h"
 #include "SignOn/authpluginif.h"
 
+// signon-plugins-common
+#include "SignOn/frameiohandler.h"
+
 extern "C" {
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -100,10 +104,16 @@ private:
     QSocketNotifier *m_errnotifier;
 
     BlobIOHandler *m_blobIOHandler;
+    /* Only set once the framed protocol has been negotiated */
+    FrameIOHandler *m_frameIOHandler;
 
     //Requiered for async session data reading
     quint32 m_currentOperation;
     QString m_currentMechanism;
+    //The request whose responses are being sent
+    quint32 m_currentRequestId;
+    //The requests being processed by the plugin, oldest first
+    QQueue<quint32> m_requestIds;
 
 private:
     QString getPluginName(const QString &type);
@@ -115,6 +125,13 @@ private:
     void userActionFinished();
     void refresh();
 
+    void setupProtocol();
+    void readFrames();
+    void processFrames();
+    bool handleFrame(const FrameIOHandler::Frame &frame);
+    void sendSessionData(quint32 response, const QVariantMap &data);
+    void requestFinished();
+
 private Q_SLOTS:
     void result(const SignOn::SessionData &data);
     void store(const SignOn::SessionData &data);
@@ -26,12 +26,9 @@
 
 #include <QBuffer>
 #include <QDBusConnection>
-#include <QDBusConnectionInterface>
-#ifdef ENABLE_P2P
-#include <dbus/dbus.h>
-#endif
 
 #include "accesscontrolmanagerhelper.h"
+#include "peercache.h"
 #include "signond-common.h"
 #include "credentialsaccessmanager.h"
 #include "signonidentity.h"
@@ -66,6 +63,26 @@ AccessControlManagerHelper::~AccessControlManagerHelper()
 bool AccessControlManagerHelper::isPeerAllowedToUseIdentity(
                                        const PeerContext &peerContext,
                                        const quint32 identityId)
+{
+    /* Cached grants are only valid while the storage is available */
+    if (CredentialsAccessManager::instance()->credentialsDB() == 0) {
+        TRACE() << "NULL db pointer, secure storage might be unavailable,";
+        return false;
+    }
+
+    PeerCache *peerCache = PeerCache::instance();
+    if (peerCache->hasAccess(peerContext, identityId))
+        return true;
+
+    bool isAllowed = checkIdentityAccess(peerContext, identityId);
+    if (isAllowed)
+        peerCache->addAccess(peerContext, identityId);
+    return isAllowed;
+}
+
+bool AccessControlManagerHelper::checkIdentityAccess(
+                                       const PeerContext &peerContext,
+                                       const quint32 identityId)
 {
     // TODO - improve this, the error handling and more precise behaviour
 
@@ -76,11 +93,7 @@ bool AccessControlManagerHelper::isPeerAllowedToUseIdentity(
     }
     QStringList acl = db->accessControlList(identityId);
 
-    TRACE() << QString(QLatin1String("Access control list of identity: "
-                                 "%1: [%2].Tokens count: %3"))
-                                .arg(identityId)
-                                .arg(acl.join(QLatin1String(", ")))
-                                .arg(acl.size());
+    TRACE() << "Access control list of identity" << identityId << ":" << acl;
 
     if (db->errorOccurred())
         return false;
@@ -99,6 +112,32 @@ bool AccessControlManagerHelper::isPeerAllowedToUseIdentity(
     return peerHasOneOfAccesses(peerContext, acl);
 }
 
+bool AccessControlManagerHelper::isPeerAllowedToUseIdentity(
+                                       const PeerContext &peerContext,
+                                       const SignonIdentityInfo &info,
+                                       AccessCache &accessCache)
+{
+    PeerCache *peerCache = PeerCache::instance();
+    if (peerCache->hasAccess(peerContext, info.id()))
+        return true;
+
+    bool isAllowed = false;
+    QStringList ownerSecContexts = info.ownerList();
+    QStringList acl = info.accessControlList();
+    if (!ownerSecContexts.isEmpty() &&
+        peerHasOneOfAccesses(peerContext, ownerSecContexts, accessCache)) {
+        isAllowed = true;
+    } else if (acl.contains(QLatin1String("*"))) {
+        isAllowed = true;
+    } else if (!acl.isEmpty()) {
+        isAllowed = peerHasOneOfAccesses(peerContext, acl, accessCache);
+    }
+
+    if (isAllowed)
+        peerCache->addAccess(peerContext, info.id());
+    return isAllowed;
+}
+
 AccessControlManagerHelper::IdentityOwnership
 AccessControlManagerHelper::isPeerOwnerOfIdentity(
                                        const PeerContext &peerContext,
@@ -133,10 +172,14 @@ AccessControlManagerHelper::isPeerKeychainWidget(
 QString AccessControlManagerHelper::appIdOfPeer(
                                        const PeerContext &peerContext)
 {
-    TRACE() << m_acManager->appIdOfPeer(peerContext.connection(),
-                                        peerContext.message());
-    return m_acManager->appIdOfPeer(peerContext.connection(),
-                                    peerContext.message());
+    PeerCache::Peer &peer = PeerCache::instance()->peer(peerContext);
+    if (!peer.m_hasAppId) {
+        peer.m_appId = m_acManager->appIdOfPeer(peerContext.connection(),
+                                                peerContext.message());
+        peer.m_hasAppId = true;
+    }
+    TRACE() << peer.m_appId;
+    return peer.m_appId;
 }
 
 bool
@@ -144,15 +187,68 @@ AccessControlManagerHelper::peerHasOneOfAccesses(
                                        const PeerContext &peerContext,
                                        const QStringList secContexts)
 {
-    foreach(QString securityContext, secContexts)
+    TRACE() << secContexts;
+    if (!allowedContexts(peerContext, secContexts).isEmpty())
+        return true;
+
+    BLAME() << "given peer does not have needed permissions";
+    return false;
+}
+
+bool
+AccessControlManagerHelper::peerHasOneOfAccesses(
+                                       const PeerContext &peerContext,
+                                       const QStringList &secContexts,
+                                       AccessCache &accessCache)
+{
+    /* Only ask the access control manager about the contexts which have not
+     * been evaluated yet, all of them in one call */
+    QStringList unknownContexts;
+    foreach(const QString &securityContext, secContexts)
     {
-        TRACE() << securityContext;
-        if (isPeerAllowedToAccess(peerContext, securityContext))
+        AccessCache::const_iterator i = accessCache.constFind(securityContext);
+        if (i == accessCache.constEnd()) {
+            unknownContexts.append(securityContext);
+        } else if (i.value()) {
             return true;
+        }
     }
 
-    BLAME() << "given peer does not have needed permissions";
-    return false;
+    if (unknownContexts.isEmpty())
+        return false;
+
+    QStringList allowed = allowedContexts(peerContext, unknownContexts);
+    foreach(const QString &securityContext, unknownContexts) {
+        accessCache.insert(securityContext,
+                           allowed.contains(securityContext));
+    }
+
+    return !allowed.isEmpty();
+}
+
+QStringList
+AccessControlManagerHelper::allowedContexts(const PeerContext &peerContext,
+                                            const QStringList &secContexts)
+{
+    if (secContexts.isEmpty())
+        return QStringList();
+
+    SignOn::BulkAccessControlInterface *bulkManager =
+        qobject_cast<SignOn::BulkAccessControlInterface *>(m_acManager);
+    if (bulkManager != 0) {
+        return bulkManager->allowedContexts(peerContext.connection(),
+                                            peerContext.message(),
+                                            secContexts);
+    }
+
+    QStringList allowed;
+    foreach(const QString &securityContext, secContexts) {
+        if (m_acManager->isPeerAllowedToAccess(peerContext.connection(),
+                                               peerContext.message(),
+                                               securityContext))
+            allowed.append(securityContext);
+    }
+    return allowed;
 }
 
 bool
@@ -168,26 +264,7 @@ AccessControlManagerHelper::isPeerAllowedToAccess(
 
 pid_t AccessControlManagerHelper::pidOfPeer(const PeerContext &peerContext)
 {
-    QString service = peerContext.message().service();
-    if (service.isEmpty()) {
-#ifdef ENABLE_P2P
-        DBusConnection *connection =
-            (DBusConnection *)peerContext.connection().internalPointer();
-        unsigned long pid = 0;
-        dbus_bool_t ok = dbus_connection_get_unix_process_id(connection,
-                                                             &pid);
-        if (Q_UNLIKELY(!ok)) {
-            BLAME() << "Couldn't get PID of caller!";
-            return 0;
-        }
-        return pid;
-#else
-        BLAME() << "Empty caller name, and no P2P support enabled";
-        return 0;
-#endif
-    } else {
-        return peerContext.connection().interface()->servicePid(service).value();
-    }
+    return PeerCache::instance()->peer(peerContext).m_pid;
 }
 
 SignOn::AccessReply *
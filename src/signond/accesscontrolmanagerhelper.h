@@ -35,6 +35,7 @@
 
 #include "peercontext.h"
 #include "signonauthsession.h"
+#include "signonidentityinfo.h"
 #include "SignOn/abstract-access-control-manager.h"
 
 namespace SignonDaemonNS {
@@ -73,6 +74,7 @@ public:
 
     /*!
      * Checks if a client process is allowed to use a specific SignonIdentity.
+     * Grants are remembered in the PeerCache, until the identity changes.
      * @param peerContext the peer connection over which the message was sent.
      * @param identityId, the SignonIdentity to be used.
      * @returns true, if the peer is allowed, false otherwise.
@@ -80,6 +82,27 @@ public:
     bool isPeerAllowedToUseIdentity(const PeerContext &peerContext,
                                     const quint32 identityId);
 
+    /*!
+     * @typedef AccessCache
+     * Results of the security context checks done for one peer, used to
+     * avoid repeating them when checking several identities at once.
+     */
+    typedef QHash<QString, bool> AccessCache;
+
+    /*!
+     * Checks if a client process is allowed to use a SignonIdentity whose
+     * information, including the owner and access control lists, has
+     * already been loaded; no database query is made.
+     * @param peerContext the peer connection over which the message was sent.
+     * @param info, the information on the SignonIdentity to be used.
+     * @param accessCache, the checks already done for the same peer; it is
+     * updated with the new ones.
+     * @returns true, if the peer is allowed, false otherwise.
+     */
+    bool isPeerAllowedToUseIdentity(const PeerContext &peerContext,
+                                    const SignonIdentityInfo &info,
+                                    AccessCache &accessCache);
+
     /*!
      * Checks if a specific process is the owner of a SignonIdentity, thus
      * having full control over it.
@@ -158,10 +181,28 @@ public:
     bool peerHasOneOfAccesses(const PeerContext &peerContext,
                               const QStringList secContexts);
 
+    /*!
+     * Checks which of the given security contexts a client process is allowed
+     * to access. If the access control manager implements
+     * SignOn::BulkAccessControlInterface, this is done with a single call.
+     * @param peerContext the peer connection over which the message was sent.
+     * @param secContexts, the securityContexts to be checked against.
+     * @returns the subset of secContexts the peer is allowed to access.
+     */
+    QStringList allowedContexts(const PeerContext &peerContext,
+                                const QStringList &secContexts);
+
     SignOn::AccessReply *
         requestAccessToIdentity(const PeerContext &peerContext,
                                 quint32 id);
 
+private:
+    bool checkIdentityAccess(const PeerContext &peerContext,
+                             const quint32 identityId);
+    bool peerHasOneOfAccesses(const PeerContext &peerContext,
+                              const QStringList &secContexts,
+                              AccessCache &accessCache);
+
 private:
     SignOn::AbstractAccessControlManager *m_acManager;
     static AccessControlManagerHelper* m_pInstance;
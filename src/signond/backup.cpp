@@ -33,6 +33,7 @@
 #include "backup_adaptor.h"
 #include "credentialsaccessmanager.h"
 #include "signond-common.h"
+#include "signondaemon.h"
 
 #define BACKUP_DIR_NAME() \
     (QDir::separator() + QLatin1String("backup"))
@@ -231,6 +232,10 @@ bool Backup::createStorageFileTree(const QStringList &backupFiles) const
 uchar Backup::backupStarts()
 {
     TRACE() << "backup";
+    /* The storage is opened lazily; the backup needs the CAM set up */
+    if (!m_backup)
+        SignonDaemon::instance()->ensureInitialized();
+
     if (!m_backup && m_cam->credentialsSystemOpened())
     {
         m_cam->closeCredentialsSystem();
@@ -303,6 +308,9 @@ uchar Backup::restoreStarts()
 uchar Backup::restoreFinished()
 {
     TRACE() << "restore";
+    if (!m_backup)
+        SignonDaemon::instance()->ensureInitialized();
+
     //restore requested
     if (m_cam->credentialsSystemOpened())
     {
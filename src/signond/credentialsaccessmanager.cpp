@@ -27,9 +27,11 @@
 #define SIGNON_ENABLE_UNSTABLE_APIS
 #include "credentialsaccessmanager.h"
 
+#include "databasereaders.h"
 #include "default-crypto-manager.h"
 #include "default-key-authorizer.h"
 #include "default-secrets-storage.h"
+#include "peercache.h"
 #include "signond-common.h"
 
 #include "SignOn/ExtensionInterface"
@@ -471,6 +473,9 @@ bool CredentialsAccessManager::openCredentialsSystem()
         return false;
     }
 
+    /* The DB file might have been replaced while it was closed */
+    DatabaseReaders::instance()->invalidateConnections();
+
     m_systemOpened = true;
 
     if (m_cryptoManager->fileSystemIsMounted()) {
@@ -501,6 +506,11 @@ bool CredentialsAccessManager::closeCredentialsSystem()
         allClosed = false;
 
     closeMetaDataDB();
+    DatabaseReaders::instance()->invalidateConnections();
+
+    /* The storage might come back with different contents (for instance,
+     * after a restore): the access decisions must be taken again */
+    PeerCache::instance()->invalidateAccess(SIGNOND_NEW_IDENTITY);
 
     m_error = NoError;
     m_systemOpened = false;
@@ -794,6 +794,101 @@ SignonIdentityInfo MetaDataDB::identity(const quint32 id)
     return info;
 }
 
+QHash<quint32, SignonIdentityInfo>
+MetaDataDB::identities(const QList<quint32> &ids)
+{
+    QHash<quint32, SignonIdentityInfo> result;
+    if (ids.isEmpty()) return result;
+
+    QStringList idList;
+    foreach (quint32 id, ids)
+        idList.append(QString::number(id));
+    QString idSet = idList.join(QLatin1Char(','));
+
+    QSqlQuery query = exec(QString::fromLatin1(
+            "SELECT id, caption, username, flags, type "
+            "FROM credentials WHERE id IN (%1)").arg(idSet));
+    if (errorOccurred()) return result;
+
+    while (query.next()) {
+        quint32 id = query.value(0).toUInt();
+        int flags = query.value(3).toInt();
+        bool isUserNameSecret = flags & UserNameIsSecret;
+
+        SignonIdentityInfo &info = result[id];
+        info.setId(id);
+        if (!isUserNameSecret)
+            info.setUserName(query.value(2).toString());
+        info.setStorePassword(flags & RememberPassword);
+        info.setCaption(query.value(1).toString());
+        info.setType(query.value(4).toInt());
+        info.setRefCount(0);
+        info.setValidated(flags & Validated);
+        info.setUserNameSecret(isUserNameSecret);
+    }
+    query.clear();
+    if (result.isEmpty()) return result;
+
+    /* The lists of all the identities are read at once, and then split */
+    QHash<quint32, QStringList> realms;
+    query = exec(QString::fromLatin1(
+            "SELECT identity_id, realm FROM REALMS "
+            "WHERE identity_id IN (%1)").arg(idSet));
+    if (errorOccurred()) return QHash<quint32, SignonIdentityInfo>();
+    while (query.next())
+        realms[query.value(0).toUInt()].append(query.value(1).toString());
+    query.clear();
+
+    QHash<quint32, QStringList> ownerTokens;
+    query = exec(QString::fromLatin1(
+            "SELECT DISTINCT OWNER.identity_id, TOKENS.token FROM "
+            "( OWNER JOIN TOKENS ON OWNER.token_id = TOKENS.id ) "
+            "WHERE OWNER.identity_id IN (%1) "
+            "ORDER BY OWNER.identity_id, TOKENS.id").arg(idSet));
+    if (errorOccurred()) return QHash<quint32, SignonIdentityInfo>();
+    while (query.next())
+        ownerTokens[query.value(0).toUInt()].append(query.value(1).toString());
+    query.clear();
+
+    QHash<quint32, QStringList> securityTokens;
+    query = exec(QString::fromLatin1(
+            "SELECT DISTINCT ACL.identity_id, TOKENS.token FROM "
+            "( ACL JOIN TOKENS ON ACL.token_id = TOKENS.id ) "
+            "WHERE ACL.identity_id IN (%1) "
+            "ORDER BY ACL.identity_id, TOKENS.id").arg(idSet));
+    if (errorOccurred()) return QHash<quint32, SignonIdentityInfo>();
+    while (query.next())
+        securityTokens[query.value(0).toUInt()].append(
+            query.value(1).toString());
+    query.clear();
+
+    QHash<quint32, MethodMap> methods;
+    query = exec(QString::fromLatin1(
+            "SELECT DISTINCT ACL.identity_id, METHODS.method, "
+            "MECHANISMS.mechanism FROM "
+            "( ACL JOIN METHODS ON ACL.method_id = METHODS.id ) "
+            "LEFT JOIN MECHANISMS ON ACL.mechanism_id = MECHANISMS.id "
+            "WHERE ACL.identity_id IN (%1)").arg(idSet));
+    if (errorOccurred()) return QHash<quint32, SignonIdentityInfo>();
+    while (query.next()) {
+        QStringList &mechanisms =
+            methods[query.value(0).toUInt()][query.value(1).toString()];
+        if (!query.value(2).isNull())
+            mechanisms.append(query.value(2).toString());
+    }
+    query.clear();
+
+    QHash<quint32, SignonIdentityInfo>::iterator i;
+    for (i = result.begin(); i != result.end(); i++) {
+        quint32 id = i.key();
+        i.value().setMethods(methods.value(id));
+        i.value().setRealms(realms.value(id));
+        i.value().setAccessControlList(securityTokens.value(id));
+        i.value().setOwnerList(ownerTokens.value(id));
+    }
+    return result;
+}
+
 QList<SignonIdentityInfo> MetaDataDB::identities(const QMap<QString,
                                                  QString> &filter)
 {
@@ -1315,6 +1410,11 @@ bool CredentialsDB::init()
     return metaDataDB->init();
 }
 
+QString CredentialsDB::metaDataDbName() const
+{
+    return metaDataDB->databaseName();
+}
+
 bool CredentialsDB::openSecretsDB(const QString &secretsDbName)
 {
     QVariantMap configuration;
@@ -1402,6 +1502,13 @@ CredentialsDB::credentials(const QMap<QString, QString> &filter)
     return metaDataDB->identities(filter);
 }
 
+QHash<quint32, SignonIdentityInfo>
+CredentialsDB::credentials(const QList<quint32> &ids)
+{
+    INIT_ERROR();
+    return metaDataDB->identities(ids);
+}
+
 quint32 CredentialsDB::insertCredentials(const SignonIdentityInfo &info)
 {
     SignonIdentityInfo newInfo = info;
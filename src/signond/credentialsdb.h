@@ -89,6 +89,7 @@ public:
     ~CredentialsDB();
 
     bool init();
+    QString metaDataDbName() const;
     /*!
      * This method will open the DB file containing the user secrets.
      * If this method is not called, or if it fails, the secrets will not be
@@ -107,6 +108,7 @@ public:
                        const QString &username, const QString &password);
     SignonIdentityInfo credentials(const quint32 id, bool queryPassword = true);
     QList<SignonIdentityInfo> credentials(const QMap<QString, QString> &filter);
+    QHash<quint32, SignonIdentityInfo> credentials(const QList<quint32> &ids);
 
     quint32 insertCredentials(const SignonIdentityInfo &info);
     quint32 updateCredentials(const SignonIdentityInfo &info);
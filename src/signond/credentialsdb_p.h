@@ -151,6 +151,14 @@ public:
         m_database.setPassword(password);
     }
 
+    /*!
+     * Sets the driver specific options for the database connection.
+     * @param options
+     */
+    void setConnectOptions(const QString &options) {
+        m_database.setConnectOptions(options);
+    }
+
     /*!
      * @returns the database name.
      */
@@ -247,9 +255,9 @@ class MetaDataDB: public SqlDatabase
 {
     friend class ::TestDatabase;
 public:
-    MetaDataDB(const QString &name):
-        SqlDatabase(name, QLatin1String("SSO-metadata"),
-                    SSO_METADATADB_VERSION) {}
+    MetaDataDB(const QString &name,
+               const QString &connectionName = QLatin1String("SSO-metadata")):
+        SqlDatabase(name, connectionName, SSO_METADATADB_VERSION) {}
 
     bool createTables();
     bool updateDB(int version);
@@ -260,6 +268,9 @@ public:
     quint32 methodId(const QString &method);
     SignonIdentityInfo identity(const quint32 id);
     QList<SignonIdentityInfo> identities(const QMap<QString, QString> &filter);
+    /* Reads the identities with the given IDs, without their secrets; the
+     * ones not found are missing from the result */
+    QHash<quint32, SignonIdentityInfo> identities(const QList<quint32> &ids);
 
     quint32 updateIdentity(const SignonIdentityInfo &info);
     bool removeIdentity(const quint32 id);
@@ -0,0 +1,176 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "databasereaders.h"
+
+#include "credentialsdb_p.h"
+#include "signontrace.h"
+
+#include <QCoreApplication>
+#include <QRunnable>
+#include <QSqlDatabase>
+#include <QThreadPool>
+#include <QThreadStorage>
+
+using namespace SignonDaemonNS;
+
+/* How long a query waits for the main thread to finish writing, in msecs */
+static const int busyTimeout = 5000;
+
+static DatabaseReaders *readersInstance = NULL;
+
+namespace SignonDaemonNS {
+
+/* The DB connection of a worker thread */
+class ReaderConnection
+{
+public:
+    ReaderConnection(const QString &databaseName, int generation);
+    ~ReaderConnection();
+
+    QString databaseName() const { return m_db->databaseName(); }
+    int generation() const { return m_generation; }
+    bool isConnected() const { return m_isConnected; }
+    MetaDataDB *db() const { return m_db; }
+
+private:
+    QString m_connectionName;
+    MetaDataDB *m_db;
+    int m_generation;
+    bool m_isConnected;
+};
+
+class ReaderTask: public QRunnable
+{
+public:
+    ReaderTask(const QString &databaseName,
+               const DatabaseReaders::Query &query,
+               DatabaseReaders *readers):
+        m_databaseName(databaseName),
+        m_query(query),
+        m_readers(readers) {}
+
+    void run();
+
+private:
+    QString m_databaseName;
+    DatabaseReaders::Query m_query;
+    DatabaseReaders *m_readers;
+};
+
+} //namespace SignonDaemonNS
+
+/* Deleted by QThreadStorage when the worker thread exits */
+static QThreadStorage<ReaderConnection *> readerConnections;
+static QAtomicInt lastConnectionId;
+
+ReaderConnection::ReaderConnection(const QString &databaseName,
+                                   int generation):
+    m_connectionName(QString::fromLatin1("SSO-metadata-reader-%1").
+                     arg(lastConnectionId.fetchAndAddRelaxed(1) + 1)),
+    m_db(new MetaDataDB(databaseName, m_connectionName)),
+    m_generation(generation),
+    m_isConnected(false)
+{
+    m_db->setConnectOptions(QString::fromLatin1("QSQLITE_OPEN_READONLY;"
+                                                "QSQLITE_BUSY_TIMEOUT=%1").
+                            arg(busyTimeout));
+    m_isConnected = m_db->connect();
+    if (!m_isConnected) {
+        BLAME() << "Couldn't open" << databaseName << "for reading:" <<
+            m_db->lastError().text();
+    }
+}
+
+ReaderConnection::~ReaderConnection()
+{
+    delete m_db;
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+void ReaderTask::run()
+{
+    int generation = m_readers->generation();
+    ReaderConnection *connection = readerConnections.localData();
+    if (!connection || !connection->isConnected() ||
+        connection->generation() != generation ||
+        connection->databaseName() != m_databaseName) {
+        TRACE() << "Opening" << m_databaseName << "in worker thread";
+        /* Delete the previous connection before opening the new one */
+        readerConnections.setLocalData(0);
+        connection = new ReaderConnection(m_databaseName, generation);
+        readerConnections.setLocalData(connection);
+    }
+
+    MetaDataDB *db = connection->isConnected() ? connection->db() : NULL;
+    if (db) db->clearError();
+    m_query(db);
+}
+
+DatabaseReaders::DatabaseReaders(QObject *parent):
+    QObject(parent),
+    m_threadCount(0),
+    m_pool(new QThreadPool(this)),
+    m_generation(0)
+{
+    /* Keep the threads, and their DB connections, alive */
+    m_pool->setExpiryTimeout(-1);
+}
+
+DatabaseReaders::~DatabaseReaders()
+{
+    m_pool->waitForDone();
+    readersInstance = NULL;
+}
+
+DatabaseReaders *DatabaseReaders::instance()
+{
+    if (readersInstance == NULL)
+        readersInstance = new DatabaseReaders(QCoreApplication::instance());
+    return readersInstance;
+}
+
+void DatabaseReaders::setThreadCount(int count)
+{
+    m_threadCount = qMax(count, 0);
+    if (m_threadCount > 0)
+        m_pool->setMaxThreadCount(m_threadCount);
+}
+
+bool DatabaseReaders::run(const QString &databaseName, const Query &query)
+{
+    if (!isEnabled()) return false;
+
+    m_pool->start(new ReaderTask(databaseName, query, this));
+    return true;
+}
+
+void DatabaseReaders::invalidateConnections()
+{
+    m_generation.fetchAndAddOrdered(1);
+}
+
+void DatabaseReaders::waitForDone()
+{
+    m_pool->waitForDone();
+}
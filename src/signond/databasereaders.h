@@ -0,0 +1,97 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_DATABASEREADERS_H
+#define SIGNON_DATABASEREADERS_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QString>
+
+#include <functional>
+
+class QThreadPool;
+
+namespace SignonDaemonNS {
+
+class MetaDataDB;
+
+/*!
+ * @class DatabaseReaders
+ * Fixed pool of worker threads which run read-only queries on the metadata
+ * DB, so that the main thread doesn't block on them. Each thread has its own
+ * read-only connection to the DB; writes still happen in the main thread,
+ * and SQLite makes them visible to the queries started after they are
+ * committed. Replacing the DB file is not, hence invalidateConnections().
+ */
+class DatabaseReaders: public QObject
+{
+    Q_OBJECT
+
+public:
+    /* Invoked in a worker thread; db is NULL if the DB couldn't be opened */
+    typedef std::function<void(MetaDataDB *db)> Query;
+
+    static DatabaseReaders *instance();
+    virtual ~DatabaseReaders();
+
+    /*!
+     * Sets the number of worker threads; 0 disables the pool, and the
+     * queries must then be run in the main thread.
+     */
+    void setThreadCount(int count);
+    int threadCount() const { return m_threadCount; }
+    bool isEnabled() const { return m_threadCount > 0; }
+
+    /*!
+     * Queues @query for execution in one of the worker threads, on the DB
+     * file @databaseName.
+     * @returns false if the pool is disabled.
+     */
+    bool run(const QString &databaseName, const Query &query);
+
+    /*!
+     * Makes the worker threads reopen their DB connection before running
+     * the next query. To be called whenever the DB is closed or reopened,
+     * since the DB file might have been replaced in between (for instance,
+     * by a restore).
+     */
+    void invalidateConnections();
+    int generation() const { return m_generation.loadAcquire(); }
+
+    /*!
+     * Blocks until all the queued queries have been executed.
+     */
+    void waitForDone();
+
+private:
+    DatabaseReaders(QObject *parent);
+
+    int m_threadCount;
+    QThreadPool *m_pool;
+    QAtomicInt m_generation;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_DATABASEREADERS_H
@@ -67,6 +67,7 @@ public:
         TOSNotAccepted,
         ForgotPassword,
         IncorrectDate,
+        TooManyRequests,
         UserDefinedError,
     };
 
@@ -70,6 +70,7 @@ static struct ErrorStrings {
     DECLARE_ERROR(TOS_NOT_ACCEPTED),
     DECLARE_ERROR(FORGOT_PASSWORD),
     DECLARE_ERROR(INCORRECT_DATE),
+    DECLARE_ERROR(TOO_MANY_REQUESTS),
     { SIGNOND_USER_ERROR_ERR_NAME, QString() }, // plugin-defined errors
 };
 
@@ -88,3 +89,17 @@ ErrorAdaptor::ErrorAdaptor(const Error &error)
         BLAME() << "Unhandled error code:" << errorCode;
     }
 }
+
+Error ErrorAdaptor::errorFromName(const QString &name,
+                                  const QString &message)
+{
+    static constexpr size_t numErrors = sizeof(s_errorStrings) / sizeof(ErrorStrings);
+
+    for (size_t i = Error::NoError + 1; i < numErrors; i++) {
+        if (s_errorStrings[i].code == name)
+            return Error(Error::Code(i), message);
+    }
+
+    BLAME() << "Unhandled error name:" << name;
+    return Error(Error::UnknownError, message);
+}
@@ -35,6 +35,9 @@ class ErrorAdaptor
 public:
     explicit ErrorAdaptor(const Error &error);
 
+    /* The inverse mapping: from a D-Bus error name to an Error */
+    static Error errorFromName(const QString &name, const QString &message);
+
     QString code() const { return m_code; }
     QString message() const { return m_message; }
     QDBusMessage createReply(const QDBusMessage &msg) const {
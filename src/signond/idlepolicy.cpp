@@ -0,0 +1,81 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "idlepolicy.h"
+
+#include "signontrace.h"
+
+using namespace SignonDaemonNS;
+
+IdlePolicy::IdlePolicy():
+    m_timeout(0),
+    m_maxTimeout(0),
+    m_idleSince(0),
+    m_averageIdleTime(0)
+{
+}
+
+void IdlePolicy::setTimeouts(uint timeout, uint maxTimeout)
+{
+    m_timeout = timeout;
+    m_maxTimeout = maxTimeout;
+}
+
+void IdlePolicy::idleStarted(qint64 time)
+{
+    if (m_idleSince == 0) m_idleSince = time;
+}
+
+void IdlePolicy::idleEnded(qint64 time)
+{
+    if (m_idleSince == 0) return;
+
+    /* Idle periods longer than the maximum timeout are all equally useless
+     * to wait for: don't let a single one of them (such as the night)
+     * dominate the average */
+    qint64 idleTime = qBound(qint64(0), time - m_idleSince,
+                             qint64(m_maxTimeout) * 2000);
+    m_idleSince = 0;
+
+    /* Exponential moving average, with weight 1/4 for the last value */
+    m_averageIdleTime = m_averageIdleTime == 0 ? idleTime :
+        (m_averageIdleTime * 3 + idleTime) / 4;
+    TRACE() << "Idle for" << idleTime << "ms, average" << m_averageIdleTime;
+}
+
+uint IdlePolicy::timeout() const
+{
+    if (!isAdaptive() || m_averageIdleTime == 0) return m_timeout;
+
+    qint64 averageSecs = (m_averageIdleTime + 999) / 1000;
+    if (averageSecs > m_maxTimeout) return m_timeout;
+
+    return uint(qBound(qint64(m_timeout), averageSecs * 2,
+                       qint64(m_maxTimeout)));
+}
+
+void IdlePolicy::restore(qint64 idleSince, qint64 averageIdleTime)
+{
+    m_idleSince = qMax(idleSince, qint64(0));
+    m_averageIdleTime = qMax(averageIdleTime, qint64(0));
+}
@@ -0,0 +1,75 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_IDLEPOLICY_H
+#define SIGNON_IDLEPOLICY_H
+
+#include <QtGlobal>
+
+namespace SignonDaemonNS {
+
+/*!
+ * @class IdlePolicy
+ * Decides how long the daemon waits, once it has no objects left, before
+ * quitting. By default it waits for the DaemonTimeout; if the clients come
+ * back within the maximum timeout, it waits for twice the average length of
+ * the idle periods, so that the next client is likely to find it running.
+ * All times are in milliseconds since the epoch, so that the statistics can
+ * be carried over to the next instance of the daemon.
+ */
+class IdlePolicy
+{
+public:
+    IdlePolicy();
+
+    /*!
+     * Sets the default timeout and its upper limit, in seconds; the timeout
+     * is not adapted if @maxTimeout is not greater than @timeout.
+     */
+    void setTimeouts(uint timeout, uint maxTimeout);
+    bool isAdaptive() const { return m_maxTimeout > m_timeout; }
+
+    void idleStarted(qint64 time);
+    void idleEnded(qint64 time);
+    bool isIdle() const { return m_idleSince != 0; }
+
+    /*!
+     * @returns the time to wait before quitting, in seconds.
+     */
+    uint timeout() const;
+
+    qint64 idleSince() const { return m_idleSince; }
+    qint64 averageIdleTime() const { return m_averageIdleTime; }
+    void restore(qint64 idleSince, qint64 averageIdleTime);
+
+private:
+    uint m_timeout;
+    uint m_maxTimeout;
+    qint64 m_idleSince;
+    /* 0 if no idle period has ended yet */
+    qint64 m_averageIdleTime;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_IDLEPOLICY_H
@@ -0,0 +1,393 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "inprocessplugin.h"
+
+#include <QDir>
+#include <QHash>
+#include <QLibrary>
+#include <QThread>
+#include <QTimer>
+
+#include "signond-common.h"
+#include "SignOn/ipc.h"
+
+#define SIGNON_PLUGIN_PREFIX QLatin1String("lib")
+#define SIGNON_PLUGIN_SUFFIX QLatin1String("plugin.so")
+/* Time allowed to the plugin to reply to a cancellation */
+#define SIGNON_PLUGIN_CANCEL_TIMEOUT 3000
+/* Time allowed to a worker thread to terminate, when unloading */
+#define SIGNON_PLUGIN_UNLOAD_TIMEOUT 1000
+
+using namespace SignOn;
+
+namespace SignonDaemonNS {
+
+static QHash<QString, InProcessPlugin *> loadedPlugins;
+
+static QVariantMap sessionDataToMap(const SessionData &data)
+{
+    QVariantMap map;
+    foreach(const QString &key, data.propertyNames())
+        map[key] = data.getProperty(key);
+    return map;
+}
+
+InProcessPlugin::InProcessPlugin():
+    QObject(0),
+    m_plugin(0),
+    m_thread(new QThread),
+    m_lastClientId(0),
+    m_activeClientId(0),
+    m_isActive(false),
+    m_cancelTimer(new QTimer(this)),
+    m_isWedged(0)
+{
+    /* Being a child, the timer is moved to the worker thread together with
+     * this object */
+    m_cancelTimer->setSingleShot(true);
+    m_cancelTimer->setInterval(SIGNON_PLUGIN_CANCEL_TIMEOUT);
+    connect(m_cancelTimer, SIGNAL(timeout()), SLOT(onCancelTimeout()));
+}
+
+InProcessPlugin::~InProcessPlugin()
+{
+    TRACE() << "Unloading in-process plugin" << m_type;
+}
+
+InProcessPlugin *InProcessPlugin::instance(const QString &pluginsDir,
+                                           const QString &type)
+{
+    InProcessPlugin *plugin = loadedPlugins.value(type, 0);
+    if (plugin != 0) {
+        if (plugin->isWedged()) {
+            BLAME() << "The in-process" << type << "plugin is not responding";
+            return 0;
+        }
+        return plugin;
+    }
+
+    QString fileName = QDir(pluginsDir).filePath(SIGNON_PLUGIN_PREFIX +
+                                                 type +
+                                                 SIGNON_PLUGIN_SUFFIX);
+
+    plugin = new InProcessPlugin;
+    plugin->m_thread->start();
+    plugin->moveToThread(plugin->m_thread);
+
+    /* The plugin object must be created in the worker thread */
+    bool ok = false;
+    QMetaObject::invokeMethod(plugin, "load", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok),
+                              Q_ARG(QString, fileName));
+    if (!ok || plugin->m_type != type) {
+        BLAME() << "Cannot load" << type << "plugin in process";
+        QThread *thread = plugin->m_thread;
+        plugin->deleteLater();
+        thread->quit();
+        thread->wait();
+        delete thread;
+        return 0;
+    }
+
+    loadedPlugins.insert(type, plugin);
+    return plugin;
+}
+
+void InProcessPlugin::unloadAll()
+{
+    foreach (InProcessPlugin *plugin, loadedPlugins) {
+        QThread *thread = plugin->m_thread;
+        QString type = plugin->m_type;
+        bool isWedged = plugin->isWedged();
+        /* Deferred deletions are processed when the thread finishes */
+        plugin->deleteLater();
+        thread->quit();
+        bool stopped = isWedged ?
+            thread->wait(SIGNON_PLUGIN_UNLOAD_TIMEOUT) : thread->wait();
+        if (!stopped) {
+            /* The plugin is stuck in its own code: the thread can neither
+             * be stopped nor deleted */
+            BLAME() << "Leaking the thread of the" << type << "plugin";
+            continue;
+        }
+        delete thread;
+    }
+    loadedPlugins.clear();
+}
+
+bool InProcessPlugin::load(const QString &fileName)
+{
+    TRACE() << "loading auth library" << fileName;
+
+    QLibrary lib(fileName);
+    if (!lib.load()) {
+        BLAME() << "Failed to load" << fileName << lib.errorString();
+        return false;
+    }
+
+    typedef AuthPluginInterface* (*SsoAuthPluginInstanceF)();
+    SsoAuthPluginInstanceF instance =
+        (SsoAuthPluginInstanceF)lib.resolve("auth_plugin_instance");
+    if (!instance) {
+        BLAME() << "Failed to resolve init function in" << fileName <<
+            lib.errorString();
+        return false;
+    }
+
+    m_plugin = qobject_cast<AuthPluginInterface *>(instance());
+    if (!m_plugin) {
+        BLAME() << "Failed to cast object for" << fileName;
+        return false;
+    }
+
+    connect(m_plugin, SIGNAL(result(const SignOn::SessionData&)),
+            this, SLOT(result(const SignOn::SessionData&)));
+
+    connect(m_plugin, SIGNAL(store(const SignOn::SessionData&)),
+            this, SLOT(store(const SignOn::SessionData&)));
+
+    connect(m_plugin, SIGNAL(error(const SignOn::Error &)),
+            this, SLOT(error(const SignOn::Error &)));
+
+    connect(m_plugin, SIGNAL(userActionRequired(const SignOn::UiSessionData&)),
+            this, SLOT(userActionRequired(const SignOn::UiSessionData&)));
+
+    connect(m_plugin, SIGNAL(refreshed(const SignOn::UiSessionData&)),
+            this, SLOT(refreshed(const SignOn::UiSessionData&)));
+
+    connect(m_plugin,
+            SIGNAL(statusChanged(const AuthPluginState, const QString&)),
+            this, SLOT(statusChanged(const AuthPluginState, const QString&)));
+
+    m_plugin->setParent(this);
+    m_type = m_plugin->type();
+    m_mechanisms = m_plugin->mechanisms();
+
+    TRACE() << "plugin is fully initialized";
+    return true;
+}
+
+quint32 InProcessPlugin::registerClient()
+{
+    return ++m_lastClientId;
+}
+
+void InProcessPlugin::process(quint32 clientId, const QVariantMap &inData,
+                              const QString &mechanism)
+{
+    QMetaObject::invokeMethod(this, "startProcess", Qt::QueuedConnection,
+                              Q_ARG(quint32, clientId),
+                              Q_ARG(QVariantMap, inData),
+                              Q_ARG(QString, mechanism));
+}
+
+void InProcessPlugin::processUi(quint32 clientId, const QVariantMap &inData)
+{
+    QMetaObject::invokeMethod(this, "startProcessUi", Qt::QueuedConnection,
+                              Q_ARG(quint32, clientId),
+                              Q_ARG(QVariantMap, inData));
+}
+
+void InProcessPlugin::processRefresh(quint32 clientId,
+                                     const QVariantMap &inData)
+{
+    QMetaObject::invokeMethod(this, "startRefresh", Qt::QueuedConnection,
+                              Q_ARG(quint32, clientId),
+                              Q_ARG(QVariantMap, inData));
+}
+
+void InProcessPlugin::cancel(quint32 clientId)
+{
+    QMetaObject::invokeMethod(this, "cancelRequest", Qt::QueuedConnection,
+                              Q_ARG(quint32, clientId));
+}
+
+void InProcessPlugin::detach(quint32 clientId)
+{
+    QMetaObject::invokeMethod(this, "detachClient", Qt::QueuedConnection,
+                              Q_ARG(quint32, clientId));
+}
+
+void InProcessPlugin::abort()
+{
+    setWedged();
+}
+
+void InProcessPlugin::startProcess(quint32 clientId,
+                                   const QVariantMap &inData,
+                                   const QString &mechanism)
+{
+    /* The client has failed the request already */
+    if (isWedged())
+        return;
+
+    Request request;
+    request.m_clientId = clientId;
+    request.m_inData = inData;
+    request.m_mechanism = mechanism;
+    m_pendingRequests.enqueue(request);
+
+    startNextRequest();
+}
+
+void InProcessPlugin::startProcessUi(quint32 clientId,
+                                     const QVariantMap &inData)
+{
+    if (!m_isActive || clientId != m_activeClientId || isWedged()) {
+        BLAME() << "UI reply for an inactive request";
+        return;
+    }
+    m_plugin->userActionFinished(UiSessionData(inData));
+}
+
+void InProcessPlugin::startRefresh(quint32 clientId,
+                                   const QVariantMap &inData)
+{
+    if (!m_isActive || clientId != m_activeClientId || isWedged()) {
+        BLAME() << "Refresh request for an inactive request";
+        return;
+    }
+    m_plugin->refresh(UiSessionData(inData));
+}
+
+void InProcessPlugin::cancelRequest(quint32 clientId)
+{
+    if (isWedged())
+        return;
+
+    if (m_isActive && clientId == m_activeClientId) {
+        m_cancelTimer->start();
+        m_plugin->cancel();
+        return;
+    }
+
+    /* The request might be still waiting for the plugin */
+    for (int i = 0; i < m_pendingRequests.count(); i++) {
+        if (m_pendingRequests[i].m_clientId == clientId) {
+            m_pendingRequests.removeAt(i);
+            Q_EMIT errorOccurred(clientId, Error::SessionCanceled,
+                                 QLatin1String("The operation is canceled"));
+            return;
+        }
+    }
+}
+
+void InProcessPlugin::detachClient(quint32 clientId)
+{
+    for (int i = m_pendingRequests.count() - 1; i >= 0; i--) {
+        if (m_pendingRequests[i].m_clientId == clientId)
+            m_pendingRequests.removeAt(i);
+    }
+
+    /* The plugin stays busy until it replies to the cancellation, but
+     * nobody will receive the reply */
+    if (m_isActive && clientId == m_activeClientId && !isWedged()) {
+        m_activeClientId = 0;
+        m_cancelTimer->start();
+        m_plugin->cancel();
+    }
+}
+
+void InProcessPlugin::startNextRequest()
+{
+    if (m_isActive || m_pendingRequests.isEmpty() || isWedged())
+        return;
+
+    Request request = m_pendingRequests.dequeue();
+    m_isActive = true;
+    m_activeClientId = request.m_clientId;
+    m_plugin->process(SessionData(request.m_inData), request.m_mechanism);
+}
+
+void InProcessPlugin::onCancelTimeout()
+{
+    BLAME() << "The" << m_type << "plugin did not reply to the cancellation";
+    m_pendingRequests.clear();
+    setWedged();
+}
+
+void InProcessPlugin::setWedged()
+{
+    if (!m_isWedged.testAndSetOrdered(0, 1))
+        return;
+
+    BLAME() << "Disabling the in-process" << m_type << "plugin";
+    Q_EMIT wedged();
+}
+
+void InProcessPlugin::requestDone()
+{
+    m_cancelTimer->stop();
+    m_isActive = false;
+    m_activeClientId = 0;
+    /* Don't start the next request while still inside the plugin's code */
+    QMetaObject::invokeMethod(this, "startNextRequest", Qt::QueuedConnection);
+}
+
+void InProcessPlugin::result(const SignOn::SessionData &data)
+{
+    quint32 clientId = m_activeClientId;
+    requestDone();
+    if (clientId != 0 && !isWedged())
+        Q_EMIT sessionDataReady(clientId, PLUGIN_RESPONSE_RESULT,
+                                sessionDataToMap(data));
+}
+
+void InProcessPlugin::store(const SignOn::SessionData &data)
+{
+    if (m_activeClientId != 0 && !isWedged())
+        Q_EMIT sessionDataReady(m_activeClientId, PLUGIN_RESPONSE_STORE,
+                                sessionDataToMap(data));
+}
+
+void InProcessPlugin::error(const SignOn::Error &err)
+{
+    quint32 clientId = m_activeClientId;
+    requestDone();
+    if (clientId != 0 && !isWedged())
+        Q_EMIT errorOccurred(clientId, err.type(), err.message());
+}
+
+void InProcessPlugin::userActionRequired(const SignOn::UiSessionData &data)
+{
+    if (m_activeClientId != 0 && !isWedged())
+        Q_EMIT sessionDataReady(m_activeClientId, PLUGIN_RESPONSE_UI,
+                                sessionDataToMap(data));
+}
+
+void InProcessPlugin::refreshed(const SignOn::UiSessionData &data)
+{
+    if (m_activeClientId != 0 && !isWedged())
+        Q_EMIT sessionDataReady(m_activeClientId, PLUGIN_RESPONSE_REFRESHED,
+                                sessionDataToMap(data));
+}
+
+void InProcessPlugin::statusChanged(const AuthPluginState state,
+                                    const QString &message)
+{
+    if (m_activeClientId != 0 && !isWedged())
+        Q_EMIT stateChanged(m_activeClientId, state, message);
+}
+
+} //namespace SignonDaemonNS
@@ -0,0 +1,138 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_INPROCESSPLUGIN_H
+#define SIGNON_INPROCESSPLUGIN_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "SignOn/authpluginif.h"
+
+class QThread;
+class QTimer;
+
+namespace SignonDaemonNS {
+
+/*!
+ * @class InProcessPlugin
+ * Runs a trusted authentication plugin in a signond worker thread, instead
+ * of a separate plugin process.
+ * Plugins are singletons, therefore there is a single instance of this
+ * object for each plugin type, shared by all the PluginProxy objects of
+ * that type: each of them registers as a client, and requests from
+ * different clients are executed one at a time. Replies are emitted with
+ * the id of the client they are addressed to.
+ * A plugin which doesn't reply to a cancellation in time is considered
+ * wedged: it's never used again, and its type is served by plugin processes
+ * from then on.
+ */
+class InProcessPlugin: public QObject
+{
+    Q_OBJECT
+
+public:
+    static InProcessPlugin *instance(const QString &pluginsDir,
+                                     const QString &type);
+    static void unloadAll();
+
+    QString type() const { return m_type; }
+    QStringList mechanisms() const { return m_mechanisms; }
+    /* Can be called from any thread */
+    bool isWedged() const { return m_isWedged.loadAcquire() != 0; }
+
+    /* These methods must be called from the main thread */
+    quint32 registerClient();
+    void process(quint32 clientId, const QVariantMap &inData,
+                 const QString &mechanism);
+    void processUi(quint32 clientId, const QVariantMap &inData);
+    void processRefresh(quint32 clientId, const QVariantMap &inData);
+    void cancel(quint32 clientId);
+    void detach(quint32 clientId);
+    /* Marks the plugin as wedged, without waiting for the worker thread */
+    void abort();
+
+Q_SIGNALS:
+    void sessionDataReady(quint32 clientId, quint32 response,
+                          const QVariantMap &data);
+    void errorOccurred(quint32 clientId, quint32 err,
+                       const QString &message);
+    void stateChanged(quint32 clientId, quint32 state,
+                      const QString &message);
+    /* Emitted once, when the plugin stops responding; the clients must fail
+     * their pending requests, as no replies will be emitted anymore */
+    void wedged();
+
+private Q_SLOTS:
+    bool load(const QString &fileName);
+    void startProcess(quint32 clientId, const QVariantMap &inData,
+                      const QString &mechanism);
+    void startProcessUi(quint32 clientId, const QVariantMap &inData);
+    void startRefresh(quint32 clientId, const QVariantMap &inData);
+    void cancelRequest(quint32 clientId);
+    void detachClient(quint32 clientId);
+    void startNextRequest();
+    void onCancelTimeout();
+
+    void result(const SignOn::SessionData &data);
+    void store(const SignOn::SessionData &data);
+    void error(const SignOn::Error &err);
+    void userActionRequired(const SignOn::UiSessionData &data);
+    void refreshed(const SignOn::UiSessionData &data);
+    void statusChanged(const AuthPluginState state,
+                       const QString &message);
+
+private:
+    InProcessPlugin();
+    ~InProcessPlugin();
+
+    void requestDone();
+    void setWedged();
+
+    struct Request {
+        quint32 m_clientId;
+        QVariantMap m_inData;
+        QString m_mechanism;
+    };
+
+    AuthPluginInterface *m_plugin;
+    QThread *m_thread;
+    QString m_type;
+    QStringList m_mechanisms;
+    quint32 m_lastClientId;
+    /* Only accessed from the worker thread */
+    QQueue<Request> m_pendingRequests;
+    quint32 m_activeClientId;
+    bool m_isActive;
+    /* Fires if the plugin doesn't reply to a cancellation */
+    QTimer *m_cancelTimer;
+    QAtomicInt m_isWedged;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_INPROCESSPLUGIN_H
@@ -0,0 +1,206 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "peercache.h"
+
+#include "peercontext.h"
+#include "signond-common.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusReply>
+#include <QDBusServiceWatcher>
+#ifdef ENABLE_P2P
+#include <dbus/dbus.h>
+#endif
+
+using namespace SignonDaemonNS;
+
+static PeerCache *peerCacheInstance = NULL;
+
+PeerCache::PeerCache(QObject *parent):
+    QObject(parent),
+    m_serviceWatcher(0),
+    m_accessHits(0),
+    m_accessMisses(0)
+{
+}
+
+PeerCache::~PeerCache()
+{
+    peerCacheInstance = NULL;
+}
+
+PeerCache *PeerCache::instance()
+{
+    if (peerCacheInstance == NULL)
+        peerCacheInstance = new PeerCache(QCoreApplication::instance());
+    return peerCacheInstance;
+}
+
+void PeerCache::addConnection(const QDBusConnection &connection)
+{
+    if (m_peers.contains(connection.name())) return;
+
+    addPeer(connection.name(), PeerContext(connection, QDBusMessage()));
+}
+
+PeerCache::Peer &PeerCache::peer(const PeerContext &peerContext)
+{
+    const QString service = peerContext.message().service();
+    const QString key = service.isEmpty() ?
+        peerContext.connection().name() : service;
+
+    QHash<QString, Peer>::iterator i = m_peers.find(key);
+    if (i != m_peers.end()) return i.value();
+
+    Peer *peer = addPeer(key, peerContext);
+    if (peer) return *peer;
+
+    m_unknownPeer = Peer();
+    return m_unknownPeer;
+}
+
+bool PeerCache::hasAccess(const PeerContext &peerContext, quint32 identityId)
+{
+    if (peer(peerContext).m_allowedIdentities.contains(identityId)) {
+        m_accessHits++;
+        return true;
+    }
+
+    m_accessMisses++;
+    return false;
+}
+
+void PeerCache::addAccess(const PeerContext &peerContext, quint32 identityId)
+{
+    peer(peerContext).m_allowedIdentities.insert(identityId);
+}
+
+void PeerCache::invalidateAccess(quint32 identityId)
+{
+    QHash<QString, Peer>::iterator i;
+    for (i = m_peers.begin(); i != m_peers.end(); i++) {
+        if (identityId == SIGNOND_NEW_IDENTITY) {
+            i.value().m_allowedIdentities.clear();
+        } else {
+            i.value().m_allowedIdentities.remove(identityId);
+        }
+    }
+}
+
+QVariantMap PeerCache::statistics() const
+{
+    quint64 lookups = m_accessHits + m_accessMisses;
+
+    QVariantMap statistics;
+    statistics.insert(QLatin1String("Peers"), m_peers.count());
+    statistics.insert(QLatin1String("AccessHits"), m_accessHits);
+    statistics.insert(QLatin1String("AccessMisses"), m_accessMisses);
+    statistics.insert(QLatin1String("AccessHitRate"), lookups > 0 ?
+                      int(m_accessHits * 100 / lookups) : 0);
+    return statistics;
+}
+
+PeerCache::Peer *PeerCache::addPeer(const QString &key,
+                                    const PeerContext &peerContext)
+{
+    QDBusConnection connection = peerContext.connection();
+    const QString service = peerContext.message().service();
+    Peer peer;
+
+    if (service.isEmpty()) {
+#ifdef ENABLE_P2P
+        DBusConnection *dbusConnection =
+            (DBusConnection *)connection.internalPointer();
+        unsigned long pid = 0;
+        dbus_bool_t ok = dbus_connection_get_unix_process_id(dbusConnection,
+                                                             &pid);
+        if (Q_UNLIKELY(!ok)) {
+            BLAME() << "Couldn't get PID of caller!";
+            return 0;
+        }
+        peer.m_pid = pid;
+
+        connection.connect(QString(),
+                           QLatin1String("/org/freedesktop/DBus/Local"),
+                           QLatin1String("org.freedesktop.DBus.Local"),
+                           QLatin1String("Disconnected"),
+                           this, SLOT(onDisconnected()));
+#else
+        BLAME() << "Empty caller name, and no P2P support enabled";
+        return 0;
+#endif
+    } else {
+        QDBusConnectionInterface *interface = connection.interface();
+        if (Q_UNLIKELY(!interface)) {
+            BLAME() << "No bus interface on connection" << connection.name();
+            return 0;
+        }
+
+        /* Watch the name before querying it: if it's gone already, the query
+         * fails; otherwise, we'll be told when it goes */
+        watchService(connection, service);
+        QDBusReply<uint> reply = interface->servicePid(service);
+        if (Q_UNLIKELY(!reply.isValid())) {
+            BLAME() << "Couldn't get PID of" << service << reply.error();
+            m_serviceWatcher->removeWatchedService(service);
+            return 0;
+        }
+        peer.m_pid = reply.value();
+    }
+
+    TRACE() << "Caching peer" << key << "PID" << peer.m_pid;
+    return &m_peers.insert(key, peer).value();
+}
+
+void PeerCache::watchService(const QDBusConnection &connection,
+                             const QString &service)
+{
+    if (!m_serviceWatcher) {
+        m_serviceWatcher =
+            new QDBusServiceWatcher(QString(), connection,
+                                    QDBusServiceWatcher::WatchForUnregistration,
+                                    this);
+        QObject::connect(m_serviceWatcher,
+                         SIGNAL(serviceUnregistered(const QString &)),
+                         this, SLOT(onServiceUnregistered(const QString &)));
+    }
+    m_serviceWatcher->addWatchedService(service);
+}
+
+void PeerCache::onServiceUnregistered(const QString &service)
+{
+    TRACE() << "Peer gone:" << service;
+    m_peers.remove(service);
+    m_serviceWatcher->removeWatchedService(service);
+}
+
+void PeerCache::onDisconnected()
+{
+    /* The signal is delivered on the connection which was closed */
+    const QString name = connection().name();
+    TRACE() << "Peer disconnected:" << name;
+    m_peers.remove(name);
+}
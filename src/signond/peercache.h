@@ -0,0 +1,128 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNOND_PEER_CACHE_H
+#define SIGNOND_PEER_CACHE_H
+
+#include <QDBusContext>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVariantMap>
+
+#include <sys/types.h>
+
+class QDBusConnection;
+class QDBusServiceWatcher;
+
+namespace SignonDaemonNS {
+
+class PeerContext;
+
+/*!
+ * @class PeerCache
+ * Remembers the identity of the clients, so that it's retrieved only once
+ * per client instead of once per access check.
+ * Clients on the bus are keyed by their unique name: their data is read the
+ * first time it's needed and dropped when the name goes away. Clients on a
+ * p2p connection are keyed by the connection, which is registered as soon as
+ * it's established and dropped when it's closed.
+ * The identities which each peer has been allowed to use are remembered
+ * too, until they are modified.
+ * This class must be used from the main thread only.
+ */
+class PeerCache: public QObject, protected QDBusContext
+{
+    Q_OBJECT
+
+public:
+    struct Peer {
+        Peer(): m_pid(0), m_hasAppId(false) {}
+
+    public:
+        pid_t m_pid;
+        /* Set by the access control manager, the first time it's asked */
+        QString m_appId;
+        bool m_hasAppId;
+        QSet<quint32> m_allowedIdentities;
+    };
+
+    static PeerCache *instance();
+    virtual ~PeerCache();
+
+    void addConnection(const QDBusConnection &connection);
+
+    /*!
+     * Returns the data of the peer, retrieving it if it's not cached yet.
+     * The reference is valid until the next call.
+     */
+    Peer &peer(const PeerContext &peerContext);
+
+    int count() const { return m_peers.count(); }
+
+    /*!
+     * @returns true if the peer has been found to be allowed to use the
+     * identity, and the identity hasn't changed since then.
+     */
+    bool hasAccess(const PeerContext &peerContext, quint32 identityId);
+    /*!
+     * Remembers that the peer is allowed to use the identity. Denials are
+     * not remembered, since the access control manager can turn them into
+     * grants after asking the user.
+     */
+    void addAccess(const PeerContext &peerContext, quint32 identityId);
+    /*!
+     * Forgets who can use the given identity, or all the identities if
+     * identityId is 0; to be called when their ACL or owners change.
+     */
+    void invalidateAccess(quint32 identityId);
+
+    /*!
+     * @returns the number of cached peers, of access lookups answered from
+     * the cache (hits) or not, and the hit rate in percent.
+     */
+    QVariantMap statistics() const;
+
+private Q_SLOTS:
+    void onServiceUnregistered(const QString &service);
+    void onDisconnected();
+
+private:
+    PeerCache(QObject *parent);
+    Peer *addPeer(const QString &key, const PeerContext &peerContext);
+    void watchService(const QDBusConnection &connection,
+                      const QString &service);
+
+private:
+    QHash<QString, Peer> m_peers;
+    /* Returned for the peers which could not be identified */
+    Peer m_unknownPeer;
+    QDBusServiceWatcher *m_serviceWatcher;
+    quint64 m_accessHits;
+    quint64 m_accessMisses;
+};
+
+} // namespace SignonDaemonNS
+
+#endif // SIGNOND_PEER_CACHE_H
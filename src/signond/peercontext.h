@@ -31,6 +31,7 @@
 namespace SignonDaemonNS {
 
 class AccessControlManagerHelper;
+class PeerCache;
 
 class PeerContext
 {
@@ -57,6 +58,7 @@ protected:
 
 private:
     friend AccessControlManagerHelper;
+    friend PeerCache;
     QDBusConnection m_connection;
     QDBusMessage m_message;
 };
@@ -25,12 +25,14 @@
 
 #include <sys/types.h>
 #include <pwd.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include <QStringList>
 #include <QThreadStorage>
 #include <QThread>
 #include <QDataStream>
+#include <QFile>
 
 #include "signond-common.h"
 #include "SignOn/uisessiondata_priv.h"
@@ -45,8 +47,11 @@
 
 // signon-plugins-common
 #include "SignOn/blobiohandler.h"
+#include "SignOn/frameiohandler.h"
 #include "SignOn/ipc.h"
 
+#include "inprocessplugin.h"
+
 using namespace SignOn;
 
 #define REMOTEPLUGIN_BIN_PATH QLatin1String("signonpluginprocess")
@@ -57,6 +62,10 @@ using namespace SignOn;
 
 namespace SignonDaemonNS {
 
+static PluginRecyclingPolicy pluginRecyclingPolicy;
+static QString inProcessPluginsDir;
+static QStringList inProcessPluginTypes;
+
 /* ---------------------- PluginProcess ---------------------- */
 
 PluginProcess::PluginProcess(QObject *parent):
@@ -68,6 +77,92 @@ PluginProcess::~PluginProcess()
 {
 }
 
+/* ---------------------- PluginReaper ---------------------- */
+
+static PluginReaper *reaperInstance = NULL;
+
+PluginReaper::PluginReaper(QObject *parent):
+    QObject(parent)
+{
+}
+
+PluginReaper::~PluginReaper()
+{
+    /* Make sure that deleting the children won't block */
+    QHashIterator<PluginProcess *, int> it(m_processes);
+    while (it.hasNext()) {
+        it.next();
+        pid_t pid = pid_t(it.key()->processId());
+        if (pid > 0)
+            ::kill(pid, SIGKILL);
+    }
+
+    reaperInstance = NULL;
+}
+
+PluginReaper *PluginReaper::instance()
+{
+    if (reaperInstance == NULL)
+        reaperInstance = new PluginReaper(QCoreApplication::instance());
+    return reaperInstance;
+}
+
+void PluginReaper::reap(PluginProcess *process)
+{
+    process->setParent(this);
+
+    if (process->state() == QProcess::NotRunning) {
+        process->deleteLater();
+        return;
+    }
+
+    /* Closing the write channel ensures that the plugin process
+     * will not get stuck on the next read.
+     */
+    process->closeWriteChannel();
+    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(onFinished()));
+
+    QTimer *timer = new QTimer(process);
+    connect(timer, SIGNAL(timeout()), this, SLOT(escalate()));
+    timer->start(PLUGINPROCESS_STOP_TIMEOUT);
+
+    m_processes.insert(process, 0);
+}
+
+void PluginReaper::onFinished()
+{
+    PluginProcess *process = qobject_cast<PluginProcess *>(sender());
+    TRACE() << "Plugin process" << process->processId() << "terminated";
+
+    m_processes.remove(process);
+    process->deleteLater();
+}
+
+void PluginReaper::escalate()
+{
+    QTimer *timer = qobject_cast<QTimer *>(sender());
+    PluginProcess *process = qobject_cast<PluginProcess *>(timer->parent());
+    pid_t pid = pid_t(process->processId());
+    if (!m_processes.contains(process) || pid <= 0) {
+        timer->stop();
+        return;
+    }
+
+    int &signalsSent = m_processes[process];
+    if (signalsSent == 0) {
+        qCritical() << "The signon plugin does not react on demand to "
+            "stop: terminating it";
+        ::kill(pid, SIGTERM);
+    } else {
+        qCritical() << "The signon plugin ignores SIGTERM: killing it";
+        ::kill(pid, SIGKILL);
+        /* SIGKILL cannot be ignored: just wait for finished() */
+        timer->stop();
+    }
+    signalsSent++;
+}
+
 /* ---------------------- PluginProxy ---------------------- */
 
 PluginProxy::PluginProxy(QString type, QObject *parent):
@@ -80,7 +175,23 @@ PluginProxy::PluginProxy(QString type, QObject *parent):
     m_isResultObtained = false;
     m_currentResultOperation = -1;
     m_process = new PluginProcess(this);
+    m_blobIOHandler = NULL;
+    m_frameIOHandler = NULL;
+    m_lastRequestId = 0;
+    m_currentRequestId = 0;
+    m_requestCount = 0;
+    m_maxConcurrentRequests = 1;
+    m_inProcessPlugin = NULL;
+    m_clientId = 0;
+
+    m_idleTimer.setSingleShot(true);
+    connect(&m_idleTimer, SIGNAL(timeout()), this, SLOT(onIdleTimeout()));
+
+    setupProcess();
+}
 
+void PluginProxy::setupProcess()
+{
 #ifdef SIGNOND_TRACE
     if (criticalsEnabled()) {
         const char *level = debugEnabled() ? "2" : "1";
@@ -105,54 +216,33 @@ PluginProxy::PluginProxy(QString type, QObject *parent):
 
 PluginProxy::~PluginProxy()
 {
-    if (m_process != NULL &&
-        m_process->state() != QProcess::NotRunning)
-    {
-        if (m_isProcessing)
-            cancel();
-
-        stop();
-
-        /* Closing the write channel ensures that the plugin process
-         * will not get stuck on the next read.
-         */
-        m_process->closeWriteChannel();
-
-        if (!m_process->waitForFinished(PLUGINPROCESS_STOP_TIMEOUT)) {
-            qCritical() << "The signon plugin does not react on demand to "
-                "stop: need to kill it!!!";
-            m_process->kill();
-
-            if (!m_process->waitForFinished(PLUGINPROCESS_STOP_TIMEOUT))
-            {
-                if (m_process->pid()) {
-                    qCritical() << "The signon plugin seems to ignore kill(), "
-                        "killing it from command line";
-                    QString killProcessCommand(QString::fromLatin1("kill -9 %1").arg(m_process->pid()));
-                    QProcess::execute(killProcessCommand);
-                }
-            }
-        }
-    }
+    if (m_inProcessPlugin)
+        m_inProcessPlugin->detach(m_clientId);
+
+    if (m_isProcessing && m_process->state() != QProcess::NotRunning)
+        cancel();
+
+    /* Don't wait for the process to terminate: the reaper will take care
+     * of it */
+    retireProcess(m_process, m_blobIOHandler, m_frameIOHandler);
 }
 
 PluginProxy* PluginProxy::createNewPluginProxy(const QString &type)
 {
     PluginProxy *pp = new PluginProxy(type);
 
-    QStringList args = QStringList() << pp->m_type;
-    pp->m_process->start(REMOTEPLUGIN_BIN_PATH, args);
-
-    QByteArray tmp;
-
-    if (!pp->waitForStarted(PLUGINPROCESS_START_TIMEOUT)) {
-        TRACE() << "The process cannot be started";
-        delete pp;
-        return NULL;
+    if (inProcessPluginTypes.contains(type)) {
+        InProcessPlugin *plugin =
+            InProcessPlugin::instance(inProcessPluginsDir, type);
+        if (plugin) {
+            pp->setupInProcessPlugin(plugin);
+            TRACE() << "The plugin is running in process";
+            return pp;
+        }
+        BLAME() << "Falling back to a plugin process for" << type;
     }
 
-    if (!pp->readOnReady(tmp, PLUGINPROCESS_START_TIMEOUT)) {
-        TRACE() << "The process cannot load plugin";
+    if (!pp->startProcess()) {
         delete pp;
         return NULL;
     }
@@ -166,6 +256,7 @@ PluginProxy* PluginProxy::createNewPluginProxy(const QString &type)
         }
     }
     pp->m_mechanisms = pp->queryMechanisms();
+    pp->m_maxConcurrentRequests = pp->queryConcurrency();
 
     connect(pp->m_process, SIGNAL(readyRead()),
             pp, SLOT(onReadStandardOutput()));
@@ -174,21 +265,96 @@ PluginProxy* PluginProxy::createNewPluginProxy(const QString &type)
     return pp;
 }
 
+void PluginProxy::setupInProcessPlugin(InProcessPlugin *plugin)
+{
+    m_inProcessPlugin = plugin;
+    m_clientId = plugin->registerClient();
+    m_mechanisms = plugin->mechanisms();
+
+    connect(plugin,
+            SIGNAL(sessionDataReady(quint32, quint32, const QVariantMap&)),
+            this,
+            SLOT(inProcessSessionData(quint32, quint32, const QVariantMap&)));
+    connect(plugin, SIGNAL(errorOccurred(quint32, quint32, const QString&)),
+            this, SLOT(inProcessError(quint32, quint32, const QString&)));
+    connect(plugin, SIGNAL(stateChanged(quint32, quint32, const QString&)),
+            this,
+            SLOT(inProcessStateChanged(quint32, quint32, const QString&)));
+    connect(plugin, SIGNAL(wedged()), this, SLOT(onInProcessPluginWedged()));
+}
+
+void PluginProxy::inProcessSessionData(quint32 clientId, quint32 response,
+                                       const QVariantMap &data)
+{
+    if (clientId == m_clientId)
+        handleSessionData(response, data);
+}
+
+void PluginProxy::inProcessError(quint32 clientId, quint32 err,
+                                 const QString &message)
+{
+    if (clientId == m_clientId)
+        handleError(err, message);
+}
+
+void PluginProxy::inProcessStateChanged(quint32 clientId, quint32 state,
+                                        const QString &message)
+{
+    if (clientId == m_clientId)
+        handleStateChange(state, message);
+}
+
+void PluginProxy::onInProcessPluginWedged()
+{
+    /* The plugin won't reply anymore; the next requests will be served by a
+     * plugin process (see restartIfRequired()) */
+    if (m_isProcessing) {
+        failPendingRequests(QLatin1String("The authentication plugin is "
+                                          "not responding"));
+    }
+}
+
 bool PluginProxy::process(const QVariantMap &inData,
                           const QString &mechanism)
 {
     if (!restartIfRequired())
         return false;
 
-    m_isResultObtained = false;
-    QVariant value = inData.value(SSOUI_KEY_UIPOLICY);
-    m_uiPolicy = value.toInt();
+    if (m_isProcessing &&
+        m_pendingRequests.count() >= maxConcurrentRequests()) {
+        BLAME() << "Too many concurrent requests";
+        return false;
+    }
 
-    QDataStream in(m_process);
-    in << (quint32)PLUGIN_OP_PROCESS;
-    in << mechanism;
+    PendingRequest request;
+    request.m_id = nextRequestId();
+    request.m_uiPolicy = inData.value(SSOUI_KEY_UIPOLICY).toInt();
+    if (!m_isProcessing) {
+        m_pendingRequests.clear();
+        m_isResultObtained = false;
+        m_uiPolicy = request.m_uiPolicy;
+        m_currentRequestId = request.m_id;
+    }
+    m_pendingRequests.enqueue(request);
+    m_requestCount++;
+    m_idleTimer.stop();
+
+    if (m_inProcessPlugin) {
+        m_inProcessPlugin->process(m_clientId, filterOutComplexTypes(inData),
+                                   mechanism);
+    } else if (m_frameIOHandler) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << mechanism;
+        out << filterOutComplexTypes(inData);
+        sendFrame(PLUGIN_OP_PROCESS, request.m_id, payload);
+    } else {
+        QDataStream in(m_process);
+        in << (quint32)PLUGIN_OP_PROCESS;
+        in << mechanism;
 
-    m_blobIOHandler->sendData(inData);
+        m_blobIOHandler->sendData(inData);
+    }
 
     m_isProcessing = true;
     return true;
@@ -201,11 +367,19 @@ bool PluginProxy::processUi(const QVariantMap &inData)
     if (!restartIfRequired())
         return false;
 
-    QDataStream in(m_process);
+    if (m_inProcessPlugin) {
+        m_inProcessPlugin->processUi(m_clientId,
+                                     filterOutComplexTypes(inData));
+    } else if (m_frameIOHandler) {
+        sendFrame(PLUGIN_OP_PROCESS_UI, m_currentRequestId,
+                  FrameIOHandler::encodeMap(inData));
+    } else {
+        QDataStream in(m_process);
 
-    in << (quint32)PLUGIN_OP_PROCESS_UI;
+        in << (quint32)PLUGIN_OP_PROCESS_UI;
 
-    m_blobIOHandler->sendData(inData);
+        m_blobIOHandler->sendData(inData);
+    }
 
     m_isProcessing = true;
 
@@ -219,11 +393,19 @@ bool PluginProxy::processRefresh(const QVariantMap &inData)
     if (!restartIfRequired())
         return false;
 
-    QDataStream in(m_process);
+    if (m_inProcessPlugin) {
+        m_inProcessPlugin->processRefresh(m_clientId,
+                                          filterOutComplexTypes(inData));
+    } else if (m_frameIOHandler) {
+        sendFrame(PLUGIN_OP_REFRESH, m_currentRequestId,
+                  FrameIOHandler::encodeMap(inData));
+    } else {
+        QDataStream in(m_process);
 
-    in << (quint32)PLUGIN_OP_REFRESH;
+        in << (quint32)PLUGIN_OP_REFRESH;
 
-    m_blobIOHandler->sendData(inData);
+        m_blobIOHandler->sendData(inData);
+    }
 
     m_isProcessing = true;
 
@@ -233,6 +415,16 @@ bool PluginProxy::processRefresh(const QVariantMap &inData)
 void PluginProxy::cancel()
 {
     TRACE();
+    if (m_inProcessPlugin) {
+        m_inProcessPlugin->cancel(m_clientId);
+        return;
+    }
+
+    if (m_frameIOHandler) {
+        sendFrame(PLUGIN_OP_CANCEL, m_currentRequestId);
+        return;
+    }
+
     QDataStream in(m_process);
     in << (quint32)PLUGIN_OP_CANCEL;
 }
@@ -240,10 +432,48 @@ void PluginProxy::cancel()
 void PluginProxy::stop()
 {
     TRACE();
+    /* In-process plugins are never stopped */
+    if (m_inProcessPlugin)
+        return;
+
+    if (m_frameIOHandler) {
+        sendFrame(PLUGIN_OP_STOP, 0);
+        return;
+    }
+
     QDataStream in(m_process);
     in << (quint32)PLUGIN_OP_STOP;
 }
 
+void PluginProxy::abort()
+{
+    TRACE();
+    if (!m_isProcessing)
+        return;
+
+    /* Threads running in-process plugins cannot be interrupted: stop using
+     * the plugin; this fails the pending requests of all its clients (see
+     * onInProcessPluginWedged()) */
+    if (m_inProcessPlugin) {
+        BLAME() << "Aborting in-process plugin" << m_type;
+        m_inProcessPlugin->abort();
+        return;
+    }
+
+    /* The plugin process is not responding: replace it, and fail the
+     * requests it was working on */
+    BLAME() << "Aborting plugin process" << m_process->processId();
+    retireProcess(m_process, m_blobIOHandler, m_frameIOHandler);
+
+    m_process = new PluginProcess(this);
+    m_blobIOHandler = NULL;
+    m_frameIOHandler = NULL;
+    setupProcess();
+    m_requestCount = 0;
+
+    failPendingRequests(QLatin1String("plugin process aborted"));
+}
+
 bool PluginProxy::readOnReady(QByteArray &buffer, int timeout)
 {
     bool ready = m_process->waitForReadyRead(timeout);
@@ -259,11 +489,359 @@ bool PluginProxy::readOnReady(QByteArray &buffer, int timeout)
     return ready;
 }
 
+bool PluginProxy::negotiateProtocol(const QByteArray &readyMessage)
+{
+    int remoteVersion = 1;
+    int index = readyMessage.indexOf(SIGNON_IPC_PROTOCOL_TAG);
+    if (index >= 0) {
+        remoteVersion = readyMessage.mid(index +
+                                   qstrlen(SIGNON_IPC_PROTOCOL_TAG)).toInt();
+    }
+
+    int version = qMin(remoteVersion, SIGNON_IPC_PROTOCOL_VERSION);
+    if (version < SIGNON_IPC_FRAMED_PROTOCOL_VERSION) {
+        TRACE() << "Plugin process only supports protocol version" <<
+            remoteVersion;
+        return true;
+    }
+
+    /* The acknowledgement must not be taken for a plugin response */
+    bool wasConnected = disconnect(m_process, SIGNAL(readyRead()),
+                                   this, SLOT(onReadStandardOutput()));
+
+    /* This is the last message encoded with the old protocol */
+    QDataStream in(m_process);
+    in << (quint32)PLUGIN_OP_PROTOCOL;
+    in << (quint32)version;
+
+    /* The reply is encoded with the old protocol too: the plugin only
+     * switches after having sent it */
+    QElapsedTimer timer;
+    timer.start();
+    while (m_process->bytesAvailable() < qint64(2 * sizeof(quint32))) {
+        int remaining = PLUGINPROCESS_START_TIMEOUT - timer.elapsed();
+        if (remaining <= 0 || !m_process->waitForReadyRead(remaining))
+            break;
+    }
+
+    bool ok = false;
+    quint32 response = 0;
+    quint32 acceptedVersion = 0;
+    if (m_process->bytesAvailable() >= qint64(2 * sizeof(quint32))) {
+        in >> response;
+        in >> acceptedVersion;
+        ok = (response == PLUGIN_RESPONSE_PROTOCOL);
+    }
+
+    if (wasConnected) {
+        connect(m_process, SIGNAL(readyRead()),
+                this, SLOT(onReadStandardOutput()));
+    }
+
+    if (!ok) {
+        /* We don't know which protocol the plugin is speaking now */
+        BLAME() << "No protocol acknowledgement from the plugin process";
+        return false;
+    }
+
+    if (acceptedVersion != quint32(version)) {
+        TRACE() << "Plugin process refused protocol version" << version;
+        return true;
+    }
+
+    TRACE() << "Switching to protocol version" << version;
+    m_frameIOHandler = new FrameIOHandler(m_process, m_process,
+                                          quint8(version));
+    return true;
+}
+
+quint32 PluginProxy::nextRequestId()
+{
+    /* 0 is never used, so that it can be used to address no request */
+    if (++m_lastRequestId == 0)
+        ++m_lastRequestId;
+    return m_lastRequestId;
+}
+
+bool PluginProxy::sendFrame(quint16 opcode, quint32 requestId,
+                            const QByteArray &payload)
+{
+    if (!m_frameIOHandler->sendFrame(opcode, requestId, payload)) {
+        BLAME() << "Couldn't write to plugin process, opcode" << opcode;
+        return false;
+    }
+    return true;
+}
+
+bool PluginProxy::waitForFrame(quint16 opcode, quint32 requestId,
+                               QByteArray &payload, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    forever {
+        m_frameIOHandler->readAvailableData();
+
+        FrameIOHandler::Frame frame;
+        while (m_frameIOHandler->takeFrame(frame)) {
+            if (frame.opcode == opcode && frame.requestId == requestId) {
+                payload = frame.payload;
+                return true;
+            }
+            TRACE() << "Skipping unexpected frame" << frame.opcode;
+        }
+
+        if (m_frameIOHandler->hasError())
+            return false;
+
+        int remaining = timeout - timer.elapsed();
+        if (remaining <= 0 || !m_process->waitForReadyRead(remaining))
+            return false;
+    }
+}
+
+void PluginProxy::readFrames()
+{
+    m_frameIOHandler->readAvailableData();
+
+    FrameIOHandler::Frame frame;
+    while (m_frameIOHandler->takeFrame(frame)) {
+        TRACE() << "PROXY RESULT OPERATION:" << frame.opcode;
+        if (frame.requestId == m_currentRequestId) {
+            handleFrame(frame.opcode, frame.payload);
+            /* handling the frame might have replaced the process */
+            if (m_frameIOHandler == NULL)
+                return;
+            continue;
+        }
+
+        /* Plugins reply to concurrent requests in order, so a reply can
+         * only refer to the oldest request. Status notifications are the
+         * only exception: plugins can emit them after a request is over. */
+        if (frame.opcode == PLUGIN_RESPONSE_SIGNAL &&
+            !isRequestPending(frame.requestId)) {
+            TRACE() << "Dropping notification for an old request" <<
+                frame.requestId;
+            continue;
+        }
+
+        BLAME() << "Reply to request" << frame.requestId <<
+            "received while waiting for" << m_currentRequestId;
+        handleProtocolError(QLatin1String("Unexpected reply received from "
+                                          "the authentication plugin."));
+        return;
+    }
+
+    if (m_frameIOHandler->hasError()) {
+        qCritical() << "Invalid data received from the plugin process";
+        handleProtocolError(QLatin1String("Invalid data received from "
+                                          "the authentication plugin."));
+    }
+}
+
+bool PluginProxy::isRequestPending(quint32 requestId) const
+{
+    foreach (const PendingRequest &request, m_pendingRequests) {
+        if (request.m_id == requestId)
+            return true;
+    }
+    return false;
+}
+
+void PluginProxy::handleProtocolError(const QString &message)
+{
+    /* There's no way to resynchronize with the plugin process: replace it,
+     * and fail the requests it was working on */
+    retireProcess(m_process, m_blobIOHandler, m_frameIOHandler);
+
+    m_process = new PluginProcess(this);
+    m_blobIOHandler = NULL;
+    m_frameIOHandler = NULL;
+    setupProcess();
+    m_requestCount = 0;
+
+    if (m_isProcessing)
+        failPendingRequests(message);
+}
+
+void PluginProxy::handleFrame(quint16 opcode, const QByteArray &payload)
+{
+    QDataStream stream(payload);
+
+    switch (opcode) {
+    case PLUGIN_RESPONSE_RESULT:
+    case PLUGIN_RESPONSE_STORE:
+    case PLUGIN_RESPONSE_UI:
+    case PLUGIN_RESPONSE_REFRESHED:
+        handleSessionData(opcode, FrameIOHandler::decodeMap(payload));
+        break;
+    case PLUGIN_RESPONSE_ERROR:
+        {
+            quint32 err;
+            QString errorMessage;
+            stream >> err;
+            stream >> errorMessage;
+            handleError(err, errorMessage);
+        }
+        break;
+    case PLUGIN_RESPONSE_SIGNAL:
+        {
+            quint32 state;
+            QString message;
+            stream >> state;
+            stream >> message;
+            handleStateChange(state, message);
+        }
+        break;
+    default:
+        TRACE() << "Unknown operation code - skipping.";
+        break;
+    }
+}
+
 bool PluginProxy::isProcessing()
 {
     return m_isProcessing;
 }
 
+int PluginProxy::maxConcurrentRequests() const
+{
+    /* Requests can only be pipelined with the framed protocol */
+    return m_frameIOHandler ? m_maxConcurrentRequests : 1;
+}
+
+void PluginProxy::setRecyclingPolicy(const PluginRecyclingPolicy &policy)
+{
+    pluginRecyclingPolicy = policy;
+}
+
+PluginRecyclingPolicy PluginProxy::recyclingPolicy()
+{
+    return pluginRecyclingPolicy;
+}
+
+void PluginProxy::setInProcessPlugins(const QString &pluginsDir,
+                                      const QStringList &types)
+{
+    inProcessPluginsDir = pluginsDir;
+    inProcessPluginTypes = types;
+}
+
+qint64 PluginProxy::memoryUsage() const
+{
+    qint64 pid = m_process->processId();
+    if (pid <= 0)
+        return 0;
+
+    /* The second field is the resident set size, in pages */
+    QFile statm(QString::fromLatin1("/proc/%1/statm").arg(pid));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        TRACE() << "Cannot read" << statm.fileName();
+        return -1;
+    }
+
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.count() < 2)
+        return -1;
+
+    return fields.at(1).toLongLong() * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void PluginProxy::scheduleRecycling()
+{
+    if (!pluginRecyclingPolicy.isEnabled())
+        return;
+
+    /* Queued, so that it runs before the session core starts the next
+     * request */
+    QMetaObject::invokeMethod(this, "recycleIfRequired", Qt::QueuedConnection);
+
+    if (pluginRecyclingPolicy.m_maxIdleTime > 0)
+        m_idleTimer.start(pluginRecyclingPolicy.m_maxIdleTime * 1000);
+}
+
+void PluginProxy::recycleIfRequired()
+{
+    if (m_isProcessing || m_process->state() != QProcess::Running)
+        return;
+
+    const PluginRecyclingPolicy &policy = pluginRecyclingPolicy;
+    if (policy.m_maxRequests > 0 && m_requestCount >= policy.m_maxRequests) {
+        TRACE() << "Plugin process served" << m_requestCount << "requests";
+    } else if (policy.m_maxMemory > 0 &&
+               memoryUsage() > qint64(policy.m_maxMemory)) {
+        TRACE() << "Plugin process is using" << memoryUsage() << "kB";
+    } else {
+        return;
+    }
+
+    /* Spawn the replacement before stopping the old process, so that the
+     * next request doesn't have to wait for it */
+    PluginProcess *oldProcess = m_process;
+    BlobIOHandler *oldBlobIOHandler = m_blobIOHandler;
+    FrameIOHandler *oldFrameIOHandler = m_frameIOHandler;
+
+    m_process = new PluginProcess(this);
+    m_blobIOHandler = NULL;
+    m_frameIOHandler = NULL;
+    setupProcess();
+
+    if (!startProcess()) {
+        BLAME() << "Cannot start a replacement plugin process";
+        retireProcess(m_process, m_blobIOHandler, m_frameIOHandler);
+        m_process = oldProcess;
+        m_blobIOHandler = oldBlobIOHandler;
+        m_frameIOHandler = oldFrameIOHandler;
+        return;
+    }
+
+    connect(m_process, SIGNAL(readyRead()),
+            this, SLOT(onReadStandardOutput()));
+
+    retireProcess(oldProcess, oldBlobIOHandler, oldFrameIOHandler);
+    m_requestCount = 0;
+}
+
+void PluginProxy::onIdleTimeout()
+{
+    if (m_isProcessing || m_process->state() == QProcess::NotRunning)
+        return;
+
+    /* The new process will be started by restartIfRequired() when the next
+     * request arrives */
+    TRACE() << "Stopping idle plugin process";
+    retireProcess(m_process, m_blobIOHandler, m_frameIOHandler);
+
+    m_process = new PluginProcess(this);
+    m_blobIOHandler = NULL;
+    m_frameIOHandler = NULL;
+    setupProcess();
+    m_requestCount = 0;
+}
+
+void PluginProxy::retireProcess(PluginProcess *process,
+                                BlobIOHandler *blobIOHandler,
+                                FrameIOHandler *frameIOHandler)
+{
+    disconnect(process, 0, this, 0);
+    if (blobIOHandler != NULL) {
+        disconnect(blobIOHandler, 0, this, 0);
+        blobIOHandler->setParent(process);
+    }
+
+    if (process->state() != QProcess::NotRunning) {
+        if (frameIOHandler != NULL) {
+            frameIOHandler->sendFrame(PLUGIN_OP_STOP, 0);
+        } else {
+            QDataStream in(process);
+            in << (quint32)PLUGIN_OP_STOP;
+        }
+    }
+
+    delete frameIOHandler;
+    PluginReaper::instance()->reap(process);
+}
+
 void PluginProxy::blobIOError()
 {
     TRACE();
@@ -291,12 +869,18 @@ bool PluginProxy::isResultOperationCodeValid(const int opCode) const
 
 void PluginProxy::onReadStandardOutput()
 {
+    if (m_frameIOHandler) {
+        readFrames();
+        return;
+    }
+
     disconnect(m_process, SIGNAL(readyRead()),
                this, SLOT(onReadStandardOutput()));
 
     if (!m_process->bytesAvailable()) {
         qCritical() << "No information available on process";
         m_isProcessing = false;
+        m_pendingRequests.clear();
         emit processError(Error::InternalServer, QString());
         return;
     }
@@ -343,10 +927,41 @@ void PluginProxy::handlePluginResponse(const quint32 resultOperation,
 {
     TRACE() << resultOperation;
 
+    if (resultOperation == PLUGIN_RESPONSE_ERROR) {
+        quint32 err;
+        QString errorMessage;
+
+        QDataStream stream(m_process);
+        stream >> err;
+        stream >> errorMessage;
+        handleError(err, errorMessage);
+    } else if (resultOperation == PLUGIN_RESPONSE_SIGNAL) {
+        quint32 state;
+        QString message;
+
+        QDataStream stream(m_process);
+        stream >> state;
+        stream >> message;
+        handleStateChange(state, message);
+    } else {
+        handleSessionData(resultOperation, sessionDataMap);
+    }
+
+    connect(m_process, SIGNAL(readyRead()), this, SLOT(onReadStandardOutput()));
+    if (m_process->bytesAvailable()) {
+        TRACE() << "plugin has more to read after handling a response";
+        onReadStandardOutput();
+    }
+}
+
+void PluginProxy::handleSessionData(const quint32 resultOperation,
+                                    const QVariantMap &sessionDataMap)
+{
     if (resultOperation == PLUGIN_RESPONSE_RESULT) {
         TRACE() << "PLUGIN_RESPONSE_RESULT";
 
         m_isProcessing = false;
+        scheduleRecycling();
 
         if (!m_isResultObtained)
             emit processResultReply(sessionDataMap);
@@ -354,6 +969,7 @@ void PluginProxy::handlePluginResponse(const quint32 resultOperation,
             BLAME() << "Unexpected plugin response: ";
 
         m_isResultObtained = true;
+        requestFinished();
     } else if (resultOperation == PLUGIN_RESPONSE_STORE) {
         TRACE() << "PLUGIN_RESPONSE_STORE";
 
@@ -405,42 +1021,59 @@ void PluginProxy::handlePluginResponse(const quint32 resultOperation,
             emit processRefreshRequest(sessionDataMap);
         else
             BLAME() << "Unexpected plugin ui response: ";
-    } else if (resultOperation == PLUGIN_RESPONSE_ERROR) {
-        TRACE() << "PLUGIN_RESPONSE_ERROR";
-        quint32 err;
-        QString errorMessage;
+    }
+}
 
-        QDataStream stream(m_process);
-        stream >> err;
-        stream >> errorMessage;
-        m_isProcessing = false;
+void PluginProxy::handleError(quint32 err, const QString &errorMessage)
+{
+    TRACE() << "PLUGIN_RESPONSE_ERROR";
+    m_isProcessing = false;
+    scheduleRecycling();
 
-        if (!m_isResultObtained)
-            emit processError((int)err, errorMessage);
-        else
-            BLAME() << "Unexpected plugin error: " << errorMessage;
+    if (!m_isResultObtained)
+        emit processError((int)err, errorMessage);
+    else
+        BLAME() << "Unexpected plugin error: " << errorMessage;
 
-        m_isResultObtained = true;
-    } else if (resultOperation == PLUGIN_RESPONSE_SIGNAL) {
-        TRACE() << "PLUGIN_RESPONSE_SIGNAL";
-        quint32 state;
-        QString message;
-
-        QDataStream stream(m_process);
-        stream >> state;
-        stream >> message;
+    m_isResultObtained = true;
+    requestFinished();
+}
 
-        if (!m_isResultObtained)
-            emit stateChanged((int)state, message);
-        else
-            BLAME() << "Unexpected plugin signal: " << state << message;
+void PluginProxy::requestFinished()
+{
+    if (!m_pendingRequests.isEmpty())
+        m_pendingRequests.dequeue();
+
+    /* The following request becomes the current one */
+    m_isProcessing = !m_pendingRequests.isEmpty();
+    if (m_isProcessing) {
+        const PendingRequest &request = m_pendingRequests.head();
+        m_currentRequestId = request.m_id;
+        m_uiPolicy = request.m_uiPolicy;
+        m_isResultObtained = false;
     }
+}
 
-    connect(m_process, SIGNAL(readyRead()), this, SLOT(onReadStandardOutput()));
-    if (m_process->bytesAvailable()) {
-        TRACE() << "plugin has more to read after handling a response";
-        onReadStandardOutput();
-    }
+void PluginProxy::failPendingRequests(const QString &message)
+{
+    int count = m_pendingRequests.count();
+    m_pendingRequests.clear();
+    m_isProcessing = false;
+
+    /* One error for each request, since the replies are matched to the
+     * requests by order; none if the plugin was idle */
+    for (int i = 0; i < count; i++)
+        emit processError(Error::InternalServer, message);
+}
+
+void PluginProxy::handleStateChange(quint32 state, const QString &message)
+{
+    TRACE() << "PLUGIN_RESPONSE_SIGNAL";
+
+    if (!m_isResultObtained)
+        emit stateChanged((int)state, message);
+    else
+        BLAME() << "Unexpected plugin signal: " << state << message;
 }
 
 void PluginProxy::onReadStandardError()
@@ -455,8 +1088,7 @@ void PluginProxy::onExit(int exitCode, QProcess::ExitStatus exitStatus)
 
     if (m_isProcessing || exitStatus == QProcess::CrashExit) {
         qCritical() << "Challenge produces CRASH!";
-        emit processError(Error::InternalServer,
-                          QLatin1String("plugin processed crashed"));
+        failPendingRequests(QLatin1String("plugin processed crashed"));
     }
     if (exitCode == 2) {
         TRACE() << "plugin process terminated because cannot change user";
@@ -477,6 +1109,21 @@ QString PluginProxy::queryType()
     if (!restartIfRequired())
         return QString();
 
+    QString type;
+    if (m_frameIOHandler) {
+        quint32 requestId = nextRequestId();
+        QByteArray payload;
+        if (!sendFrame(PLUGIN_OP_TYPE, requestId) ||
+            !waitForFrame(PLUGIN_RESPONSE_TYPE, requestId, payload,
+                          PLUGINPROCESS_START_TIMEOUT)) {
+            qCritical("PluginProxy returned NULL result");
+            return type;
+        }
+        QDataStream out(payload);
+        out >> type;
+        return type;
+    }
+
     QDataStream ds(m_process);
     ds << (quint32)PLUGIN_OP_TYPE;
 
@@ -486,7 +1133,6 @@ QString PluginProxy::queryType()
     if (!(result = readOnReady(buffer, PLUGINPROCESS_START_TIMEOUT)))
         qCritical("PluginProxy returned NULL result");
 
-    QString type;
     QDataStream out(buffer);
     out >> type;
     return type;
@@ -499,6 +1145,22 @@ QStringList PluginProxy::queryMechanisms()
     if (!restartIfRequired())
         return QStringList();
 
+    if (m_frameIOHandler) {
+        quint32 requestId = nextRequestId();
+        QByteArray payload;
+        QStringList mechanisms;
+        if (!sendFrame(PLUGIN_OP_MECHANISMS, requestId) ||
+            !waitForFrame(PLUGIN_RESPONSE_MECHANISMS, requestId, payload,
+                          PLUGINPROCESS_START_TIMEOUT)) {
+            qCritical("PluginProxy returned NULL result");
+            return mechanisms;
+        }
+        QDataStream out(payload);
+        out >> mechanisms;
+        TRACE() << mechanisms;
+        return mechanisms;
+    }
+
     QDataStream in(m_process);
     in << (quint32)PLUGIN_OP_MECHANISMS;
 
@@ -524,11 +1186,40 @@ QStringList PluginProxy::queryMechanisms()
     return strList;
 }
 
+int PluginProxy::queryConcurrency()
+{
+    TRACE();
+
+    /* The old protocol doesn't support concurrent requests */
+    if (!m_frameIOHandler)
+        return 1;
+
+    quint32 requestId = nextRequestId();
+    QByteArray payload;
+    if (!sendFrame(PLUGIN_OP_CONCURRENCY, requestId) ||
+        !waitForFrame(PLUGIN_RESPONSE_CONCURRENCY, requestId, payload,
+                      PLUGINPROCESS_START_TIMEOUT)) {
+        qCritical("PluginProxy returned NULL result");
+        return 1;
+    }
+
+    quint32 count = 1;
+    QDataStream out(payload);
+    out >> count;
+    TRACE() << count;
+    return qMax(int(count), 1);
+}
+
 bool PluginProxy::waitForStarted(int timeout)
 {
     if (!m_process->waitForStarted(timeout))
         return false;
 
+    /* The protocol is negotiated again with every new process */
+    delete m_frameIOHandler;
+    m_frameIOHandler = NULL;
+    delete m_blobIOHandler;
+
     m_blobIOHandler = new BlobIOHandler(m_process, m_process, this);
 
     connect(m_blobIOHandler,
@@ -536,11 +1227,9 @@ bool PluginProxy::waitForStarted(int timeout)
             this,
             SLOT(sessionDataReceived(const QVariantMap &)));
 
-    QSocketNotifier *readNotifier =
-        new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
-
-    readNotifier->setEnabled(false);
-    m_blobIOHandler->setReadChannelSocketNotifier(readNotifier);
+    /* No socket notifier here: the handler must be woken up by the
+     * readyRead() signal of the plugin process, in order to get the
+     * remaining pages of large BLOBs. */
 
     return true;
 }
@@ -550,16 +1239,57 @@ bool PluginProxy::waitForFinished(int timeout)
     return m_process->waitForFinished(timeout);
 }
 
+bool PluginProxy::startProcess()
+{
+    m_process->start(REMOTEPLUGIN_BIN_PATH, QStringList(m_type));
+
+    QByteArray tmp;
+
+    if (!waitForStarted(PLUGINPROCESS_START_TIMEOUT)) {
+        TRACE() << "The process cannot be started";
+        return false;
+    }
+
+    if (!readOnReady(tmp, PLUGINPROCESS_START_TIMEOUT)) {
+        TRACE() << "The process cannot load plugin";
+        return false;
+    }
+
+    if (!negotiateProtocol(tmp)) {
+        TRACE() << "The protocol negotiation failed";
+        /* Don't leave behind a process we cannot talk to */
+        m_process->kill();
+        m_process->waitForFinished(PLUGINPROCESS_STOP_TIMEOUT);
+        return false;
+    }
+    return true;
+}
+
 bool PluginProxy::restartIfRequired()
 {
+    bool wasInProcess = false;
+    if (m_inProcessPlugin) {
+        /* The requests in flight are failed by onInProcessPluginWedged() */
+        if (!m_inProcessPlugin->isWedged() || m_isProcessing)
+            return true;
+
+        BLAME() << "Falling back to a plugin process for" << m_type;
+        disconnect(m_inProcessPlugin, 0, this, 0);
+        m_inProcessPlugin = NULL;
+        wasInProcess = true;
+    }
+
     if (m_process->state() == QProcess::NotRunning) {
         TRACE() << "RESTART REQUIRED";
-        m_process->start(REMOTEPLUGIN_BIN_PATH, QStringList(m_type));
-
-        QByteArray tmp;
-        if (!waitForStarted(PLUGINPROCESS_START_TIMEOUT) ||
-            !readOnReady(tmp, PLUGINPROCESS_START_TIMEOUT))
+        if (!startProcess())
             return false;
+
+        /* The process object might be a new one, after recycling */
+        connect(m_process, SIGNAL(readyRead()),
+                this, SLOT(onReadStandardOutput()), Qt::UniqueConnection);
+
+        if (wasInProcess)
+            m_maxConcurrentRequests = queryConcurrency();
     }
     return true;
 }
@@ -30,11 +30,37 @@
 
 namespace SignOn {
     class BlobIOHandler;
+    class FrameIOHandler;
     class EncryptedDevice;
 }
 
 namespace SignonDaemonNS {
 
+class InProcessPlugin;
+
+/*!
+ * @class PluginRecyclingPolicy
+ * Limits after which a plugin process gets replaced by a fresh one. A value
+ * of 0 disables the corresponding limit.
+ */
+struct PluginRecyclingPolicy
+{
+    PluginRecyclingPolicy():
+        m_maxRequests(0), m_maxMemory(0), m_maxIdleTime(0) {}
+
+    bool isEnabled() const {
+        return m_maxRequests > 0 || m_maxMemory > 0 || m_maxIdleTime > 0;
+    }
+
+public:
+    /* number of process() requests served */
+    uint m_maxRequests;
+    /* resident memory, in kB */
+    uint m_maxMemory;
+    /* seconds spent without any request */
+    uint m_maxIdleTime;
+};
+
 /*!
  * @class PluginProcess
  * Process to run authentication.
@@ -44,11 +70,40 @@ class PluginProcess: public QProcess
 {
     Q_OBJECT
     friend class PluginProxy;
+    friend class PluginReaper;
 
     PluginProcess(QObject* parent = NULL);
     ~PluginProcess();
 };
 
+/*!
+ * @class PluginReaper
+ * Takes ownership of the plugin processes being stopped, and makes sure that
+ * they terminate without blocking the daemon: processes which don't exit on
+ * their own get a SIGTERM, and later a SIGKILL.
+ */
+class PluginReaper: public QObject
+{
+    Q_OBJECT
+
+public:
+    static PluginReaper *instance();
+    virtual ~PluginReaper();
+
+    void reap(PluginProcess *process);
+    int count() const { return m_processes.count(); }
+
+private Q_SLOTS:
+    void onFinished();
+    void escalate();
+
+private:
+    PluginReaper(QObject *parent);
+
+    /* number of signals sent to each process */
+    QHash<PluginProcess *, int> m_processes;
+};
+
 /*!
  * @class PluginProxy
  * Plugin proxy.
@@ -68,6 +123,18 @@ public:
     bool restartIfRequired();
     bool isProcessing();
 
+    static void setRecyclingPolicy(const PluginRecyclingPolicy &policy);
+    static PluginRecyclingPolicy recyclingPolicy();
+
+    static void setInProcessPlugins(const QString &pluginsDir,
+                                    const QStringList &types);
+    bool isInProcess() const { return m_inProcessPlugin != 0; }
+
+    int maxConcurrentRequests() const;
+
+    uint requestCount() const { return m_requestCount; }
+    qint64 memoryUsage() const;
+
 public Q_SLOTS:
     QString type() const { return m_type; }
     QStringList mechanisms() const { return m_mechanisms; }
@@ -77,6 +144,7 @@ public Q_SLOTS:
     bool processRefresh(const QVariantMap &inData);
     void cancel();
     void stop();
+    void abort();
 
 Q_SIGNALS:
     void processResultReply(const QVariantMap &data);
@@ -91,14 +159,39 @@ Q_SIGNALS:
 private:
     QString queryType();
     QStringList queryMechanisms();
+    int queryConcurrency();
 
+    void setupProcess();
+    bool startProcess();
+    void setupInProcessPlugin(InProcessPlugin *plugin);
     bool waitForStarted(int timeout);
     bool waitForFinished(int timeout);
+    void retireProcess(PluginProcess *process,
+                       SignOn::BlobIOHandler *blobIOHandler,
+                       SignOn::FrameIOHandler *frameIOHandler);
+    void scheduleRecycling();
 
     bool readOnReady(QByteArray &buffer, int timeout);
+    bool negotiateProtocol(const QByteArray &readyMessage);
+    quint32 nextRequestId();
+    bool sendFrame(quint16 opcode, quint32 requestId,
+                   const QByteArray &payload = QByteArray());
+    bool waitForFrame(quint16 opcode, quint32 requestId,
+                      QByteArray &payload, int timeout);
+    void readFrames();
+    bool isRequestPending(quint32 requestId) const;
+    void handleProtocolError(const QString &message);
+    void handleFrame(quint16 opcode, const QByteArray &payload);
 
     void handlePluginResponse(const quint32 resultOperation,
                               const QVariantMap &sessionDataMap = QVariantMap());
+    void handleSessionData(const quint32 resultOperation,
+                           const QVariantMap &sessionDataMap);
+    void handleError(quint32 err, const QString &errorMessage);
+    void handleStateChange(quint32 state, const QString &message);
+
+    void requestFinished();
+    void failPendingRequests(const QString &message);
 
     bool isResultOperationCodeValid(const int opCode) const;
 
@@ -109,6 +202,15 @@ private Q_SLOTS:
     void onError(QProcess::ProcessError err);
     void sessionDataReceived(const QVariantMap &map);
     void blobIOError();
+    void recycleIfRequired();
+    void onIdleTimeout();
+    void inProcessSessionData(quint32 clientId, quint32 response,
+                              const QVariantMap &data);
+    void inProcessError(quint32 clientId, quint32 err,
+                        const QString &message);
+    void inProcessStateChanged(quint32 clientId, quint32 state,
+                               const QString &message);
+    void onInProcessPluginWedged();
 
 private:
     PluginProxy(QString type, QObject *parent = NULL);
@@ -122,6 +224,22 @@ private:
 
     PluginProcess *m_process;
     SignOn::BlobIOHandler *m_blobIOHandler;
+    /* Only set if the plugin process speaks the framed protocol */
+    SignOn::FrameIOHandler *m_frameIOHandler;
+    quint32 m_lastRequestId;
+    /* The oldest request being processed: replies always refer to it */
+    quint32 m_currentRequestId;
+    struct PendingRequest {
+        quint32 m_id;
+        int m_uiPolicy;
+    };
+    QQueue<PendingRequest> m_pendingRequests;
+    int m_maxConcurrentRequests;
+    uint m_requestCount;
+    QTimer m_idleTimer;
+    /* Only set if the plugin runs in a signond thread */
+    InProcessPlugin *m_inProcessPlugin;
+    quint32 m_clientId;
 };
 
 } //namespace SignonDaemonNS
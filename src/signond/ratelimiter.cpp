@@ -0,0 +1,122 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "ratelimiter.h"
+
+#include "accesscontrolmanagerhelper.h"
+#include "signond-common.h"
+
+/* Above this number of buckets, the ones which are full (or, failing that,
+ * the least recently used one) are dropped */
+#define MAX_BUCKETS 256
+
+using namespace SignonDaemonNS;
+
+RateLimiter::RateLimiter():
+    m_rate(0),
+    m_burst(0)
+{
+    m_clock.start();
+}
+
+RateLimiter *RateLimiter::instance()
+{
+    static RateLimiter limiter;
+    return &limiter;
+}
+
+void RateLimiter::setLimits(uint rate, uint burst)
+{
+    m_rate = rate;
+    m_burst = qMax(burst, 1u);
+    m_buckets.clear();
+}
+
+QString RateLimiter::peerKey(const PeerContext &peerContext)
+{
+    QString appId =
+        AccessControlManagerHelper::instance()->appIdOfPeer(peerContext);
+    if (!appId.isEmpty()) return appId;
+
+    return QStringLiteral("pid:") +
+        QString::number(AccessControlManagerHelper::pidOfPeer(peerContext));
+}
+
+bool RateLimiter::admit(const PeerContext &peerContext)
+{
+    if (!isEnabled()) return true;
+    return admit(peerKey(peerContext));
+}
+
+bool RateLimiter::admit(const QString &peer)
+{
+    if (!isEnabled()) return true;
+
+    qint64 now = m_clock.elapsed();
+
+    QHash<QString, Bucket>::iterator it = m_buckets.find(peer);
+    if (it == m_buckets.end()) {
+        if (m_buckets.count() >= MAX_BUCKETS)
+            removeUnusedBuckets(now);
+        Bucket bucket;
+        bucket.m_tokens = m_burst;
+        bucket.m_lastUpdate = now;
+        it = m_buckets.insert(peer, bucket);
+    }
+
+    Bucket &bucket = it.value();
+    bucket.m_tokens = qMin(double(m_burst), bucket.m_tokens +
+                           (now - bucket.m_lastUpdate) * m_rate / 1000.0);
+    bucket.m_lastUpdate = now;
+
+    if (bucket.m_tokens < 1.0) {
+        TRACE() << "Rejecting request from" << peer;
+        return false;
+    }
+
+    bucket.m_tokens -= 1.0;
+    return true;
+}
+
+void RateLimiter::removeUnusedBuckets(qint64 now)
+{
+    QHash<QString, Bucket>::iterator oldest = m_buckets.end();
+    QHash<QString, Bucket>::iterator it = m_buckets.begin();
+    while (it != m_buckets.end()) {
+        const Bucket &bucket = it.value();
+        double tokens = bucket.m_tokens +
+            (now - bucket.m_lastUpdate) * m_rate / 1000.0;
+        if (tokens >= m_burst) {
+            it = m_buckets.erase(it);
+            oldest = m_buckets.end();
+            continue;
+        }
+        if (oldest == m_buckets.end() ||
+            bucket.m_lastUpdate < oldest.value().m_lastUpdate)
+            oldest = it;
+        ++it;
+    }
+
+    if (m_buckets.count() >= MAX_BUCKETS && oldest != m_buckets.end())
+        m_buckets.erase(oldest);
+}
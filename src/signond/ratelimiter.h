@@ -0,0 +1,81 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_RATELIMITER_H
+#define SIGNON_RATELIMITER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+
+namespace SignonDaemonNS {
+
+class PeerContext;
+
+/*!
+ * @class RateLimiter
+ * Admission control for the requests of the D-Bus clients: each peer has a
+ * token bucket which is refilled at a constant rate, and every request
+ * costs one token. Requests from peers whose bucket is empty must be
+ * rejected before doing any work on them.
+ */
+class RateLimiter
+{
+public:
+    static RateLimiter *instance();
+
+    /*!
+     * Sets the number of requests per second accepted from each peer on
+     * average, and the number of requests which can be accepted at once
+     * after a period of inactivity. A @rate of 0 disables rate limiting.
+     */
+    void setLimits(uint rate, uint burst);
+    bool isEnabled() const { return m_rate > 0; }
+
+    /*!
+     * Takes a token from the bucket of @peer.
+     * @returns false if the request must be rejected.
+     */
+    bool admit(const QString &peer);
+    bool admit(const PeerContext &peerContext);
+
+    static QString peerKey(const PeerContext &peerContext);
+
+private:
+    RateLimiter();
+    void removeUnusedBuckets(qint64 now);
+
+    struct Bucket {
+        double m_tokens;
+        qint64 m_lastUpdate; // msecs
+    };
+
+    uint m_rate;
+    uint m_burst;
+    QElapsedTimer m_clock;
+    QHash<QString, Bucket> m_buckets;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_RATELIMITER_H
@@ -0,0 +1,209 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "requestscheduler.h"
+
+#include "signond-common.h"
+#include "SignOn/sessiondata.h"
+#include "SignOn/uisessiondata_priv.h"
+
+#include <QCoreApplication>
+
+using namespace SignonDaemonNS;
+
+static RequestScheduler *schedulerInstance = NULL;
+
+RequestScheduler::RequestScheduler(QObject *parent):
+    QObject(parent),
+    m_activeRequests(0),
+    m_maxActiveRequests(0),
+    m_scheduled(false)
+{
+}
+
+RequestScheduler::~RequestScheduler()
+{
+    schedulerInstance = NULL;
+}
+
+RequestScheduler *RequestScheduler::instance()
+{
+    if (schedulerInstance == NULL)
+        schedulerInstance = new RequestScheduler(QCoreApplication::instance());
+    return schedulerInstance;
+}
+
+RequestScheduler::Priority
+RequestScheduler::priorityFor(const QVariantMap &params)
+{
+    int uiPolicy = params.value(SSOUI_KEY_UIPOLICY).toInt();
+    return uiPolicy == SignOn::NoUserInteractionPolicy ?
+        Background : Interactive;
+}
+
+void RequestScheduler::submit(QObject *owner, Priority priority,
+                              const QString &peer, const StartCb &start)
+{
+    Ticket ticket;
+    ticket.m_owner = owner;
+    ticket.m_start = start;
+    ticket.m_waitTimer.start();
+
+    Queue &queue = m_queues[priority];
+    if (!queue.m_peers.contains(peer))
+        queue.m_peers.append(peer);
+    queue.m_tickets[peer].enqueue(ticket);
+
+    scheduleLater();
+}
+
+void RequestScheduler::release(QObject *owner)
+{
+    QHash<QObject *, int>::iterator it = m_activeByOwner.find(owner);
+    if (it == m_activeByOwner.end()) {
+        BLAME() << "Releasing a request which was not granted";
+        return;
+    }
+
+    if (--it.value() == 0)
+        m_activeByOwner.erase(it);
+    m_activeRequests--;
+
+    scheduleLater();
+}
+
+void RequestScheduler::withdraw(QObject *owner)
+{
+    for (int priority = 0; priority < NumPriorities; priority++) {
+        Queue &queue = m_queues[priority];
+        QStringList::iterator peer = queue.m_peers.begin();
+        while (peer != queue.m_peers.end()) {
+            QQueue<Ticket> &tickets = queue.m_tickets[*peer];
+            QQueue<Ticket>::iterator i = tickets.begin();
+            while (i != tickets.end()) {
+                if (i->m_owner == owner)
+                    i = tickets.erase(i);
+                else
+                    ++i;
+            }
+
+            if (tickets.isEmpty()) {
+                queue.m_tickets.remove(*peer);
+                peer = queue.m_peers.erase(peer);
+            } else {
+                ++peer;
+            }
+        }
+    }
+
+    int active = m_activeByOwner.take(owner);
+    if (active > 0) {
+        m_activeRequests -= active;
+        scheduleLater();
+    }
+}
+
+int RequestScheduler::queueLength(Priority priority) const
+{
+    int length = 0;
+    foreach (const QQueue<Ticket> &tickets, m_queues[priority].m_tickets)
+        length += tickets.count();
+    return length;
+}
+
+QVariantMap RequestScheduler::statistics() const
+{
+    static const char *names[NumPriorities] = {
+        "Interactive", "Background"
+    };
+
+    QVariantMap statistics;
+    statistics.insert(QLatin1String("ActiveRequests"), m_activeRequests);
+    statistics.insert(QLatin1String("MaxActiveRequests"),
+                      m_maxActiveRequests);
+
+    for (int priority = 0; priority < NumPriorities; priority++) {
+        const Queue &queue = m_queues[priority];
+        QVariantMap stats;
+        stats.insert(QLatin1String("QueueLength"),
+                     queueLength(Priority(priority)));
+        stats.insert(QLatin1String("Granted"), queue.m_granted);
+        stats.insert(QLatin1String("AverageWait"), queue.m_granted > 0 ?
+                     queue.m_totalWait / queue.m_granted : 0);
+        stats.insert(QLatin1String("MaxWait"), queue.m_maxWait);
+        statistics.insert(QLatin1String(names[priority]), stats);
+    }
+
+    return statistics;
+}
+
+void RequestScheduler::scheduleLater()
+{
+    /* Grants are never given from within the caller's stack, since they
+     * cause more requests to be submitted */
+    if (m_scheduled) return;
+    m_scheduled = true;
+    QMetaObject::invokeMethod(this, "schedule", Qt::QueuedConnection);
+}
+
+void RequestScheduler::schedule()
+{
+    m_scheduled = false;
+
+    for (int priority = 0; priority < NumPriorities; priority++) {
+        while (!m_queues[priority].m_peers.isEmpty()) {
+            if (m_maxActiveRequests > 0 &&
+                m_activeRequests >= m_maxActiveRequests) {
+                TRACE() << "Limit of active requests reached";
+                return;
+            }
+            grant(Priority(priority));
+        }
+    }
+}
+
+void RequestScheduler::grant(Priority priority)
+{
+    Queue &queue = m_queues[priority];
+
+    /* Serve the first peer, and move it to the back of the line */
+    QString peer = queue.m_peers.takeFirst();
+    QQueue<Ticket> &tickets = queue.m_tickets[peer];
+    Ticket ticket = tickets.dequeue();
+    if (tickets.isEmpty())
+        queue.m_tickets.remove(peer);
+    else
+        queue.m_peers.append(peer);
+
+    qint64 wait = ticket.m_waitTimer.elapsed();
+    queue.m_granted++;
+    queue.m_totalWait += wait;
+    if (wait > queue.m_maxWait)
+        queue.m_maxWait = wait;
+    TRACE() << "Granting request of" << peer << "priority" << priority <<
+        "after" << wait << "ms";
+
+    m_activeRequests++;
+    m_activeByOwner[ticket.m_owner]++;
+    ticket.m_start();
+}
@@ -0,0 +1,129 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_REQUESTSCHEDULER_H
+#define SIGNON_REQUESTSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QStringList>
+#include <QVariantMap>
+
+#include <functional>
+
+namespace SignonDaemonNS {
+
+/*!
+ * @class RequestScheduler
+ * Decides when the authentication requests of all the session cores get
+ * sent to their plugins.
+ * Session cores submit their next request and start it only once the
+ * scheduler grants it. Requests are served by priority class; within the
+ * same class, peers are served in turn, so that a single client cannot
+ * starve the others. If a global limit is set, no more than that number of
+ * requests is processed by the plugins at any time.
+ */
+class RequestScheduler: public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority {
+        /* The user might be waiting for the result */
+        Interactive = 0,
+        /* NoUserInteractionPolicy requests, such as token refreshes */
+        Background,
+        NumPriorities
+    };
+
+    typedef std::function<void()> StartCb;
+
+    static RequestScheduler *instance();
+    virtual ~RequestScheduler();
+
+    static Priority priorityFor(const QVariantMap &params);
+
+    /* 0 means no limit */
+    void setMaxActiveRequests(int count) { m_maxActiveRequests = count; }
+    int maxActiveRequests() const { return m_maxActiveRequests; }
+
+    /*!
+     * Queues a request of @owner; @start is invoked once the request can be
+     * started. Each owner can have a single request waiting.
+     */
+    void submit(QObject *owner, Priority priority, const QString &peer,
+                const StartCb &start);
+    /*!
+     * Must be called when a started request is over.
+     */
+    void release(QObject *owner);
+    /*!
+     * Drops the waiting request of @owner, and releases its started ones.
+     */
+    void withdraw(QObject *owner);
+
+    int activeRequests() const { return m_activeRequests; }
+    int queueLength(Priority priority) const;
+    /*!
+     * @returns the scheduling metrics: queue lengths, number of granted
+     * requests and their waiting time (average and maximum, in msecs) for
+     * each priority class.
+     */
+    QVariantMap statistics() const;
+
+private Q_SLOTS:
+    void schedule();
+
+private:
+    RequestScheduler(QObject *parent);
+    void scheduleLater();
+    void grant(Priority priority);
+
+    struct Ticket {
+        QObject *m_owner;
+        StartCb m_start;
+        QElapsedTimer m_waitTimer;
+    };
+
+    struct Queue {
+        Queue(): m_granted(0), m_totalWait(0), m_maxWait(0) {}
+        /* peers having waiting requests, in the order they'll be served */
+        QStringList m_peers;
+        QHash<QString, QQueue<Ticket> > m_tickets;
+        qint64 m_granted;
+        qint64 m_totalWait;
+        qint64 m_maxWait;
+    };
+
+    Queue m_queues[NumPriorities];
+    QHash<QObject *, int> m_activeByOwner;
+    int m_activeRequests;
+    int m_maxActiveRequests;
+    bool m_scheduled;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_REQUESTSCHEDULER_H
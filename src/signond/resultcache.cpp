@@ -0,0 +1,261 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "resultcache.h"
+
+#include "signond-common.h"
+#include "SignOn/authpluginif.h"
+#include "SignOn/uisessiondata_priv.h"
+
+#define SSO_KEY_EXPIRES_IN QLatin1String("ExpiresIn")
+#define SSO_KEY_RENEW_TOKEN QLatin1String("RenewToken")
+#define SSO_KEY_WINDOW_ID QLatin1String("WindowId")
+#define SSO_KEY_NETWORK_TIMEOUT QLatin1String("NetworkTimeout")
+#define SSO_KEY_TIMEOUT QLatin1String("Timeout")
+
+#define RESULT_CACHE_DEFAULT_MAX_ENTRIES 100
+
+using namespace SignonDaemonNS;
+
+ResultCache::ResultCache():
+    m_defaultLifetime(0),
+    m_maxEntries(RESULT_CACHE_DEFAULT_MAX_ENTRIES),
+    m_useCounter(0)
+{
+}
+
+ResultCache *ResultCache::instance()
+{
+    static ResultCache cache;
+    return &cache;
+}
+
+void ResultCache::setCachedMethods(const QStringList &methods)
+{
+    m_methods = methods;
+    if (m_methods.isEmpty())
+        clear();
+}
+
+void ResultCache::setMaxEntries(int maxEntries)
+{
+    m_maxEntries = qMax(maxEntries, 0);
+    makeRoom(0);
+}
+
+bool ResultCache::isEnabled(const QString &method) const
+{
+    return m_methods.contains(method);
+}
+
+bool ResultCache::canLookup(const QVariantMap &params)
+{
+    /* The client explicitly asked for a new token */
+    if (params.value(SSO_KEY_RENEW_TOKEN).toBool()) return false;
+    return canInsert(params);
+}
+
+bool ResultCache::canInsert(const QVariantMap &params)
+{
+    /* The user must be asked for the password every time */
+    return params.value(SSOUI_KEY_UIPOLICY).toInt() !=
+        SignOn::RequestPasswordPolicy;
+}
+
+QVariantMap ResultCache::normalizedParams(const QVariantMap &params)
+{
+    QVariantMap normalized;
+
+    QMapIterator<QString, QVariant> it(params);
+    while (it.hasNext()) {
+        it.next();
+        if (it.value().isNull() || !it.value().isValid()) continue;
+        /* These don't affect the result */
+        if (it.key() == SSO_KEY_RENEW_TOKEN ||
+            it.key() == SSO_KEY_WINDOW_ID ||
+            it.key() == SSO_KEY_NETWORK_TIMEOUT ||
+            it.key() == SSO_KEY_TIMEOUT) continue;
+        normalized.insert(it.key(), it.value());
+    }
+
+    return normalized;
+}
+
+void ResultCache::removeExpired(QList<Entry> &entries)
+{
+    QList<Entry>::iterator i = entries.begin();
+    while (i != entries.end()) {
+        if (i->isExpired())
+            i = entries.erase(i);
+        else
+            ++i;
+    }
+}
+
+void ResultCache::removeAllExpired()
+{
+    QHash<quint32, QList<Entry> >::iterator it = m_entries.begin();
+    while (it != m_entries.end()) {
+        removeExpired(it.value());
+        if (it.value().isEmpty())
+            it = m_entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+void ResultCache::removeLeastRecentlyUsed()
+{
+    QHash<quint32, QList<Entry> >::iterator oldest = m_entries.end();
+    int oldestIndex = -1;
+    quint64 oldestUse = 0;
+
+    QHash<quint32, QList<Entry> >::iterator it;
+    for (it = m_entries.begin(); it != m_entries.end(); ++it) {
+        const QList<Entry> &entries = it.value();
+        for (int i = 0; i < entries.count(); i++) {
+            if (oldestIndex < 0 || entries.at(i).m_lastUsed < oldestUse) {
+                oldest = it;
+                oldestIndex = i;
+                oldestUse = entries.at(i).m_lastUsed;
+            }
+        }
+    }
+
+    if (oldestIndex < 0) return;
+
+    TRACE() << "Evicting a cached result of" << oldest.key();
+    oldest.value().removeAt(oldestIndex);
+    if (oldest.value().isEmpty())
+        m_entries.erase(oldest);
+}
+
+void ResultCache::makeRoom(int needed)
+{
+    if (m_maxEntries <= 0) return;
+
+    if (count() + needed > m_maxEntries)
+        removeAllExpired();
+
+    int toRemove = count() + needed - m_maxEntries;
+    for (int i = 0; i < toRemove; i++)
+        removeLeastRecentlyUsed();
+}
+
+bool ResultCache::lookup(quint32 id, const QString &method,
+                         const QString &mechanism,
+                         const QVariantMap &params, QVariantMap &result)
+{
+    if (!isEnabled(method) || !canLookup(params)) return false;
+
+    QHash<quint32, QList<Entry> >::iterator it = m_entries.find(id);
+    if (it == m_entries.end()) return false;
+
+    QList<Entry> &entries = it.value();
+    removeExpired(entries);
+    if (entries.isEmpty()) {
+        m_entries.erase(it);
+        return false;
+    }
+
+    QVariantMap key = normalizedParams(params);
+    for (int i = 0; i < entries.count(); i++) {
+        Entry &entry = entries[i];
+        if (entry.m_method != method || entry.m_mechanism != mechanism ||
+            entry.m_params != key) continue;
+
+        entry.m_lastUsed = ++m_useCounter;
+        result = entry.m_result;
+        if (result.contains(SSO_KEY_EXPIRES_IN)) {
+            qint64 remaining = entry.m_lifetime - entry.m_timer.elapsed();
+            result[SSO_KEY_EXPIRES_IN] = int(remaining / 1000);
+        }
+        TRACE() << "Found cached result for" << id << method << mechanism;
+        return true;
+    }
+
+    return false;
+}
+
+void ResultCache::insert(quint32 id, const QString &method,
+                         const QString &mechanism,
+                         const QVariantMap &params, const QVariantMap &result)
+{
+    if (!isEnabled(method) || !canInsert(params)) return;
+
+    qint64 lifetime = m_defaultLifetime;
+    if (result.contains(SSO_KEY_EXPIRES_IN)) {
+        bool ok = false;
+        lifetime = result.value(SSO_KEY_EXPIRES_IN).toLongLong(&ok);
+        if (!ok) return;
+    }
+    if (lifetime <= 0) return;
+
+    Entry entry;
+    entry.m_method = method;
+    entry.m_mechanism = mechanism;
+    entry.m_params = normalizedParams(params);
+    entry.m_result = result;
+    entry.m_lifetime = lifetime * 1000;
+    entry.m_timer.start();
+    entry.m_lastUsed = ++m_useCounter;
+
+    QHash<quint32, QList<Entry> >::iterator it = m_entries.find(id);
+    if (it != m_entries.end()) {
+        QList<Entry> &entries = it.value();
+        removeExpired(entries);
+        for (int i = 0; i < entries.count(); i++) {
+            const Entry &other = entries.at(i);
+            if (other.m_method == method && other.m_mechanism == mechanism &&
+                other.m_params == entry.m_params) {
+                entries.removeAt(i);
+                break;
+            }
+        }
+        if (entries.isEmpty())
+            m_entries.erase(it);
+    }
+
+    /* Results of identities which are never used again would otherwise stay
+     * in memory forever */
+    makeRoom(1);
+    m_entries[id].append(entry);
+}
+
+void ResultCache::invalidate(quint32 id)
+{
+    m_entries.remove(id);
+}
+
+void ResultCache::clear()
+{
+    m_entries.clear();
+}
+
+int ResultCache::count() const
+{
+    int count = 0;
+    foreach (const QList<Entry> &entries, m_entries)
+        count += entries.count();
+    return count;
+}
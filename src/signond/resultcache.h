@@ -0,0 +1,105 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_RESULTCACHE_H
+#define SIGNON_RESULTCACHE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QVariantMap>
+
+namespace SignonDaemonNS {
+
+/*!
+ * @class ResultCache
+ * Keeps the successful replies of the authentication plugins for a short
+ * time, so that repeated identical requests can be answered without invoking
+ * the plugin again. Caching is enabled per authentication method; results
+ * are kept for the number of seconds given by their "ExpiresIn" field or,
+ * if that is missing, for the configured default lifetime.
+ * When the cache is full, expired results are dropped first, and then the
+ * least recently used ones.
+ */
+class ResultCache
+{
+public:
+    static ResultCache *instance();
+
+    void setCachedMethods(const QStringList &methods);
+    void setDefaultLifetime(uint seconds) { m_defaultLifetime = seconds; }
+    /* Maximum number of cached results; 0 means no limit */
+    void setMaxEntries(int maxEntries);
+    int maxEntries() const { return m_maxEntries; }
+    bool isEnabled(const QString &method) const;
+
+    /*!
+     * Looks for a valid result for the given request parameters.
+     * @returns true if a result was found; its "ExpiresIn" field, if present,
+     * is updated with the remaining lifetime.
+     */
+    bool lookup(quint32 id, const QString &method, const QString &mechanism,
+                const QVariantMap &params, QVariantMap &result);
+    void insert(quint32 id, const QString &method, const QString &mechanism,
+                const QVariantMap &params, const QVariantMap &result);
+
+    /* Forgets all the results obtained for the given identity */
+    void invalidate(quint32 id);
+    void clear();
+    int count() const;
+
+    static bool canLookup(const QVariantMap &params);
+    static bool canInsert(const QVariantMap &params);
+
+private:
+    ResultCache();
+
+    struct Entry {
+        QString m_method;
+        QString m_mechanism;
+        QVariantMap m_params;
+        QVariantMap m_result;
+        QElapsedTimer m_timer;
+        qint64 m_lifetime; // msecs
+        /* Value of m_useCounter when the entry was last used */
+        quint64 m_lastUsed;
+        bool isExpired() const { return m_timer.hasExpired(m_lifetime); }
+    };
+
+    static QVariantMap normalizedParams(const QVariantMap &params);
+    void removeExpired(QList<Entry> &entries);
+    void removeAllExpired();
+    void removeLeastRecentlyUsed();
+    void makeRoom(int needed);
+
+    QStringList m_methods;
+    uint m_defaultLifetime;
+    int m_maxEntries;
+    quint64 m_useCounter;
+    QHash<quint32, QList<Entry> > m_entries;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_RESULTCACHE_H
@@ -0,0 +1,72 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "sessionindex.h"
+
+using namespace SignonDaemonNS;
+
+quint32 SessionIndex::registerMethod(const QString &method)
+{
+    quint32 id = m_methodIds.value(method, 0);
+    if (id == 0) {
+        id = m_methodIds.count() + 1;
+        m_methodIds.insert(method, id);
+    }
+    return id;
+}
+
+bool SessionIndex::insert(quint32 id, quint32 methodId,
+                          SignonSessionCore *core)
+{
+    if (id == 0) {
+        m_nonStoredSessions.insert(core);
+        return true;
+    }
+
+    Key key(id, methodId);
+    if (m_storedSessions.contains(key)) return false;
+    m_storedSessions.insert(key, core);
+    return true;
+}
+
+void SessionIndex::remove(quint32 id, quint32 methodId,
+                          SignonSessionCore *core)
+{
+    if (id == 0) {
+        m_nonStoredSessions.remove(core);
+        return;
+    }
+
+    Key key(id, methodId);
+    if (m_storedSessions.value(key) == core)
+        m_storedSessions.remove(key);
+}
+
+QList<SignonSessionCore *> SessionIndex::takeAll()
+{
+    QList<SignonSessionCore *> sessions = m_storedSessions.values();
+    sessions += m_nonStoredSessions.toList();
+    m_storedSessions.clear();
+    m_nonStoredSessions.clear();
+    return sessions;
+}
@@ -0,0 +1,86 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef SIGNON_SESSIONINDEX_H
+#define SIGNON_SESSIONINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QString>
+
+namespace SignonDaemonNS {
+
+class SignonSessionCore;
+
+/*!
+ * @class SessionIndex
+ * Index of the live session cores. Sessions of stored identities are unique
+ * for each identity and method, and are found by the pair (identity ID,
+ * method ID), where method names are interned into integers; sessions of
+ * new identities are only kept in a set.
+ */
+class SessionIndex
+{
+public:
+    SessionIndex() {}
+
+    /*!
+     * @returns the ID of @method, or 0 if it has never been registered.
+     */
+    quint32 methodId(const QString &method) const {
+        return m_methodIds.value(method, 0);
+    }
+    quint32 registerMethod(const QString &method);
+
+    SignonSessionCore *find(quint32 id, quint32 methodId) const {
+        return m_storedSessions.value(Key(id, methodId), 0);
+    }
+
+    /*!
+     * Adds @core to the index; if @id is 0, @methodId is ignored.
+     * @returns false if another session is registered for the same key.
+     */
+    bool insert(quint32 id, quint32 methodId, SignonSessionCore *core);
+    void remove(quint32 id, quint32 methodId, SignonSessionCore *core);
+
+    QList<SignonSessionCore *> storedSessions() const {
+        return m_storedSessions.values();
+    }
+    QList<SignonSessionCore *> takeAll();
+    int count() const {
+        return m_storedSessions.count() + m_nonStoredSessions.count();
+    }
+
+private:
+    typedef QPair<quint32, quint32> Key;
+
+    QHash<QString, quint32> m_methodIds;
+    QHash<Key, SignonSessionCore *> m_storedSessions;
+    QSet<SignonSessionCore *> m_nonStoredSessions;
+};
+
+} //namespace SignonDaemonNS
+
+#endif // SIGNON_SESSIONINDEX_H
@@ -23,6 +23,9 @@
 
 #include "signond-common.h"
 #include "signonauthsession.h"
+#include "credentialsaccessmanager.h"
+#include "credentialsdb.h"
+#include "error.h"
 
 using namespace SignonDaemonNS;
 
@@ -88,12 +91,46 @@ pid_t SignonAuthSession::ownerPid() const
     return m_ownerPid;
 }
 
+Error SignonAuthSession::checkMechanism(const QString &mechanism,
+                                        QString &allowedMechanism) const
+{
+    allowedMechanism = mechanism;
+    if (id() == SIGNOND_NEW_IDENTITY) return Error::none();
+
+    CredentialsDB *db = CredentialsAccessManager::instance()->credentialsDB();
+    if (!db) {
+        BLAME() << "Null database handler object.";
+        return Error::none();
+    }
+
+    SignonIdentityInfo identityInfo = db->credentials(id(), false);
+    if (!identityInfo.checkMethodAndMechanism(method(), mechanism,
+                                              allowedMechanism)) {
+        QString errMsg;
+        QTextStream(&errMsg) << SIGNOND_METHOD_OR_MECHANISM_NOT_ALLOWED_ERR_STR
+                             << " Method:"
+                             << method()
+                             << ", mechanism:"
+                             << mechanism
+                             << ", allowed:"
+                             << allowedMechanism;
+        return Error(Error::MethodOrMechanismNotAllowed, errMsg);
+    }
+
+    return Error::none();
+}
+
 QStringList
 SignonAuthSession::queryAvailableMechanisms(const QStringList &wantedMechanisms)
 {
     return parent()->queryAvailableMechanisms(wantedMechanisms);
 }
 
+int SignonAuthSession::queueLength() const
+{
+    return parent()->queueLength();
+}
+
 void SignonAuthSession::process(const QVariantMap &sessionDataVa,
                                 const QString &mechanism,
                                 const PeerContext &peerContext,
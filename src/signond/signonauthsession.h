@@ -69,11 +69,17 @@ public:
     QString method() const;
     pid_t ownerPid() const;
 
+    /* Checks whether the identity allows the given mechanism; on success,
+     * allowedMechanism is set to the mechanism to be used */
+    Error checkMechanism(const QString &mechanism,
+                         QString &allowedMechanism) const;
+
     typedef std::function<void(const QVariantMap &map, const Error &error)>
         ProcessCb;
 
 public Q_SLOTS:
     QStringList queryAvailableMechanisms(const QStringList &wantedMechanisms);
+    int queueLength() const;
     void process(const QVariantMap &sessionDataVa,
                  const QString &mechanism,
                  const PeerContext &peerContext,
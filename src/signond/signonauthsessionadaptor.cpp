@@ -25,9 +25,8 @@
 
 #include "signonauthsessionadaptor.h"
 #include "accesscontrolmanagerhelper.h"
-#include "credentialsaccessmanager.h"
-#include "credentialsdb.h"
 #include "erroradaptor.h"
+#include "ratelimiter.h"
 
 namespace SignonDaemonNS {
 
@@ -79,32 +78,19 @@ QVariantMap SignonAuthSessionAdaptor::process(const QVariantMap &sessionDataVa,
 {
     TRACE() << mechanism;
 
-    QString allowedMechanism(mechanism);
-
-    if (parent()->id() != SIGNOND_NEW_IDENTITY) {
-        CredentialsDB *db =
-            CredentialsAccessManager::instance()->credentialsDB();
-        if (db) {
-            SignonIdentityInfo identityInfo = db->credentials(parent()->id(),
-                                                              false);
-            if (!identityInfo.checkMethodAndMechanism(parent()->method(),
-                                                      mechanism,
-                                                      allowedMechanism)) {
-                QString errMsg;
-                QTextStream(&errMsg) << SIGNOND_METHOD_OR_MECHANISM_NOT_ALLOWED_ERR_STR
-                                     << " Method:"
-                                     << parent()->method()
-                                     << ", mechanism:"
-                                     << mechanism
-                                     << ", allowed:"
-                                     << allowedMechanism;
-                errorReply(SIGNOND_METHOD_OR_MECHANISM_NOT_ALLOWED_ERR_NAME,
-                           errMsg);
-                return QVariantMap();
-            }
-        } else {
-            BLAME() << "Null database handler object.";
-        }
+    const QDBusContext &context = *this;
+    if (!RateLimiter::instance()->admit(PeerContext(context))) {
+        errorReply(SIGNOND_TOO_MANY_REQUESTS_ERR_NAME,
+                   SIGNOND_TOO_MANY_REQUESTS_ERR_STR);
+        return QVariantMap();
+    }
+
+    QString allowedMechanism;
+    Error error = parent()->checkMechanism(mechanism, allowedMechanism);
+    if (error) {
+        ErrorAdaptor errorAdaptor(error);
+        errorReply(errorAdaptor.code(), errorAdaptor.message());
+        return QVariantMap();
     }
 
     QDBusContext &dbusContext = *this;
@@ -138,6 +124,26 @@ QVariantMap SignonAuthSessionAdaptor::process(const QVariantMap &sessionDataVa,
     return QVariantMap(); // ignored
 }
 
+uint SignonAuthSessionAdaptor::queueLength()
+{
+    TRACE();
+
+    QDBusContext &dbusContext = *this;
+    if (AccessControlManagerHelper::pidOfPeer(dbusContext) !=
+        parent()->ownerPid()) {
+        TRACE() << "queueLength called from peer that doesn't own the "
+            "AuthSession object";
+        QString errMsg;
+        QTextStream(&errMsg) << SIGNOND_PERMISSION_DENIED_ERR_STR
+                             << " Authentication session owned by other "
+                             "process.";
+        errorReply(SIGNOND_PERMISSION_DENIED_ERR_NAME, errMsg);
+        return 0;
+    }
+
+    return parent()->queueLength();
+}
+
 void SignonAuthSessionAdaptor::cancel()
 {
     TRACE();
@@ -52,6 +52,7 @@ public Q_SLOTS:
     QStringList queryAvailableMechanisms(const QStringList &wantedMechanisms);
     QVariantMap process(const QVariantMap &sessionDataVa,
                         const QString &mechanism);
+    uint queueLength();
 
     Q_NOREPLY void cancel();
     Q_NOREPLY void setId(quint32 id);
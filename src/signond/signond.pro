@@ -17,11 +17,14 @@ HEADERS += \
     credentialsaccessmanager.h \
     credentialsdb.h \
     credentialsdb_p.h \
+    databasereaders.h \
     default-crypto-manager.h \
     default-key-authorizer.h \
     default-secrets-storage.h \
     error.h \
     erroradapter.h \
+    idlepolicy.h \
+    peercache.h \
     peercontext.h \
     signonsessioncore.h \
     signonauthsessionadaptor.h \
@@ -33,6 +36,11 @@ HEADERS += \
     signondisposable.h \
     signontrace.h \
     pluginproxy.h \
+    inprocessplugin.h \
+    ratelimiter.h \
+    requestscheduler.h \
+    resultcache.h \
+    sessionindex.h \
     signonidentityinfo.h \
     signonui_interface.h \
     signonidentityadaptor.h \
@@ -42,10 +50,13 @@ SOURCES += \
     accesscontrolmanagerhelper.cpp \
     credentialsaccessmanager.cpp \
     credentialsdb.cpp \
+    databasereaders.cpp \
     default-crypto-manager.cpp \
     default-key-authorizer.cpp \
     default-secrets-storage.cpp \
     erroradaptor.cpp \
+    idlepolicy.cpp \
+    peercache.cpp \
     signonsessioncore.cpp \
     signonauthsessionadaptor.cpp \
     signonauthsession.cpp \
@@ -54,6 +65,11 @@ SOURCES += \
     signondisposable.cpp \
     signonui_interface.cpp \
     pluginproxy.cpp \
+    inprocessplugin.cpp \
+    ratelimiter.cpp \
+    requestscheduler.cpp \
+    resultcache.cpp \
+    sessionindex.cpp \
     main.cpp \
     signondaemon.cpp \
     signonidentityinfo.cpp \
@@ -72,6 +88,7 @@ CONFIG += build_all \
 
 QMAKE_LIBDIR += \
     $${TOP_BUILD_DIR}/lib/plugins/signon-plugins-common \
+    $${TOP_BUILD_DIR}/lib/plugins \
     $${TOP_BUILD_DIR}/lib/signond/SignOn
 
 CONFIG(enable-p2p) {
@@ -97,6 +114,7 @@ DEFINES += SIGNOND_TRACE
 LIBS += \
     -lrt \
     -lsignon-plugins-common \
+    -lsignon-plugins \
     -lsignon-extension
 
 headers.files = $$HEADERS
@@ -47,6 +47,14 @@ extern "C" {
 #include "signonidentity.h"
 #include "signonauthsession.h"
 #include "accesscontrolmanagerhelper.h"
+#include "credentialsdb_p.h"
+#include "databasereaders.h"
+#include "erroradaptor.h"
+#include "inprocessplugin.h"
+#include "peercache.h"
+#include "ratelimiter.h"
+#include "requestscheduler.h"
+#include "resultcache.h"
 
 #define SIGNON_RETURN_IF_CAM_UNAVAILABLE(_ret_arg_) do {                   \
         if (m_pCAMManager && !m_pCAMManager->credentialsSystemOpened()) {  \
@@ -67,10 +75,20 @@ namespace SignonDaemonNS {
 SignonDaemonConfiguration::SignonDaemonConfiguration():
     m_pluginsDir(QLatin1String(SIGNOND_PLUGINS_DIR)),
     m_extensionsDir(QLatin1String(SIGNOND_EXTENSIONS_DIR)),
+    m_saveState(false),
     m_camConfiguration(),
     m_daemonTimeout(0), // 0 = no timeout
+    m_maxDaemonTimeout(0), // 0 = DaemonTimeout
     m_identityTimeout(300),//secs
-    m_authSessionTimeout(300)//secs
+    m_authSessionTimeout(300),//secs
+    m_cachedResultLifetime(0),
+    m_cachedResultMaxEntries(100),
+    m_maxActiveRequests(0),
+    m_rateLimit(0),
+    m_rateLimitBurst(20),
+    m_maxQueueLength(0),
+    m_maxQueuedData(0),
+    m_databaseReaderThreads(0)
 {}
 
 SignonDaemonConfiguration::~SignonDaemonConfiguration()
@@ -86,6 +104,7 @@ SignonDaemonConfiguration::~SignonDaemonConfiguration()
     StoragePath=~/.signon/
     ;0 - fatal, 1 - critical(default), 2 - info/debug
     LoggingLevel=1
+    SaveState=false
 
     [SecureStorage]
     FileSystemName=signonfs
@@ -95,6 +114,35 @@ SignonDaemonConfiguration::~SignonDaemonConfiguration()
     [ObjectTimeouts]
     IdentityTimeout=300
     AuthSessionTimeout=300
+    DaemonTimeout=0
+    MaxDaemonTimeout=0
+
+    [PluginRecycling]
+    MaxRequests=0
+    MaxMemory=0
+    MaxIdleTime=0
+
+    [Plugins]
+    InProcess=password
+
+    [ResultCache]
+    Methods=oauth2
+    DefaultLifetime=0
+    MaxEntries=100
+
+    [Scheduler]
+    MaxActiveRequests=0
+
+    [RateLimit]
+    RequestsPerSecond=0
+    Burst=20
+
+    [RequestQueue]
+    MaxLength=0
+    MaxData=0
+
+    [DatabaseReaders]
+    Threads=0
  */
 void SignonDaemonConfiguration::load()
 {
@@ -112,6 +160,8 @@ void SignonDaemonConfiguration::load()
         settings.value(QLatin1String("LoggingLevel"), 1).toInt();
     setLoggingLevel(loggingLevel);
 
+    m_saveState = settings.value(QLatin1String("SaveState"), false).toBool();
+
     QString cfgStoragePath =
         settings.value(QLatin1String("StoragePath")).toString();
     if (!cfgStoragePath.isEmpty()) {
@@ -160,6 +210,79 @@ void SignonDaemonConfiguration::load()
     if (isOk)
         m_daemonTimeout = aux;
 
+    aux = settings.value(QLatin1String("MaxDaemonTimeout")).toUInt(&isOk);
+    if (isOk)
+        m_maxDaemonTimeout = aux;
+
+    settings.endGroup();
+
+    //Plugin process recycling
+    settings.beginGroup(QLatin1String("PluginRecycling"));
+
+    aux = settings.value(QLatin1String("MaxRequests")).toUInt(&isOk);
+    if (isOk)
+        m_pluginRecyclingPolicy.m_maxRequests = aux;
+
+    aux = settings.value(QLatin1String("MaxMemory")).toUInt(&isOk);
+    if (isOk)
+        m_pluginRecyclingPolicy.m_maxMemory = aux;
+
+    aux = settings.value(QLatin1String("MaxIdleTime")).toUInt(&isOk);
+    if (isOk)
+        m_pluginRecyclingPolicy.m_maxIdleTime = aux;
+
+    settings.endGroup();
+
+    //Trusted plugins, run in signond's own process
+    settings.beginGroup(QLatin1String("Plugins"));
+    m_inProcessPlugins =
+        settings.value(QLatin1String("InProcess")).toStringList();
+    settings.endGroup();
+
+    //Caching of the authentication results
+    settings.beginGroup(QLatin1String("ResultCache"));
+    m_cachedResultMethods =
+        settings.value(QLatin1String("Methods")).toStringList();
+    aux = settings.value(QLatin1String("DefaultLifetime")).toUInt(&isOk);
+    if (isOk)
+        m_cachedResultLifetime = aux;
+    aux = settings.value(QLatin1String("MaxEntries")).toUInt(&isOk);
+    if (isOk)
+        m_cachedResultMaxEntries = aux;
+    settings.endGroup();
+
+    //Scheduling of the authentication requests
+    settings.beginGroup(QLatin1String("Scheduler"));
+    aux = settings.value(QLatin1String("MaxActiveRequests")).toUInt(&isOk);
+    if (isOk)
+        m_maxActiveRequests = aux;
+    settings.endGroup();
+
+    //Admission control of the clients' requests
+    settings.beginGroup(QLatin1String("RateLimit"));
+    aux = settings.value(QLatin1String("RequestsPerSecond")).toUInt(&isOk);
+    if (isOk)
+        m_rateLimit = aux;
+    aux = settings.value(QLatin1String("Burst")).toUInt(&isOk);
+    if (isOk)
+        m_rateLimitBurst = aux;
+    settings.endGroup();
+
+    //Requests waiting to be processed
+    settings.beginGroup(QLatin1String("RequestQueue"));
+    aux = settings.value(QLatin1String("MaxLength")).toUInt(&isOk);
+    if (isOk)
+        m_maxQueueLength = aux;
+    aux = settings.value(QLatin1String("MaxData")).toUInt(&isOk);
+    if (isOk)
+        m_maxQueuedData = aux;
+    settings.endGroup();
+
+    //Threads running the DB queries
+    settings.beginGroup(QLatin1String("DatabaseReaders"));
+    aux = settings.value(QLatin1String("Threads")).toUInt(&isOk);
+    if (isOk)
+        m_databaseReaderThreads = aux;
     settings.endGroup();
 
     //Environment variables
@@ -239,8 +362,11 @@ SignonDaemon::SignonDaemon(QObject *parent):
     QObject(parent),
     m_configuration(0),
     m_pCAMManager(0),
+    m_isInitialized(false),
     m_dbusServer(0)
 {
+    m_startupTimer.start();
+
     // Files created by signond must be unreadable by "other"
     umask(S_IROTH | S_IWOTH);
 
@@ -253,12 +379,17 @@ SignonDaemon::SignonDaemon(QObject *parent):
 
 SignonDaemon::~SignonDaemon()
 {
+    SignonDisposable::setIdlePolicy(0);
+    if (m_configuration && m_configuration->saveState())
+        saveState();
+
     ::close(sigFd[0]);
     ::close(sigFd[1]);
 
     delete m_dbusServer;
 
     SignonAuthSession::stopAllAuthSessions();
+    InProcessPlugin::unloadAll();
     m_storedIdentities.clear();
 
     if (m_pCAMManager) {
@@ -362,6 +493,27 @@ void SignonDaemon::init()
         qWarning("SignonDaemon could not create the configuration object.");
 
     m_configuration->load();
+    PluginProxy::setRecyclingPolicy(m_configuration->pluginRecyclingPolicy());
+    PluginProxy::setInProcessPlugins(m_configuration->pluginsDir(),
+                                     m_configuration->inProcessPlugins());
+    ResultCache *resultCache = ResultCache::instance();
+    resultCache->setCachedMethods(m_configuration->cachedResultMethods());
+    resultCache->setDefaultLifetime(m_configuration->cachedResultLifetime());
+    resultCache->setMaxEntries(m_configuration->cachedResultMaxEntries());
+    RequestScheduler::instance()->setMaxActiveRequests(
+        m_configuration->maxActiveRequests());
+    RateLimiter::instance()->setLimits(m_configuration->rateLimit(),
+                                       m_configuration->rateLimitBurst());
+    SignonSessionCore::setQueueLimits(
+        m_configuration->maxQueueLength(),
+        qint64(m_configuration->maxQueuedData()) * 1024);
+    DatabaseReaders::instance()->setThreadCount(
+        m_configuration->databaseReaderThreads());
+    m_idlePolicy.setTimeouts(m_configuration->daemonTimeout(),
+                             m_configuration->maxDaemonTimeout());
+    if (m_configuration->saveState())
+        loadState();
+    TRACE() << "Configuration loaded after" << m_startupTimer.elapsed() << "ms";
 
     QCoreApplication *app = QCoreApplication::instance();
     if (!app)
@@ -433,17 +585,39 @@ void SignonDaemon::init()
                        QLatin1String("Disconnected"),
                        this, SLOT(onDisconnected()));
 
-    initExtensions();
-
-    if (!initStorage())
-        BLAME() << "Signond: Cannot initialize credentials storage.";
+    TRACE() << "D-Bus service registered after" << m_startupTimer.elapsed() <<
+        "ms";
 
     if (m_configuration->daemonTimeout() > 0) {
         SignonDisposable::invokeOnIdle(m_configuration->daemonTimeout(),
                                        this, SLOT(deleteLater()));
+        SignonDisposable::setIdlePolicy(&m_idlePolicy);
     }
 
-    TRACE() << "Signond SUCCESSFULLY initialized.";
+    /* Loading the extensions and opening the storage can take a long time
+     * (the encrypted FS might need to be mounted): it's done by
+     * ensureInitialized() when the first request which needs them arrives.
+     * Requests such as queryMethods() and queryMechanisms() never wait for
+     * it. */
+}
+
+void SignonDaemon::ensureInitialized()
+{
+    if (m_isInitialized) return;
+    m_isInitialized = true;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    initExtensions();
+    TRACE() << "Extensions loaded in" << timer.restart() << "ms";
+
+    if (!initStorage())
+        BLAME() << "Signond: Cannot initialize credentials storage.";
+    TRACE() << "Storage initialized in" << timer.elapsed() << "ms";
+
+    TRACE() << "Signond SUCCESSFULLY initialized after" <<
+        m_startupTimer.elapsed() << "ms";
 }
 
 void SignonDaemon::onNewConnection(const QDBusConnection &connection)
@@ -454,6 +628,9 @@ void SignonDaemon::onNewConnection(const QDBusConnection &connection)
                              this, QDBusConnection::ExportAdaptors)) {
         qFatal("Failed to register SignonDaemon object");
     }
+
+    /* The client's credentials won't change: read them right away */
+    PeerCache::instance()->addConnection(conn);
 }
 
 void SignonDaemon::initExtensions()
@@ -508,6 +685,62 @@ bool SignonDaemon::initStorage()
     return true;
 }
 
+QString SignonDaemon::stateFilePath() const
+{
+    return m_configuration->camConfiguration().m_storagePath +
+        QLatin1String("/daemon-state");
+}
+
+void SignonDaemon::loadState()
+{
+    QSettings state(stateFilePath(), QSettings::IniFormat);
+
+    m_idlePolicy.restore(
+        state.value(QLatin1String("IdleSince")).toLongLong(),
+        state.value(QLatin1String("AverageIdleTime")).toLongLong());
+    /* The daemon was started because a client needs it */
+    m_idlePolicy.idleEnded(QDateTime::currentMSecsSinceEpoch());
+
+    state.beginGroup(QLatin1String("Mechanisms"));
+    foreach (const QString &method, state.childGroups()) {
+        state.beginGroup(method);
+        CachedMechanisms &cached = m_mechanisms[method];
+        cached.m_pluginModified =
+            state.value(QLatin1String("PluginModified")).toLongLong();
+        cached.m_mechanisms =
+            state.value(QLatin1String("Mechanisms")).toStringList();
+        state.endGroup();
+    }
+    state.endGroup();
+
+    TRACE() << "State loaded, mechanisms known for" << m_mechanisms.keys();
+}
+
+void SignonDaemon::saveState() const
+{
+    QSettings state(stateFilePath(), QSettings::IniFormat);
+    state.clear();
+
+    state.setValue(QLatin1String("IdleSince"), m_idlePolicy.idleSince());
+    state.setValue(QLatin1String("AverageIdleTime"),
+                   m_idlePolicy.averageIdleTime());
+
+    state.beginGroup(QLatin1String("Mechanisms"));
+    QHash<QString, CachedMechanisms>::const_iterator i;
+    for (i = m_mechanisms.constBegin(); i != m_mechanisms.constEnd(); i++) {
+        state.beginGroup(i.key());
+        state.setValue(QLatin1String("PluginModified"),
+                       i.value().m_pluginModified);
+        state.setValue(QLatin1String("Mechanisms"), i.value().m_mechanisms);
+        state.endGroup();
+    }
+    state.endGroup();
+
+    state.sync();
+    if (state.status() != QSettings::NoError)
+        BLAME() << "Couldn't save the state to" << stateFilePath();
+}
+
 void SignonDaemon::onIdentityStored(SignonIdentity *identity)
 {
     m_storedIdentities.insert(identity->id(), identity);
@@ -597,8 +830,89 @@ SignonIdentity *SignonDaemon::getIdentity(const quint32 id,
     return identity;
 }
 
+QList<QVariantMap> SignonDaemon::getIdentities(const QList<quint32> &ids,
+                                               const PeerContext &peerContext)
+{
+    clearLastError();
+
+    SIGNON_RETURN_IF_CAM_UNAVAILABLE(QList<QVariantMap>());
+
+    TRACE() << "Getting identities:" << ids;
+
+    CredentialsDB *db = m_pCAMManager->credentialsDB();
+    if (!db) {
+        qCritical() << Q_FUNC_INFO << m_pCAMManager->lastError();
+        return QList<QVariantMap>();
+    }
+
+    AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
+    /* Most identities share the same security contexts: each of them is
+     * checked only once */
+    AccessControlManagerHelper::AccessCache accessCache;
+
+    /* The info of the identity objects already alive is cached; the others
+     * are all read at once, together with their owner and access control
+     * lists */
+    QList<quint32> missingIds;
+    foreach (quint32 id, ids) {
+        if (id != SIGNOND_NEW_IDENTITY &&
+            m_storedIdentities.value(id, NULL) == NULL)
+            missingIds.append(id);
+    }
+
+    QHash<quint32, SignonIdentityInfo> storedInfo;
+    if (!missingIds.isEmpty()) {
+        storedInfo = db->credentials(missingIds);
+        if (db->errorOccurred()) {
+            setLastError(internalServerErrName,
+                         internalServerErrStr +
+                         QLatin1String("Querying database error "
+                                       "occurred."));
+            return QList<QVariantMap>();
+        }
+    }
+
+    QList<QVariantMap> identities;
+    QSet<quint32> seen;
+    foreach (quint32 id, ids) {
+        if (id == SIGNOND_NEW_IDENTITY || seen.contains(id)) continue;
+        seen.insert(id);
+
+        SignonIdentityInfo info;
+        SignonIdentity *identity = m_storedIdentities.value(id, NULL);
+        if (identity != NULL) {
+            bool ok;
+            info = identity->queryInfo(ok, false);
+        } else {
+            info = storedInfo.value(id);
+        }
+
+        if (info.isNew()) {
+            TRACE() << "Identity not found:" << id;
+            continue;
+        }
+
+        if (!acm->isPeerAllowedToUseIdentity(peerContext, info,
+                                             accessCache)) {
+            TRACE() << "Peer not allowed to use identity" << id;
+            continue;
+        }
+
+        identities.append(info.toMap());
+    }
+
+    return identities;
+}
+
 QStringList SignonDaemon::queryMethods()
 {
+    /* The list is only rebuilt when files are added to or removed from the
+     * plugins directory */
+    QDateTime lastModified =
+        QFileInfo(m_configuration->pluginsDir()).lastModified();
+    if (lastModified.isValid() && lastModified == m_methodsLastModified)
+        return m_methods;
+
     QDir pluginsDir(m_configuration->pluginsDir());
     //TODO: in the future remove the sym links comment
     QStringList fileNames = pluginsDir.entryList(
@@ -616,6 +930,8 @@ QStringList SignonDaemon::queryMethods()
         }
     }
 
+    m_methods = ret;
+    m_methodsLastModified = lastModified;
     return ret;
 }
 
@@ -625,6 +941,20 @@ QStringList SignonDaemon::queryMechanisms(const QString &method)
 
     TRACE() << method;
 
+    /* Avoid starting the plugin, if it hasn't changed since the last time
+     * its mechanisms were read */
+    QFileInfo pluginInfo(QDir(m_configuration->pluginsDir()).
+                         filePath(SIGNOND_PLUGIN_PREFIX + method +
+                                  SIGNOND_PLUGIN_SUFFIX));
+    qint64 pluginModified = pluginInfo.exists() ?
+        pluginInfo.lastModified().toMSecsSinceEpoch() : 0;
+    QHash<QString, CachedMechanisms>::const_iterator cached =
+        m_mechanisms.constFind(method);
+    if (pluginModified != 0 && cached != m_mechanisms.constEnd() &&
+        cached.value().m_pluginModified == pluginModified) {
+        return cached.value().m_mechanisms;
+    }
+
     PluginProxy *plugin = PluginProxy::createNewPluginProxy(method);
 
     if (!plugin) {
@@ -640,9 +970,35 @@ QStringList SignonDaemon::queryMechanisms(const QString &method)
     QStringList mechs = plugin->mechanisms();
     delete plugin;
 
+    if (pluginModified != 0) {
+        CachedMechanisms &entry = m_mechanisms[method];
+        entry.m_pluginModified = pluginModified;
+        entry.m_mechanisms = mechs;
+    }
     return mechs;
 }
 
+static QMap<QString, QString> identityFilter(const QVariantMap &filter)
+{
+    QMap<QString, QString> filterLocal;
+    QMapIterator<QString, QVariant> it(filter);
+    while (it.hasNext()) {
+        it.next();
+        filterLocal.insert(it.key(), it.value().toString());
+    }
+    return filterLocal;
+}
+
+static QList<QVariantMap>
+identitiesToMaps(const QList<SignonIdentityInfo> &credentials)
+{
+    QList<QVariantMap> mapList;
+    foreach (const SignonIdentityInfo &info, credentials) {
+        mapList.append(info.toMap());
+    }
+    return mapList;
+}
+
 QList<QVariantMap> SignonDaemon::queryIdentities(const QVariantMap &filter)
 {
     clearLastError();
@@ -657,14 +1013,8 @@ QList<QVariantMap> SignonDaemon::queryIdentities(const QVariantMap &filter)
         return QList<QVariantMap>();
     }
 
-    QMap<QString, QString> filterLocal;
-    QMapIterator<QString, QVariant> it(filter);
-    while (it.hasNext()) {
-        it.next();
-        filterLocal.insert(it.key(), it.value().toString());
-    }
-
-    QList<SignonIdentityInfo> credentials = db->credentials(filterLocal);
+    QList<SignonIdentityInfo> credentials =
+        db->credentials(identityFilter(filter));
 
     if (db->errorOccurred()) {
         setLastError(internalServerErrName,
@@ -673,11 +1023,53 @@ QList<QVariantMap> SignonDaemon::queryIdentities(const QVariantMap &filter)
         return QList<QVariantMap>();
     }
 
-    QList<QVariantMap> mapList;
-    foreach (const SignonIdentityInfo &info, credentials) {
-        mapList.append(info.toMap());
+    return identitiesToMaps(credentials);
+}
+
+void SignonDaemon::queryIdentities(const QVariantMap &filter,
+                                   const QueryIdentitiesCb &callback)
+{
+    DatabaseReaders *readers = DatabaseReaders::instance();
+    CredentialsDB *db = m_pCAMManager->credentialsSystemOpened() ?
+        m_pCAMManager->credentialsDB() : 0;
+    if (!readers->isEnabled() || !db) {
+        QList<QVariantMap> identities = queryIdentities(filter);
+        callback(identities, lastErrorIsValid() ?
+                 ErrorAdaptor::errorFromName(m_lastErrorName,
+                                             m_lastErrorMessage) :
+                 Error::none());
+        return;
     }
-    return mapList;
+
+    TRACE() << "Querying identities in a worker thread";
+
+    /* Both the DB query and the conversion of the results run in the
+     * worker thread; so does the callback */
+    QMap<QString, QString> filterLocal = identityFilter(filter);
+    readers->run(db->metaDataDbName(),
+                 [filterLocal, callback](MetaDataDB *metaDataDB) {
+        if (!metaDataDB) {
+            callback(QList<QVariantMap>(),
+                     Error(Error::InternalServer,
+                           internalServerErrStr +
+                           QLatin1String("Could not access Signon "
+                                         "Database.")));
+            return;
+        }
+
+        QList<SignonIdentityInfo> credentials =
+            metaDataDB->identities(filterLocal);
+        if (metaDataDB->errorOccurred()) {
+            callback(QList<QVariantMap>(),
+                     Error(Error::InternalServer,
+                           internalServerErrStr +
+                           QLatin1String("Querying database error "
+                                         "occurred.")));
+            return;
+        }
+
+        callback(identitiesToMaps(credentials), Error::none());
+    });
 }
 
 bool SignonDaemon::clear()
@@ -699,6 +1091,9 @@ bool SignonDaemon::clear()
                      QLatin1String("Database error occurred."));
         return false;
     }
+    ResultCache::instance()->clear();
+    PeerCache::instance()->invalidateAccess(SIGNOND_NEW_IDENTITY);
+    SignonSessionCore::identityChanged(SIGNOND_NEW_IDENTITY);
     return true;
 }
 
@@ -719,6 +1114,40 @@ SignonAuthSession *SignonDaemon::getAuthSession(const quint32 id,
     return authSession;
 }
 
+void SignonDaemon::processOneShot(const quint32 id, const QString &method,
+                                  const QString &mechanism,
+                                  const QVariantMap &sessionData,
+                                  const PeerContext &peerContext,
+                                  const ProcessCb &callback)
+{
+    TRACE() << "One-shot authentication, identity" << id << "method" << method;
+
+    pid_t ownerPid = AccessControlManagerHelper::pidOfPeer(peerContext);
+    SignonAuthSession *authSession = getAuthSession(id, method, ownerPid);
+    if (!authSession) {
+        callback(QVariantMap(), Error(Error::MethodNotKnown));
+        return;
+    }
+
+    QString allowedMechanism;
+    Error error = authSession->checkMechanism(mechanism, allowedMechanism);
+    if (error) {
+        authSession->deleteLater();
+        callback(QVariantMap(), error);
+        return;
+    }
+
+    /* The session is never exported: its state changes are not reported to
+     * the client, and it goes away with the reply */
+    QPointer<SignonAuthSession> session(authSession);
+    authSession->process(sessionData, allowedMechanism, peerContext,
+                         [session, callback](const QVariantMap &map,
+                                             const Error &error) {
+        callback(map, error);
+        if (session) session->deleteLater();
+    });
+}
+
 void SignonDaemon::onDisconnected()
 {
     TRACE() << "Disconnected from session bus: exiting";
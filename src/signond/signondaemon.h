@@ -36,6 +36,11 @@ extern "C" {
 #include <QtDBus>
 
 #include "credentialsaccessmanager.h"
+#include "error.h"
+#include "idlepolicy.h"
+#include "pluginproxy.h"
+
+#include <functional>
 
 #ifndef SIGNOND_PLUGINS_DIR
     #define SIGNOND_PLUGINS_DIR "/usr/lib/signon"
@@ -77,23 +82,65 @@ public:
     QString extensionsDir() const { return m_extensionsDir; }
     QString busAddress() const { return m_busAddress; }
     uint daemonTimeout() const { return m_daemonTimeout; }
+    uint maxDaemonTimeout() const { return m_maxDaemonTimeout; }
+    bool saveState() const { return m_saveState; }
     uint identityTimeout() const { return m_identityTimeout; }
     uint authSessionTimeout() const { return m_authSessionTimeout; }
 
+    const PluginRecyclingPolicy &pluginRecyclingPolicy() const {
+        return m_pluginRecyclingPolicy;
+    }
+    QStringList inProcessPlugins() const { return m_inProcessPlugins; }
+    QStringList cachedResultMethods() const { return m_cachedResultMethods; }
+    uint cachedResultLifetime() const { return m_cachedResultLifetime; }
+    uint cachedResultMaxEntries() const { return m_cachedResultMaxEntries; }
+    uint maxActiveRequests() const { return m_maxActiveRequests; }
+    uint rateLimit() const { return m_rateLimit; }
+    uint rateLimitBurst() const { return m_rateLimitBurst; }
+    uint maxQueueLength() const { return m_maxQueueLength; }
+    uint maxQueuedData() const { return m_maxQueuedData; }
+    uint databaseReaderThreads() const { return m_databaseReaderThreads; }
+
 private:
     QString m_pluginsDir;
     QString m_extensionsDir;
     QString m_busAddress;
+    bool m_saveState;
 
     // storage configuration
     CAMConfiguration m_camConfiguration;
 
     //object timeouts
     uint m_daemonTimeout;
+    uint m_maxDaemonTimeout;
     uint m_identityTimeout;
     uint m_authSessionTimeout;
+
+    // plugin process limits
+    PluginRecyclingPolicy m_pluginRecyclingPolicy;
+    QStringList m_inProcessPlugins;
+
+    // result caching
+    QStringList m_cachedResultMethods;
+    uint m_cachedResultLifetime;
+    uint m_cachedResultMaxEntries;
+
+    // limit of requests processed by the plugins at the same time
+    uint m_maxActiveRequests;
+
+    // requests accepted from each client
+    uint m_rateLimit;
+    uint m_rateLimitBurst;
+
+    // limits of the requests waiting in the sessions' queues
+    uint m_maxQueueLength;
+    uint m_maxQueuedData;
+
+    // threads running the read-only DB queries
+    uint m_databaseReaderThreads;
 };
 
+class PeerContext;
 class SignonIdentity;
 
 /*!
@@ -124,18 +171,42 @@ public:
 public:
     SignonIdentity *registerNewIdentity();
     SignonIdentity *getIdentity(const quint32 id, QVariantMap &identityData);
+    /* Returns the data of the given identities which exist and which the
+     * peer is allowed to use, without creating any identity object */
+    QList<QVariantMap> getIdentities(const QList<quint32> &ids,
+                                     const PeerContext &peerContext);
     SignonAuthSession *getAuthSession(const quint32 id, const QString type,
                                       pid_t ownerPid);
+    /* Runs a single authentication on an ephemeral session, which is
+     * destroyed once the result has been delivered to the callback */
+    typedef std::function<void(const QVariantMap &map,
+                               const Error &error)> ProcessCb;
+    void processOneShot(const quint32 id, const QString &method,
+                        const QString &mechanism,
+                        const QVariantMap &sessionData,
+                        const PeerContext &peerContext,
+                        const ProcessCb &callback);
 
     QStringList queryMethods();
     QStringList queryMechanisms(const QString &method);
     QList<QVariantMap> queryIdentities(const QVariantMap &filter);
+    /* Runs the query in a DatabaseReaders thread, if enabled; the callback
+     * can then be invoked in that thread */
+    typedef std::function<void(const QList<QVariantMap> &identities,
+                               const Error &error)> QueryIdentitiesCb;
+    void queryIdentities(const QVariantMap &filter,
+                         const QueryIdentitiesCb &callback);
     bool clear();
 
     QString lastErrorName() const { return m_lastErrorName; }
     QString lastErrorMessage() const { return m_lastErrorMessage; }
     bool lastErrorIsValid() const { return !m_lastErrorName.isEmpty(); }
 
+    /* Loads the extensions and opens the credentials storage, if this hasn't
+     * been done yet; must be called before serving requests which use the
+     * access control manager or the DB */
+    void ensureInitialized();
+
 private Q_SLOTS:
     void onDisconnected();
     void onNewConnection(const QDBusConnection &connection);
@@ -148,6 +219,10 @@ private:
     void initExtension(const QString &filePath);
     bool initStorage();
 
+    QString stateFilePath() const;
+    void loadState();
+    void saveState() const;
+
     void watchIdentity(SignonIdentity *identity);
     void setupSignalHandlers();
 
@@ -170,6 +245,25 @@ private:
     int m_identityTimeout;
     int m_authSessionTimeout;
 
+    /* Extensions and storage are initialized after the D-Bus service is
+     * registered */
+    bool m_isInitialized;
+    QElapsedTimer m_startupTimer;
+
+    /* Cached result of queryMethods() */
+    QStringList m_methods;
+    QDateTime m_methodsLastModified;
+
+    /* Cached results of queryMechanisms(), valid as long as the plugin file
+     * is not modified */
+    struct CachedMechanisms {
+        qint64 m_pluginModified;
+        QStringList m_mechanisms;
+    };
+    QHash<QString, CachedMechanisms> m_mechanisms;
+
+    IdlePolicy m_idlePolicy;
+
     QDBusServer *m_dbusServer;
 
     QString m_lastErrorName;
@@ -29,6 +29,8 @@
 #include "signondisposable.h"
 #include "signonidentityadaptor.h"
 #include "accesscontrolmanagerhelper.h"
+#include "erroradaptor.h"
+#include "ratelimiter.h"
 
 namespace SignonDaemonNS {
 
@@ -50,15 +52,23 @@ SignonDaemonAdaptor::registerObject(const QDBusConnection &connection,
 {
     QString path = object->objectName();
 
-    QObject *registeredObject = connection.objectRegisteredAt(path);
-    if (!registeredObject || registeredObject->parent() != object) {
-        QDBusConnection conn(connection);
-        auto adaptor = new typename T::Adaptor(object);
-        if (!conn.registerObject(path, adaptor,
-                                 QDBusConnection::ExportAllContents)) {
-            BLAME() << "Object registration failed:" << object <<
-                conn.lastError();
-        }
+    /* A single adaptor serves all the connections on which the object is
+     * registered: its signals are relayed to each of them */
+    typedef typename T::Adaptor Adaptor;
+    Adaptor *adaptor =
+        object->template findChild<Adaptor *>(QString(),
+                                              Qt::FindDirectChildrenOnly);
+    if (!adaptor) {
+        adaptor = new Adaptor(object);
+    } else if (connection.objectRegisteredAt(path) == adaptor) {
+        return QDBusObjectPath(path);
+    }
+
+    QDBusConnection conn(connection);
+    if (!conn.registerObject(path, adaptor,
+                             QDBusConnection::ExportAllContents)) {
+        BLAME() << "Object registration failed:" << object <<
+            conn.lastError();
     }
     return QDBusObjectPath(path);
 }
@@ -68,6 +78,7 @@ void SignonDaemonAdaptor::registerNewIdentity(const QString &applicationContext,
 {
     Q_UNUSED(applicationContext);
 
+    m_parent->ensureInitialized();
     SignonIdentity *identity = m_parent->registerNewIdentity();
 
     QDBusConnection dbusConnection(parentDBusContext().connection());
@@ -98,6 +109,17 @@ void SignonDaemonAdaptor::securityErrorReply(const QDBusConnection &conn,
     TRACE() << "Method FAILED Access Control check:" << msg.member();
 }
 
+void SignonDaemonAdaptor::tooManyRequestsErrorReply(const QDBusConnection &conn,
+                                                    const QDBusMessage &msg)
+{
+    msg.setDelayedReply(true);
+    QDBusMessage errReply =
+                msg.createErrorReply(SIGNOND_TOO_MANY_REQUESTS_ERR_NAME,
+                                     SIGNOND_TOO_MANY_REQUESTS_ERR_STR);
+    conn.send(errReply);
+    TRACE() << "Method rejected by rate limiting:" << msg.member();
+}
+
 bool SignonDaemonAdaptor::handleLastError(const QDBusConnection &conn,
                                           const QDBusMessage &msg)
 {
@@ -118,6 +140,7 @@ void SignonDaemonAdaptor::getIdentity(const quint32 id,
 {
     Q_UNUSED(applicationContext);
 
+    m_parent->ensureInitialized();
     AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
     QDBusMessage msg = parentDBusContext().message();
     QDBusConnection conn = parentDBusContext().connection();
@@ -169,6 +192,23 @@ void SignonDaemonAdaptor::onIdentityAccessReplyFinished()
     SignonDisposable::destroyUnused();
 }
 
+MapList SignonDaemonAdaptor::getIdentities(const QList<quint32> &ids,
+                                           const QString &applicationContext)
+{
+    Q_UNUSED(applicationContext);
+
+    m_parent->ensureInitialized();
+    QDBusMessage msg = parentDBusContext().message();
+    QDBusConnection conn = parentDBusContext().connection();
+
+    /* Identities which the peer is not allowed to use are left out of the
+     * reply: no access request is made for them */
+    MapList identities = m_parent->getIdentities(ids, PeerContext(conn, msg));
+    if (handleLastError(conn, msg)) return MapList();
+
+    return identities;
+}
+
 QStringList SignonDaemonAdaptor::queryMethods()
 {
     return m_parent->queryMethods();
@@ -182,10 +222,17 @@ QDBusObjectPath SignonDaemonAdaptor::getAuthSessionObjectPath(const quint32 id,
 
     SignonDisposable::destroyUnused();
 
+    m_parent->ensureInitialized();
     AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
     QDBusMessage msg = parentDBusContext().message();
     QDBusConnection conn = parentDBusContext().connection();
 
+    /* Reject flooding clients before doing any work */
+    if (!RateLimiter::instance()->admit(PeerContext(conn, msg))) {
+        tooManyRequestsErrorReply(conn, msg);
+        return QDBusObjectPath();
+    }
+
     /* Access Control */
     if (id != SIGNOND_NEW_IDENTITY) {
         if (!acm->isPeerAllowedToUseIdentity(PeerContext(conn, msg), id)) {
@@ -241,6 +288,85 @@ void SignonDaemonAdaptor::onAuthSessionAccessReplyFinished()
     SignonDisposable::destroyUnused();
 }
 
+QVariantMap SignonDaemonAdaptor::processOneShot(const quint32 id,
+                                                const QString &method,
+                                                const QString &mechanism,
+                                                const QVariantMap &sessionData)
+{
+    TRACE() << method << mechanism;
+
+    m_parent->ensureInitialized();
+    AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
+    QDBusMessage msg = parentDBusContext().message();
+    QDBusConnection conn = parentDBusContext().connection();
+
+    if (!RateLimiter::instance()->admit(PeerContext(conn, msg))) {
+        tooManyRequestsErrorReply(conn, msg);
+        return QVariantMap();
+    }
+
+    msg.setDelayedReply(true);
+
+    /* Access Control */
+    if (id != SIGNOND_NEW_IDENTITY &&
+        !acm->isPeerAllowedToUseIdentity(PeerContext(conn, msg), id)) {
+        SignOn::AccessReply *reply =
+            acm->requestAccessToIdentity(PeerContext(conn, msg), id);
+        reply->setProperty("method", method);
+        reply->setProperty("mechanism", mechanism);
+        reply->setProperty("sessionData", sessionData);
+        QObject::connect(reply, SIGNAL(finished()),
+                         this, SLOT(onOneShotAccessReplyFinished()));
+        return QVariantMap();
+    }
+
+    startOneShot(conn, msg, id, method, mechanism, sessionData);
+    return QVariantMap(); // ignored
+}
+
+void SignonDaemonAdaptor::onOneShotAccessReplyFinished()
+{
+    SignOn::AccessReply *reply = qobject_cast<SignOn::AccessReply*>(sender());
+    Q_ASSERT(reply != 0);
+
+    reply->deleteLater();
+    QDBusConnection connection = reply->request().peerConnection();
+    QDBusMessage message = reply->request().peerMessage();
+    quint32 id = reply->request().identity();
+    AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
+
+    if (!reply->isAccepted() ||
+        !acm->isPeerAllowedToUseIdentity(PeerContext(connection, message), id)) {
+        securityErrorReply(connection, message);
+        return;
+    }
+
+    startOneShot(connection, message, id,
+                 reply->property("method").toString(),
+                 reply->property("mechanism").toString(),
+                 reply->property("sessionData").toMap());
+}
+
+void SignonDaemonAdaptor::startOneShot(const QDBusConnection &connection,
+                                       const QDBusMessage &message,
+                                       quint32 id, const QString &method,
+                                       const QString &mechanism,
+                                       const QVariantMap &sessionData)
+{
+    m_parent->processOneShot(id, method, mechanism, sessionData,
+                             PeerContext(connection, message),
+                             [connection, message](const QVariantMap &map,
+                                                   const Error &error) {
+        if (!error) {
+            QDBusMessage dbusreply = message.createReply();
+            dbusreply << map;
+            connection.send(dbusreply);
+        } else {
+            connection.send(ErrorAdaptor(error).createReply(message));
+        }
+    });
+}
+
 QStringList SignonDaemonAdaptor::queryMechanisms(const QString &method)
 {
     QStringList mechanisms = m_parent->queryMechanisms(method);
@@ -257,6 +383,8 @@ void SignonDaemonAdaptor::queryIdentities(const QVariantMap &filter,
 {
     Q_UNUSED(applicationContext);
 
+    m_parent->ensureInitialized();
+
     /* Access Control */
     QDBusMessage msg = parentDBusContext().message();
     QDBusConnection conn = parentDBusContext().connection();
@@ -267,15 +395,23 @@ void SignonDaemonAdaptor::queryIdentities(const QVariantMap &filter,
     }
 
     msg.setDelayedReply(true);
-    MapList identities = m_parent->queryIdentities(filter);
-    if (handleLastError(conn, msg)) return;
-
-    QDBusMessage reply = msg.createReply(QVariant::fromValue(identities));
-    conn.send(reply);
+    /* QDBusConnection::send() is thread-safe: the reply is marshalled and
+     * sent by the thread which ran the query */
+    m_parent->queryIdentities(filter,
+                              [conn, msg](const MapList &identities,
+                                          const Error &error) {
+        if (!error) {
+            conn.send(msg.createReply(QVariant::fromValue(identities)));
+        } else {
+            conn.send(ErrorAdaptor(error).createReply(msg));
+        }
+    });
 }
 
 bool SignonDaemonAdaptor::clear()
 {
+    m_parent->ensureInitialized();
+
     /* Access Control */
     QDBusMessage msg = parentDBusContext().message();
     QDBusConnection conn = parentDBusContext().connection();
@@ -54,10 +54,16 @@ public Q_SLOTS:
     void getIdentity(const quint32 id, const QString &applicationContext,
                      QDBusObjectPath &objectPath,
                      QVariantMap &identityData);
+    MapList getIdentities(const QList<quint32> &ids,
+                          const QString &applicationContext);
     QDBusObjectPath getAuthSessionObjectPath(const quint32 id,
                                              const QString &applicationContext,
                                              const QString &type);
 
+    QVariantMap processOneShot(const quint32 id, const QString &method,
+                               const QString &mechanism,
+                               const QVariantMap &sessionData);
+
     QStringList queryMethods();
     QStringList queryMechanisms(const QString &method);
     void queryIdentities(const QVariantMap &filter,
@@ -68,8 +74,15 @@ private:
     void securityErrorReply();
     void securityErrorReply(const QDBusConnection &connection,
                             const QDBusMessage &message);
+    void tooManyRequestsErrorReply(const QDBusConnection &connection,
+                                   const QDBusMessage &message);
     bool handleLastError(const QDBusConnection &connection,
                          const QDBusMessage &message);
+    void startOneShot(const QDBusConnection &connection,
+                      const QDBusMessage &message,
+                      quint32 id, const QString &method,
+                      const QString &mechanism,
+                      const QVariantMap &sessionData);
     template <typename T>
     QDBusObjectPath registerObject(const QDBusConnection &connection,
                                    T *object);
@@ -77,6 +90,7 @@ private:
 private Q_SLOTS:
     void onIdentityAccessReplyFinished();
     void onAuthSessionAccessReplyFinished();
+    void onOneShotAccessReplyFinished();
 
 private:
     SignonDaemon *m_parent;
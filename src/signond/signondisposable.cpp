@@ -23,28 +23,94 @@
 
 #include "signondisposable.h"
 
+#include "idlepolicy.h"
+
+#include <QDateTime>
 #include <QTimer>
 
 namespace SignonDaemonNS {
 
-static QList<SignonDisposable *> disposableObjects;
+/* The disposable objects having the same maximum inactivity, least recently
+ * used first */
+struct ExpiryList {
+    ExpiryList(): head(0), tail(0) {}
+    SignonDisposable *head;
+    SignonDisposable *tail;
+};
+
+static QMap<int, ExpiryList> expiryLists;
+static int disposableCount = 0;
 static QPointer<QTimer> notifyTimer = 0;
 static QPointer<QTimer> disposeTimer = 0;
+static IdlePolicy *idlePolicy = 0;
+
+static bool monotonicTime(time_t *seconds)
+{
+    struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    /* A resolution of one second is all we need */
+    if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) != 0)
+#else
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+#endif
+    {
+        qWarning("Couldn't get time from monotonic clock");
+        return false;
+    }
+    *seconds = ts.tv_sec;
+    return true;
+}
+
+static void startNotifyTimer()
+{
+    TRACE() << "No disposable objects, starting notification timer";
+    if (idlePolicy) {
+        idlePolicy->idleStarted(QDateTime::currentMSecsSinceEpoch());
+        notifyTimer->setInterval(idlePolicy->timeout() * 1000);
+        TRACE() << "Idle timeout:" << notifyTimer->interval() << "ms";
+    }
+    notifyTimer->start();
+}
+
+/* Arms the disposeTimer to fire when the least recently used objects
+ * become inactive */
+static void scheduleDisposal(time_t now)
+{
+    if (disposeTimer == 0) return;
+
+    time_t firstExpiry = 0;
+    bool found = false;
+    QMap<int, ExpiryList>::const_iterator i;
+    for (i = expiryLists.constBegin(); i != expiryLists.constEnd(); i++) {
+        if (!i.value().head) continue;
+        time_t expiry = i.value().head->lastActivity + i.key();
+        if (!found || expiry < firstExpiry) {
+            firstExpiry = expiry;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        disposeTimer->stop();
+        return;
+    }
+
+    // Add a couple of seconds, to run the check after the objects are inactive
+    time_t delay = qMax(firstExpiry - now, time_t(0)) + 2;
+    disposeTimer->start(int(delay) * 1000);
+}
 
 SignonDisposable::SignonDisposable(int maxInactivity, QObject *parent):
     QObject(parent),
     maxInactivity(maxInactivity),
-    autoDestruct(true)
+    lastActivity(0),
+    autoDestruct(true),
+    expiryList(&expiryLists[maxInactivity]),
+    previous(0),
+    next(0)
 {
-    disposableObjects.append(this);
-
-    if (disposeTimer != 0) {
-        int interval = (maxInactivity + 2) * 1000;
-        if (interval > disposeTimer->interval())
-            disposeTimer->setInterval(interval);
-        QObject::connect(disposeTimer, SIGNAL(timeout()),
-                         this, SLOT(destroyUnused()));
-    }
+    disposableCount++;
 
     // mark as used
     keepInUse();
@@ -52,30 +118,70 @@ SignonDisposable::SignonDisposable(int maxInactivity, QObject *parent):
 
 SignonDisposable::~SignonDisposable()
 {
-    disposableObjects.removeOne(this);
+    unlink();
+    disposableCount--;
+
+    if (disposableCount == 0 && notifyTimer != 0) {
+        startNotifyTimer();
+    }
 }
 
-void SignonDisposable::keepInUse() const
+void SignonDisposable::link() const
 {
-    struct timespec ts;
+    SignonDisposable *self = const_cast<SignonDisposable *>(this);
+    previous = expiryList->tail;
+    next = 0;
+    if (expiryList->tail)
+        expiryList->tail->next = self;
+    else
+        expiryList->head = self;
+    expiryList->tail = self;
+}
 
-    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
-        qWarning("Couldn't get time from monotonic clock");
+void SignonDisposable::unlink() const
+{
+    if (expiryList->head != this && previous == 0) return; // not linked
+
+    if (previous)
+        previous->next = next;
+    else
+        expiryList->head = next;
+    if (next)
+        next->previous = previous;
+    else
+        expiryList->tail = previous;
+    previous = next = 0;
+}
+
+void SignonDisposable::keepInUse() const
+{
+    if (!monotonicTime(&lastActivity))
         return;
+
+    /* Move the object to the end of its list */
+    if (autoDestruct && expiryList->tail != this) {
+        unlink();
+        link();
     }
-    lastActivity = ts.tv_sec;
 
-    if (notifyTimer != 0) {
+    if (notifyTimer != 0 && notifyTimer->isActive()) {
         notifyTimer->stop();
+        if (idlePolicy)
+            idlePolicy->idleEnded(QDateTime::currentMSecsSinceEpoch());
     }
-    if (disposeTimer != 0) {
-        disposeTimer->start();
+    /* The timer can only be early, never late: any changes in the activity
+     * make the objects expire later */
+    if (disposeTimer != 0 && !disposeTimer->isActive()) {
+        scheduleDisposal(lastActivity);
     }
 }
 
 void SignonDisposable::setAutoDestruct(bool value) const
 {
-    autoDestruct = value;
+    if (value != autoDestruct) {
+        autoDestruct = value;
+        if (!value) unlink();
+    }
     keepInUse();
 }
 
@@ -90,44 +196,46 @@ void SignonDisposable::invokeOnIdle(int maxInactivity,
 
     /* In addition to the notifyTimer, we create another timer to let
      * destroyUnused() to run when we expect that some SignonDisposable object
-     * might be inactive: that is, a couple of seconds later than the maximum
-     * inactivity interval. This timer is triggered by the keepInUse() method.
+     * might be inactive. This timer is armed by the keepInUse() method.
      */
     disposeTimer = new QTimer(object);
     disposeTimer->setSingleShot(true);
-    int disposableMaxInactivity = 0;
-    foreach (SignonDisposable *disposable, disposableObjects) {
-        QObject::connect(disposeTimer, SIGNAL(timeout()),
-                         disposable, SLOT(destroyUnused()));
-        if (disposableMaxInactivity < disposable->maxInactivity)
-            disposableMaxInactivity = disposable->maxInactivity;
-    }
+    QObject::connect(disposeTimer, &QTimer::timeout,
+                     &SignonDisposable::destroyUnused);
 
-    // Add a couple of seconds, to run the check after the objects are inactive
-    disposeTimer->setInterval((disposableMaxInactivity + 2) * 1000);
+    time_t now;
+    if (monotonicTime(&now))
+        scheduleDisposal(now);
 }
 
-void SignonDisposable::destroyUnused()
+void SignonDisposable::setIdlePolicy(IdlePolicy *policy)
 {
-    struct timespec ts;
+    idlePolicy = policy;
+}
 
-    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
-        qWarning("Couldn't get time from monotonic clock");
+void SignonDisposable::destroyUnused()
+{
+    time_t now;
+    if (!monotonicTime(&now))
         return;
-    }
 
-    foreach (SignonDisposable *object, disposableObjects) {
-        if (object->autoDestruct &&
-            (ts.tv_sec - object->lastActivity > object->maxInactivity)) {
+    QMap<int, ExpiryList>::iterator i;
+    for (i = expiryLists.begin(); i != expiryLists.end(); i++) {
+        ExpiryList &list = i.value();
+        /* destroy() might mark the object as used again, moving it to the
+         * end of the list */
+        while (list.head && now - list.head->lastActivity > i.key()) {
+            SignonDisposable *object = list.head;
+            object->unlink();
             TRACE() << "Object unused, deleting: " << object;
             object->destroy();
-            disposableObjects.removeOne(object);
         }
     }
 
-    if (disposableObjects.isEmpty() && notifyTimer != 0) {
-        TRACE() << "No disposable objects, starting notification timer";
-        notifyTimer->start();
+    scheduleDisposal(now);
+
+    if (disposableCount == 0 && notifyTimer != 0) {
+        startNotifyTimer();
     }
 }
 
@@ -31,11 +31,19 @@
 
 namespace SignonDaemonNS {
 
+class IdlePolicy;
+struct ExpiryList;
+
 /*!
  * @class SignonDisposable
  *
  * Base class for server objects that can be automatically destroyed after
  * a certain period of inactivity.
+ *
+ * The objects having the same maximum inactivity are kept in a list sorted
+ * by their last activity, so that marking an object as used only needs to
+ * move it to the end of its list, and finding the unused objects only needs
+ * to look at the beginning of each list.
  */
 class SignonDisposable: public QObject
 {
@@ -84,6 +92,12 @@ public:
     static void invokeOnIdle(int maxInactivity,
                              QObject *object, const char *member);
 
+    /*!
+     * Let @policy decide the inactivity time after which the method set with
+     * invokeOnIdle() is invoked, and inform it of the idle periods.
+     */
+    static void setIdlePolicy(IdlePolicy *policy);
+
 public Q_SLOTS:
     /*!
      * Deletes all disposable object for which the inactivity time has
@@ -92,9 +106,17 @@ public Q_SLOTS:
     static void destroyUnused();
 
 private:
+    void link() const;
+    void unlink() const;
+
     int maxInactivity;
     mutable time_t lastActivity;
     mutable bool autoDestruct;
+    /* Position in the expiry list; only objects which can be destroyed
+     * automatically are in the list */
+    ExpiryList *expiryList;
+    mutable SignonDisposable *previous;
+    mutable SignonDisposable *next;
 }; //class SignonDaemon
 
 } //namespace SignonDaemonNS
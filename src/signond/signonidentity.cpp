@@ -33,6 +33,9 @@
 #include "signoncommon.h"
 
 #include "accesscontrolmanagerhelper.h"
+#include "peercache.h"
+#include "resultcache.h"
+#include "signonsessioncore.h"
 
 #include <QDBusPendingCallWatcher>
 #include <QDBusPendingReply>
@@ -322,6 +325,9 @@ void SignonIdentity::remove(const RemoveCb &callback)
     SIGNON_RETURN_IF_CAM_NOT_AVAILABLE_ASYNC0();
 
     CredentialsDB *db = CredentialsAccessManager::instance()->credentialsDB();
+    ResultCache::instance()->invalidate(m_id);
+    PeerCache::instance()->invalidateAccess(m_id);
+    SignonSessionCore::identityChanged(m_id);
     if ((db == 0) || !db->removeCredentials(m_id)) {
         TRACE() << "Error occurred while inserting/updating credentials.";
         callback(Error(Error::RemoveFailed,
@@ -375,6 +381,8 @@ void SignonIdentity::signOut(const SignOutCb &callback)
         if ((db == 0) || !db->removeData(m_id)) {
             TRACE() << "clear data failed";
         }
+        ResultCache::instance()->invalidate(m_id);
+        SignonSessionCore::identityChanged(m_id);
 
         setAutoDestruct(false);
         QDBusPendingCallWatcher *watcher =
@@ -477,6 +485,8 @@ quint32 SignonIdentity::storeCredentials(const SignonIdentityInfo &info)
             delete m_pInfo;
             m_pInfo = NULL;
         }
+        ResultCache::instance()->invalidate(m_id);
+        PeerCache::instance()->invalidateAccess(m_id);
         Q_EMIT stored(this);
 
         TRACE() << "FRESH, JUST STORED CREDENTIALS ID:" << m_id;
@@ -40,7 +40,7 @@ SignonIdentityAdaptor::SignonIdentityAdaptor(SignonIdentity *parent):
     QObject::connect(parent, &SignonIdentity::unregistered,
                      this, [this]() {
         Q_EMIT unregistered();
-        // Destroying the adaptor also triggers unregisterObject()
+        // Destroying the adaptor unregisters it from all the connections
         delete this;
     });
 }
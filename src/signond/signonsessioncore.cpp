@@ -30,11 +30,16 @@
 #include "signonidentity.h"
 #include "signonui_interface.h"
 #include "accesscontrolmanagerhelper.h"
+#include "requestscheduler.h"
+#include "resultcache.h"
+#include "sessionindex.h"
 
 #include "SignOn/uisessiondata_priv.h"
 #include "SignOn/authpluginif.h"
 #include "SignOn/signonerror.h"
 
+#include <climits>
+
 #define MAX_IDLE_TIME SIGNOND_MAX_IDLE_TIME
 /*
  * the watchdog searches for idle sessions with period of half of idle timeout
@@ -44,33 +49,54 @@
 #define SSO_KEY_USERNAME QLatin1String("UserName")
 #define SSO_KEY_PASSWORD QLatin1String("Secret")
 #define SSO_KEY_CAPTION QLatin1String("Caption")
+#define SSO_KEY_TIMEOUT QLatin1String("Timeout")
+
+/* Time given to a plugin to reply to the cancellation of a request which
+ * timed out, before its process gets replaced */
+#define PLUGIN_ABORT_TIMEOUT 3000
 
 using namespace SignonDaemonNS;
 
 /*
- * cache of session queues, as was mentined they cannot be static
+ * cache of session queues, including the "zero" authsessions (needed for
+ * global signout)
  * */
-QMap<QString, SignonSessionCore *> sessionsOfStoredCredentials;
+static SessionIndex sessionIndex;
+
 /*
- * List of "zero" authsessions, needed for global signout
+ * Limits to the requests queued in the sessions (0 = no limit), and size of
+ * the parameters of all the queued requests
  * */
-QList<SignonSessionCore *> sessionsOfNonStoredCredentials;
+static int maxQueueLength = 0;
+static qint64 maxQueuedBytes = 0;
+static qint64 totalQueuedBytes = 0;
+
+static inline bool isEmptyValue(const QVariant &value)
+{
+    return value.isNull() || !value.isValid();
+}
 
 static QVariantMap filterVariantMap(const QVariantMap &other)
 {
-    QVariantMap result;
+    /* Only copy the map if some values must be dropped */
+    QVariantMap::const_iterator it = other.constBegin();
+    while (it != other.constEnd() && !isEmptyValue(it.value())) it++;
+    if (it == other.constEnd()) return other;
 
-    foreach(QString key, other.keys()) {
-        if (!other.value(key).isNull() && other.value(key).isValid())
-            result.insert(key, other.value(key));
+    QVariantMap result;
+    for (it = other.constBegin(); it != other.constEnd(); it++) {
+        if (!isEmptyValue(it.value()))
+            result.insert(it.key(), it.value());
     }
 
     return result;
 }
 
-static QString sessionName(const quint32 id, const QString &method)
+static QStringList accessControlTokens(const SignonIdentityInfo &info,
+                                       const PeerContext &peerContext)
 {
-   return QString::number(id) + QLatin1String("+") + method;
+    AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
+    return acm->allowedContexts(peerContext, info.accessControlList());
 }
 
 SignonSessionCore::SignonSessionCore(quint32 id,
@@ -80,23 +106,44 @@ SignonSessionCore::SignonSessionCore(quint32 id,
     SignonDisposable(timeout, parent),
     m_signonui(0),
     m_watcher(0),
-    m_requestIsActive(false),
-    m_canceled(false),
+    m_activeRequests(0),
+    m_waitingForScheduler(false),
     m_id(id),
     m_method(method),
+    m_methodId(0),
+    m_identityDataLoaded(false),
+    m_isStoringCredentials(false),
     m_queryCredsUiDisplayed(false)
 {
     m_signonui = new SignonUiInterface(SIGNON_UI_SERVICE,
                                        SIGNON_UI_DAEMON_OBJECTPATH,
                                        QDBusConnection::sessionBus());
 
+    m_deadlineTimer.setSingleShot(true);
+    connect(&m_deadlineTimer, SIGNAL(timeout()), SLOT(checkDeadlines()));
+    m_abortTimer.setSingleShot(true);
+    m_abortTimer.setInterval(PLUGIN_ABORT_TIMEOUT);
+    connect(&m_abortTimer, SIGNAL(timeout()), SLOT(onAbortTimeout()));
+
     connect(CredentialsAccessManager::instance(),
             SIGNAL(credentialsSystemReady()),
             SLOT(credentialsSystemReady()));
+
+    /* Watch for updates of the identity happening outside of this object */
+    CredentialsDB *db = CredentialsAccessManager::instance()->credentialsDB();
+    if (db) {
+        connect(db, SIGNAL(credentialsUpdated(quint32)),
+                SLOT(onCredentialsUpdated(quint32)));
+    }
 }
 
 SignonSessionCore::~SignonSessionCore()
 {
+    RequestScheduler::instance()->withdraw(this);
+
+    foreach (const RequestData &request, m_listOfRequests)
+        totalQueuedBytes -= request.m_size;
+
     delete m_plugin;
     delete m_watcher;
     delete m_signonui;
@@ -110,12 +157,10 @@ SignonSessionCore *SignonSessionCore::sessionCore(const quint32 id,
                                                   const QString &method,
                                                   SignonDaemon *parent)
 {
-    QString key = sessionName(id, method);
-
     if (id) {
-        if (sessionsOfStoredCredentials.contains(key)) {
-            return sessionsOfStoredCredentials.value(key);
-        }
+        SignonSessionCore *core =
+            sessionIndex.find(id, sessionIndex.methodId(method));
+        if (core) return core;
     }
 
     SignonSessionCore *ssc = new SignonSessionCore(id, method,
@@ -128,15 +173,46 @@ SignonSessionCore *SignonSessionCore::sessionCore(const quint32 id,
         return NULL;
     }
 
-    if (id)
-        sessionsOfStoredCredentials.insert(key, ssc);
-    else
-        sessionsOfNonStoredCredentials.append(ssc);
+    /* Only register the methods of existing plugins */
+    ssc->m_methodId = sessionIndex.registerMethod(method);
+    sessionIndex.insert(id, ssc->m_methodId, ssc);
 
-    TRACE() << "The new session is created :" << key;
+    TRACE() << "The new session is created :" << id << method;
     return ssc;
 }
 
+void SignonSessionCore::setQueueLimits(uint maxLength, qint64 maxBytes)
+{
+    maxQueueLength = maxLength;
+    maxQueuedBytes = maxBytes;
+}
+
+/* Serializing the session data is expensive: only do it when the size is
+ * going to be checked */
+static qint64 requestSize(const QVariantMap &params)
+{
+    return maxQueuedBytes > 0 ? variantMapSize(params) : 0;
+}
+
+qint64 SignonSessionCore::queuedBytes()
+{
+    return totalQueuedBytes;
+}
+
+int SignonSessionCore::queueLength() const
+{
+    keepInUse();
+    return m_listOfRequests.count();
+}
+
+void SignonSessionCore::identityChanged(quint32 id)
+{
+    foreach (SignonSessionCore *core, sessionIndex.storedSessions()) {
+        if (id == SIGNOND_NEW_IDENTITY || core->m_id == id)
+            core->resetIdentityData();
+    }
+}
+
 quint32 SignonSessionCore::id() const
 {
     TRACE();
@@ -201,11 +277,7 @@ bool SignonSessionCore::setupPlugin()
 
 void SignonSessionCore::stopAllAuthSessions()
 {
-    qDeleteAll(sessionsOfStoredCredentials);
-    sessionsOfStoredCredentials.clear();
-
-    qDeleteAll(sessionsOfNonStoredCredentials);
-    sessionsOfNonStoredCredentials.clear();
+    qDeleteAll(sessionIndex.takeAll());
 }
 
 QStringList
@@ -227,11 +299,51 @@ void SignonSessionCore::process(const PeerContext &peerContext,
                                 const ProcessCb &callback)
 {
     keepInUse();
-    m_listOfRequests.enqueue(RequestData(peerContext,
-                                         sessionDataVa,
-                                         mechanism,
-                                         cancelKey,
-                                         callback));
+
+    ResultCache *cache = ResultCache::instance();
+    if (m_id != SIGNOND_NEW_IDENTITY && cache->isEnabled(m_method) &&
+        CredentialsAccessManager::instance()->isCredentialsSystemReady()) {
+        QVariantMap result;
+        if (cache->lookup(m_id, m_method, mechanism,
+                          resultCacheKey(peerContext, sessionDataVa),
+                          result)) {
+            QTimer::singleShot(0, this, [callback, result]() {
+                callback(result, Error::NoError);
+            });
+            return;
+        }
+    }
+
+    RequestData request(peerContext,
+                        sessionDataVa,
+                        mechanism,
+                        cancelKey,
+                        callback);
+    request.m_timeout = sessionDataVa.value(SSO_KEY_TIMEOUT).toLongLong();
+    if (coalesceRequest(request))
+        return;
+
+    /* Reject the request early if the queues are full, so that the client
+     * can back off */
+    request.m_size = requestSize(sessionDataVa);
+    int length = m_listOfRequests.count();
+    if ((maxQueueLength > 0 && length >= maxQueueLength) ||
+        (maxQueuedBytes > 0 &&
+         totalQueuedBytes + request.m_size > maxQueuedBytes)) {
+        BLAME() << "Request rejected; queue length:" << length <<
+            "queued bytes:" << totalQueuedBytes;
+        Error error(Error::TooManyRequests,
+                    QString::fromLatin1("Too many queued requests (%1 in "
+                                        "this session)").arg(length));
+        QTimer::singleShot(0, this, [callback, error]() {
+            callback(QVariantMap(), error);
+        });
+        return;
+    }
+
+    insertRequest(length, request);
+    if (request.m_timeout > 0)
+        updateDeadlineTimer();
 
     if (CredentialsAccessManager::instance()->isCredentialsSystemReady())
         QMetaObject::invokeMethod(this, "startNewRequest", Qt::QueuedConnection);
@@ -241,6 +353,18 @@ void SignonSessionCore::cancel(const QString &cancelKey)
 {
     TRACE();
 
+    /* Requests served by another one are just detached from it */
+    for (int i = 0; i < m_listOfRequests.size(); i++) {
+        QList<CoalescedRequest> &coalesced = m_listOfRequests[i].m_coalesced;
+        for (int j = 0; j < coalesced.size(); j++) {
+            if (coalesced.at(j).m_cancelKey == cancelKey) {
+                CoalescedRequest canceled = coalesced.takeAt(j);
+                canceled.m_callback(QVariantMap(), Error::SessionCanceled);
+                return;
+            }
+        }
+    }
+
     int requestIndex;
     for (requestIndex = 0;
          requestIndex < m_listOfRequests.size();
@@ -254,15 +378,54 @@ void SignonSessionCore::cancel(const QString &cancelKey)
     if (requestIndex < m_listOfRequests.size()) {
         /* If the request being cancelled is active, we need to keep
          * in the queue until the plugin has replied. */
-        bool isActive = (requestIndex == 0) && m_requestIsActive;
+        bool isActive = requestIndex < m_activeRequests;
+        RequestData &request = m_listOfRequests[requestIndex];
+        if (!request.m_coalesced.isEmpty()) {
+            bool hasUi = requestIndex == 0 && isActive &&
+                (m_watcher != 0 || m_queryCredsUiDisplayed);
+            CoalescedRequest next = request.m_coalesced.takeFirst();
+            if (!hasUi) {
+                /* Let the next client take over the request */
+                TRACE() << "Request handed over to" << next.m_cancelKey;
+                CoalescedRequest canceled(request.m_peerContext,
+                                          request.m_cancelKey,
+                                          request.m_callback);
+                request.m_peerContext = next.m_peerContext;
+                request.m_cancelKey = next.m_cancelKey;
+                request.m_callback = next.m_callback;
+                canceled.m_callback(QVariantMap(), Error::SessionCanceled);
+                return;
+            }
+
+            /* The user is interacting on behalf of the canceling client:
+             * the other clients need a request of their own */
+            RequestData retry(next.m_peerContext, request.m_clientData,
+                              request.m_mechanism, next.m_cancelKey,
+                              next.m_callback);
+            retry.m_size = requestSize(retry.m_params);
+            /* The deadline of the original request still applies */
+            retry.m_timeout = request.m_timeout;
+            retry.m_queuedTime = request.m_queuedTime;
+            retry.m_coalesced = request.m_coalesced;
+            request.m_coalesced.clear();
+            insertRequest(m_activeRequests, retry);
+            if (retry.m_timeout > 0)
+                updateDeadlineTimer();
+        }
+
         if (isActive) {
-            m_canceled = true;
-            m_plugin->cancel();
+            m_listOfRequests[requestIndex].m_canceled = true;
 
-            if (m_watcher && !m_watcher->isFinished()) {
-                m_signonui->cancelUiRequest(cancelKey);
-                delete m_watcher;
-                m_watcher = 0;
+            /* Only the oldest request can be canceled in the plugin; the
+             * others will just have their reply ignored */
+            if (requestIndex == 0) {
+                m_plugin->cancel();
+
+                if (m_watcher && !m_watcher->isFinished()) {
+                    m_signonui->cancelUiRequest(cancelKey);
+                    delete m_watcher;
+                    m_watcher = 0;
+                }
             }
         }
 
@@ -273,8 +436,8 @@ void SignonSessionCore::cancel(const QString &cancelKey)
          * resultSlot or via errorSlot.
          * */
         RequestData rd(isActive ?
-                       m_listOfRequests.head() :
-                       m_listOfRequests.takeAt(requestIndex));
+                       m_listOfRequests.at(requestIndex) :
+                       takeRequest(requestIndex));
         rd.m_callback(QVariantMap(), Error::SessionCanceled);
         TRACE() << "Size of the queue is" << m_listOfRequests.size();
     }
@@ -287,44 +450,80 @@ void SignonSessionCore::setId(quint32 id)
     if (m_id == id)
         return;
 
-    QString key;
-
-    if (id == 0) {
-        key = sessionName(m_id, m_method);
-        sessionsOfNonStoredCredentials.append(
-                                        sessionsOfStoredCredentials.take(key));
-    } else {
-        key = sessionName(id, m_method);
-        if (sessionsOfStoredCredentials.contains(key)) {
-            qCritical() << "attempt to assign existing id";
-            return;
-        }
-
-        sessionsOfNonStoredCredentials.removeOne(this);
-        sessionsOfStoredCredentials[key] = this;
+    if (id != 0 && sessionIndex.find(id, m_methodId)) {
+        qCritical() << "attempt to assign existing id";
+        return;
     }
+
+    sessionIndex.remove(m_id, m_methodId, this);
+    sessionIndex.insert(id, m_methodId, this);
     m_id = id;
+    resetIdentityData();
 }
 
-void SignonSessionCore::startProcess()
+void SignonSessionCore::loadIdentityData()
+{
+    if (m_id == SIGNOND_NEW_IDENTITY || m_identityDataLoaded)
+        return;
+
+    CredentialsAccessManager *cam = CredentialsAccessManager::instance();
+    CredentialsDB *db = cam->credentialsDB();
+    if (!cam->isCredentialsSystemReady() || db == 0)
+        return;
+
+    TRACE() << "Loading data of identity" << m_id;
+    m_identityInfo = db->credentials(m_id);
+    m_storedParams = db->loadData(m_id, m_method);
+    /* Don't keep failures, the next request will try again */
+    m_identityDataLoaded = m_identityInfo.id() != SIGNOND_NEW_IDENTITY;
+}
+
+void SignonSessionCore::onCredentialsUpdated(quint32 id)
+{
+    /* Our own writes are applied to the loaded data directly */
+    if (id == m_id && !m_isStoringCredentials)
+        resetIdentityData();
+}
+
+void SignonSessionCore::resetIdentityData()
+{
+    /* The data is read again when the next request needs it */
+    m_identityDataLoaded = false;
+    m_identityInfo = SignonIdentityInfo();
+    m_storedParams.clear();
+}
+
+SignonIdentityInfo SignonSessionCore::identityInfo()
+{
+    loadIdentityData();
+    return m_identityInfo;
+}
+
+QVariantMap SignonSessionCore::storedParams()
+{
+    loadIdentityData();
+    return m_storedParams;
+}
+
+bool SignonSessionCore::startProcess()
 {
 
     TRACE() << "the number of requests is" << m_listOfRequests.length();
 
-    m_requestIsActive = true;
-    RequestData data = m_listOfRequests.head();
+    int index = m_activeRequests++;
+    RequestData &data = m_listOfRequests[index];
+    /* The parameters share the client data until they get modified, which
+     * happens at most once */
     QVariantMap parameters = data.m_params;
 
     /* save the client data; this should not be modified during the processing
      * of this request */
-    m_clientData = parameters;
+    data.m_clientData = parameters;
 
     if (m_id) {
-        CredentialsDB *db =
-            CredentialsAccessManager::instance()->credentialsDB();
-        Q_ASSERT(db != 0);
-
-        SignonIdentityInfo info = db->credentials(m_id);
+        /* The identity data has normally been read already, when the
+         * session was created */
+        SignonIdentityInfo info = identityInfo();
         if (info.id() != SIGNOND_NEW_IDENTITY) {
             if (!parameters.contains(SSO_KEY_PASSWORD)) {
                 parameters[SSO_KEY_PASSWORD] = info.password();
@@ -335,14 +534,8 @@ void SignonSessionCore::startProcess()
                 parameters[SSO_KEY_USERNAME] = info.userName();
             }
 
-            QStringList paramsTokenList;
-            QStringList identityAclList = info.accessControlList();
-
-            foreach(QString acl, identityAclList) {
-                if (AccessControlManagerHelper::instance()->
-                    isPeerAllowedToAccess(data.m_peerContext, acl))
-                    paramsTokenList.append(acl);
-            }
+            QStringList paramsTokenList =
+                accessControlTokens(info, data.m_peerContext);
 
             if (!paramsTokenList.isEmpty()) {
                 parameters[SSO_ACCESS_CONTROL_TOKENS] = paramsTokenList;
@@ -352,28 +545,99 @@ void SignonSessionCore::startProcess()
                 "database.";
         }
 
-        QVariantMap storedParams = db->loadData(m_id, m_method);
-
         //parameters will overwrite any common keys on stored params
-        parameters = mergeVariantMaps(storedParams, parameters);
+        addMissingKeys(parameters, storedParams());
     }
 
-    if (parameters.contains(SSOUI_KEY_UIPOLICY)
-        && parameters[SSOUI_KEY_UIPOLICY] == RequestPasswordPolicy) {
+    if (parameters.value(SSOUI_KEY_UIPOLICY) == RequestPasswordPolicy) {
         parameters.remove(SSO_KEY_PASSWORD);
     }
 
     /* Temporary caching, if credentials are valid
      * this data will be effectively cached */
-    m_tmpUsername = parameters[SSO_KEY_USERNAME].toString();
-    m_tmpPassword = parameters[SSO_KEY_PASSWORD].toString();
+    data.m_tmpUsername = parameters.value(SSO_KEY_USERNAME).toString();
+    data.m_tmpPassword = parameters.value(SSO_KEY_PASSWORD).toString();
 
     if (!m_plugin->process(parameters, data.m_mechanism)) {
-        data.m_callback(QVariantMap(), Error::RuntimeError);
-        requestDone();
-    } else
-        stateChangedSlot(SignOn::SessionStarted,
-                         QLatin1String("The request is started successfully"));
+        RequestData failed = takeRequest(index);
+        m_activeRequests--;
+        RequestScheduler::instance()->release(this);
+        failed.m_callback(QVariantMap(), Error::RuntimeError);
+        foreach (const CoalescedRequest &coalesced, failed.m_coalesced)
+            coalesced.m_callback(QVariantMap(), Error::RuntimeError);
+        return false;
+    }
+
+    emit stateChanged(data.m_cancelKey, SignOn::SessionStarted,
+                      QLatin1String("The request is started successfully"));
+    foreach (const CoalescedRequest &coalesced, data.m_coalesced) {
+        emit stateChanged(coalesced.m_cancelKey, SignOn::SessionStarted,
+                          QLatin1String("The request is started successfully"));
+    }
+    keepInUse();
+    return true;
+}
+
+QVariantMap SignonSessionCore::resultCacheKey(const PeerContext &peerContext,
+                                              const QVariantMap &params)
+{
+    /* The result depends on the access control tokens given to the plugin */
+    QVariantMap key = params;
+    key[SSO_ACCESS_CONTROL_TOKENS] = accessControlTokens(identityInfo(),
+                                                         peerContext);
+    return key;
+}
+
+bool SignonSessionCore::coalesceRequest(const RequestData &request)
+{
+    /* Only requests on stored identities can share the plugin invocation;
+     * requests explicitly asking for the user's password cannot. */
+    if (m_id == SIGNOND_NEW_IDENTITY) return false;
+    if (request.m_params.value(SSOUI_KEY_UIPOLICY) == RequestPasswordPolicy)
+        return false;
+
+    CredentialsAccessManager *cam = CredentialsAccessManager::instance();
+    if (!cam->isCredentialsSystemReady()) return false;
+
+    SignonIdentityInfo info;
+    QStringList tokens;
+    bool tokensComputed = false;
+
+    for (int i = 0; i < m_listOfRequests.size(); i++) {
+        RequestData &other = m_listOfRequests[i];
+        if (other.m_canceled || other.m_mechanism != request.m_mechanism)
+            continue;
+
+        /* The parameters of a started request might have been replaced by
+         * the results of a UI interaction */
+        const QVariantMap &otherParams = i < m_activeRequests ?
+            other.m_clientData : other.m_params;
+        if (otherParams != request.m_params) continue;
+
+        /* The plugin receives the access control tokens of the peer: the
+         * result can be shared only if they are the same */
+        if (!tokensComputed) {
+            info = identityInfo();
+            tokens = accessControlTokens(info, request.m_peerContext);
+            tokensComputed = true;
+        }
+        if (accessControlTokens(info, other.m_peerContext) != tokens)
+            continue;
+
+        TRACE() << "Request" << request.m_cancelKey <<
+            "coalesced with" << other.m_cancelKey;
+        other.m_coalesced.append(CoalescedRequest(request.m_peerContext,
+                                                  request.m_cancelKey,
+                                                  request.m_callback));
+        if (i < m_activeRequests) {
+            emit stateChanged(request.m_cancelKey, SignOn::SessionStarted,
+                              QLatin1String("The request is started "
+                                            "successfully"));
+        }
+        return true;
+    }
+
+    return false;
 }
 
 void SignonSessionCore::replyError(const RequestData &request,
@@ -445,6 +709,8 @@ void SignonSessionCore::replyError(const RequestData &request,
 
     Error error(code, errMessage);
     request.m_callback(QVariantMap(), error);
+    foreach (const CoalescedRequest &coalesced, request.m_coalesced)
+        coalesced.m_callback(QVariantMap(), error);
 }
 
 void SignonSessionCore::processStoreOperation(const StoreOperation &operation)
@@ -454,8 +720,14 @@ void SignonSessionCore::processStoreOperation(const StoreOperation &operation)
     Q_ASSERT(db != 0);
 
     if (operation.m_storeType != StoreOperation::Blob) {
-        if (!(db->updateCredentials(operation.m_info))) {
+        m_isStoringCredentials = true;
+        bool ok = db->updateCredentials(operation.m_info);
+        m_isStoringCredentials = false;
+        if (!ok) {
             BLAME() << "Error occurred while updating credentials.";
+            resetIdentityData();
+        } else if (m_identityDataLoaded) {
+            m_identityInfo = operation.m_info;
         }
     } else {
         TRACE() << "Processing --- StoreOperation::Blob";
@@ -464,29 +736,149 @@ void SignonSessionCore::processStoreOperation(const StoreOperation &operation)
                            operation.m_authMethod,
                            operation.m_blobData)) {
             BLAME() << "Error occurred while storing data.";
+            resetIdentityData();
+        } else if (m_identityDataLoaded) {
+            /* The stored data replaces the previous one */
+            m_storedParams = operation.m_blobData;
         }
     }
 }
 
+void SignonSessionCore::insertRequest(int index, const RequestData &request)
+{
+    totalQueuedBytes += request.m_size;
+    m_listOfRequests.insert(index, request);
+}
+
+RequestData SignonSessionCore::takeRequest(int index)
+{
+    RequestData request = m_listOfRequests.takeAt(index);
+    totalQueuedBytes -= request.m_size;
+    return request;
+}
+
 void SignonSessionCore::requestDone()
 {
-    m_listOfRequests.removeFirst();
-    m_requestIsActive = false;
+    /* Only requests which have been sent to the plugin can be done */
+    if (m_activeRequests <= 0) {
+        BLAME() << "No active request";
+        return;
+    }
+
+    takeRequest(0);
+    m_activeRequests--;
+    RequestScheduler::instance()->release(this);
+    m_abortTimer.stop();
+
+    /* A pipelined request which timed out can only now be canceled in the
+     * plugin */
+    if (m_activeRequests > 0 && m_listOfRequests.head().m_timedOut) {
+        m_plugin->cancel();
+        m_abortTimer.start();
+    }
+
+    updateDeadlineTimer();
     QMetaObject::invokeMethod(this, "startNewRequest", Qt::QueuedConnection);
 }
 
+void SignonSessionCore::expireRequest(int index)
+{
+    bool isActive = index < m_activeRequests;
+    RequestData rd(isActive ?
+                   m_listOfRequests.at(index) :
+                   takeRequest(index));
+    TRACE() << "Request" << rd.m_cancelKey << "timed out";
+
+    if (isActive) {
+        /* Keep the request in the queue until the plugin replies, like
+         * for canceled requests */
+        RequestData &request = m_listOfRequests[index];
+        request.m_canceled = true;
+        request.m_timedOut = true;
+        request.m_coalesced.clear();
+
+        if (index == 0) {
+            if (m_watcher && !m_watcher->isFinished()) {
+                m_signonui->cancelUiRequest(rd.m_cancelKey);
+                delete m_watcher;
+                m_watcher = 0;
+            }
+            m_plugin->cancel();
+            m_abortTimer.start();
+        }
+    }
+
+    Error error(Error::TimedOut,
+                QString::fromLatin1("Request not completed within %1 ms")
+                .arg(rd.m_timeout));
+    rd.m_callback(QVariantMap(), error);
+    foreach (const CoalescedRequest &coalesced, rd.m_coalesced)
+        coalesced.m_callback(QVariantMap(), error);
+}
+
+void SignonSessionCore::updateDeadlineTimer()
+{
+    qint64 next = -1;
+    foreach (const RequestData &request, m_listOfRequests) {
+        if (request.m_timeout <= 0 || request.m_timedOut) continue;
+        qint64 remaining = request.m_timeout - request.m_queuedTime.elapsed();
+        if (next < 0 || remaining < next)
+            next = qMax(remaining, qint64(0));
+    }
+
+    if (next < 0)
+        m_deadlineTimer.stop();
+    else
+        m_deadlineTimer.start(int(qMin(next, qint64(INT_MAX))));
+}
+
+void SignonSessionCore::checkDeadlines()
+{
+    keepInUse();
+
+    /* Go backwards, since inactive requests are removed from the queue */
+    for (int i = m_listOfRequests.count() - 1; i >= 0; i--) {
+        const RequestData &request = m_listOfRequests.at(i);
+        if (request.m_timeout <= 0 || request.m_timedOut) continue;
+        if (request.m_queuedTime.hasExpired(request.m_timeout))
+            expireRequest(i);
+    }
+
+    updateDeadlineTimer();
+}
+
+void SignonSessionCore::onAbortTimeout()
+{
+    if (m_activeRequests == 0 || !m_listOfRequests.head().m_timedOut)
+        return;
+
+    /* The plugin errors on all its pending requests, which will unblock the
+     * queue */
+    BLAME() << "Plugin did not reply to the cancellation of a request";
+    m_plugin->abort();
+
+    /* If the plugin could not be aborted, don't wait for its replies any
+     * longer: the clients have been answered already */
+    while (m_activeRequests > 0 && m_listOfRequests.head().m_timedOut) {
+        BLAME() << "Dropping timed out request" <<
+            m_listOfRequests.head().m_cancelKey;
+        requestDone();
+    }
+}
+
 void SignonSessionCore::processResultReply(const QVariantMap &data)
 {
     TRACE();
 
     keepInUse();
 
-    if (m_listOfRequests.isEmpty())
+    /* Replies can only refer to requests sent to the plugin */
+    if (m_activeRequests <= 0)
         return;
 
     RequestData rd = m_listOfRequests.head();
 
-    if (!m_canceled) {
+    if (!rd.m_canceled) {
         QVariantMap filteredData = filterVariantMap(data);
 
         CredentialsAccessManager *camManager =
@@ -501,11 +893,11 @@ void SignonSessionCore::processResultReply(const QVariantMap &data)
 
             /* update username and password from ui interaction; do not allow
              * updating the username if the identity is validated */
-            if (!info.validated() && !m_tmpUsername.isEmpty()) {
-                info.setUserName(m_tmpUsername);
+            if (!info.validated() && !rd.m_tmpUsername.isEmpty()) {
+                info.setUserName(rd.m_tmpUsername);
             }
-            if (!m_tmpPassword.isEmpty()) {
-                info.setPassword(m_tmpPassword);
+            if (!rd.m_tmpPassword.isEmpty()) {
+                info.setPassword(rd.m_tmpPassword);
             }
             info.setValidated(true);
 
@@ -537,15 +929,21 @@ void SignonSessionCore::processResultReply(const QVariantMap &data)
             }
         }
 
-        m_tmpUsername.clear();
-        m_tmpPassword.clear();
-
         //remove secret field from output
         if (m_method != QLatin1String("password")
             && filteredData.contains(SSO_KEY_PASSWORD))
             filteredData.remove(SSO_KEY_PASSWORD);
 
+        ResultCache *cache = ResultCache::instance();
+        if (m_id != SIGNOND_NEW_IDENTITY && cache->isEnabled(m_method)) {
+            cache->insert(m_id, m_method, rd.m_mechanism,
+                          resultCacheKey(rd.m_peerContext, rd.m_clientData),
+                          filteredData);
+        }
+
         rd.m_callback(filteredData, Error::NoError);
+        foreach (const CoalescedRequest &coalesced, rd.m_coalesced)
+            coalesced.m_callback(filteredData, Error::NoError);
 
         if (m_watcher && !m_watcher->isFinished()) {
             delete m_watcher;
@@ -619,7 +1017,7 @@ void SignonSessionCore::processUiRequest(const QVariantMap &data)
 
     keepInUse();
 
-    if (!m_canceled && !m_listOfRequests.isEmpty()) {
+    if (m_activeRequests > 0 && !m_listOfRequests.head().m_canceled) {
         RequestData &request = m_listOfRequests.head();
         QString uiRequestId = request.m_cancelKey;
 
@@ -639,7 +1037,7 @@ void SignonSessionCore::processUiRequest(const QVariantMap &data)
         else
             request.m_params[SSOUI_KEY_STORED_IDENTITY] = true;
         request.m_params[SSOUI_KEY_IDENTITY] = m_id;
-        request.m_params[SSOUI_KEY_CLIENT_DATA] = m_clientData;
+        request.m_params[SSOUI_KEY_CLIENT_DATA] = request.m_clientData;
         request.m_params[SSOUI_KEY_METHOD] = m_method;
         request.m_params[SSOUI_KEY_MECHANISM] = request.m_mechanism;
         /* Pass some data about the requesting client */
@@ -694,7 +1092,7 @@ void SignonSessionCore::processRefreshRequest(const QVariantMap &data)
 
     keepInUse();
 
-    if (!m_canceled && !m_listOfRequests.isEmpty()) {
+    if (m_activeRequests > 0 && !m_listOfRequests.head().m_canceled) {
         QString uiRequestId = m_listOfRequests.head().m_cancelKey;
 
         if (m_watcher) {
@@ -719,15 +1117,14 @@ void SignonSessionCore::processError(int err, const QString &message)
 {
     TRACE();
     keepInUse();
-    m_tmpUsername.clear();
-    m_tmpPassword.clear();
 
-    if (m_listOfRequests.isEmpty())
+    /* Errors can only refer to requests sent to the plugin */
+    if (m_activeRequests <= 0)
         return;
 
     RequestData rd = m_listOfRequests.head();
 
-    if (!m_canceled) {
+    if (!rd.m_canceled) {
         replyError(rd, err, message);
 
         if (m_watcher && !m_watcher->isFinished()) {
@@ -746,9 +1143,11 @@ void SignonSessionCore::processError(int err, const QString &message)
 
 void SignonSessionCore::stateChangedSlot(int state, const QString &message)
 {
-    if (!m_canceled && !m_listOfRequests.isEmpty()) {
+    if (m_activeRequests > 0 && !m_listOfRequests.head().m_canceled) {
         RequestData rd = m_listOfRequests.head();
         emit stateChanged(rd.m_cancelKey, (int)state, message);
+        foreach (const CoalescedRequest &coalesced, rd.m_coalesced)
+            emit stateChanged(coalesced.m_cancelKey, (int)state, message);
     }
 
     keepInUse();
@@ -812,13 +1211,13 @@ void SignonSessionCore::queryUiSlot(QDBusPendingCallWatcher *call)
         m_queryCredsUiDisplayed = false;
     }
 
-    if (!m_canceled) {
+    if (!rd.m_canceled) {
         /* Temporary caching, if credentials are valid
          * this data will be effectively cached */
-        m_tmpUsername = rd.m_params.value(SSO_KEY_USERNAME,
-                                          QVariant()).toString();
-        m_tmpPassword = rd.m_params.value(SSO_KEY_PASSWORD,
-                                          QVariant()).toString();
+        rd.m_tmpUsername = rd.m_params.value(SSO_KEY_USERNAME,
+                                             QVariant()).toString();
+        rd.m_tmpPassword = rd.m_params.value(SSO_KEY_PASSWORD,
+                                             QVariant()).toString();
 
         if (isRequestToRefresh) {
             TRACE() << "REFRESH IS REQUIRED";
@@ -838,43 +1237,71 @@ void SignonSessionCore::startNewRequest()
 {
     keepInUse();
 
-    m_canceled = false;
-
     if (m_listOfRequests.isEmpty()) {
         TRACE() << "No more requests to process";
         setAutoDestruct(true);
         return;
     }
 
-    // there is an active request already
-    if (m_requestIsActive) {
-        TRACE() << "One request is already active";
-        return;
-    }
-
     //there is some UI operation with plugin
     if (m_watcher && !m_watcher->isFinished()) {
         TRACE() << "Some UI operation is still pending";
         return;
     }
 
-    TRACE() << "Starting the authentication process";
+    if (m_activeRequests >= m_listOfRequests.count() ||
+        m_waitingForScheduler)
+        return;
+
+    /* Plugins supporting it get several requests at once */
+    if (m_activeRequests >= m_plugin->maxConcurrentRequests()) {
+        TRACE() << m_activeRequests << "requests are already active";
+        return;
+    }
+
+    const RequestData &next = m_listOfRequests.at(m_activeRequests);
+    AccessControlManagerHelper *acm = AccessControlManagerHelper::instance();
+    QString peer = acm->appIdOfPeer(next.m_peerContext);
+    if (peer.isEmpty())
+        peer = QString::number(acm->pidOfPeer(next.m_peerContext));
+
     setAutoDestruct(false);
+    m_waitingForScheduler = true;
+    RequestScheduler::instance()->submit(this,
+        RequestScheduler::priorityFor(next.m_params), peer,
+        [this]() { onRequestScheduled(); });
+}
+
+void SignonSessionCore::onRequestScheduled()
+{
+    m_waitingForScheduler = false;
+
+    /* The request might have been canceled in the meantime, or a UI
+     * interaction might have started */
+    if (m_activeRequests >= m_listOfRequests.count() ||
+        (m_watcher && !m_watcher->isFinished())) {
+        RequestScheduler::instance()->release(this);
+        if (m_activeRequests == 0 && m_listOfRequests.isEmpty())
+            setAutoDestruct(true);
+        return;
+    }
+
+    TRACE() << "Starting the authentication process";
     startProcess();
+    /* Submit the next request, if the plugin can take it */
+    QMetaObject::invokeMethod(this, "startNewRequest", Qt::QueuedConnection);
 }
 
 void SignonSessionCore::destroy()
 {
-    if (m_requestIsActive ||
+    if (m_activeRequests > 0 ||
+        m_waitingForScheduler ||
         m_watcher != NULL) {
         keepInUse();
         return;
     }
 
-    if (m_id)
-        sessionsOfStoredCredentials.remove(sessionName(m_id, m_method));
-    else
-        sessionsOfNonStoredCredentials.removeOne(this);
+    sessionIndex.remove(m_id, m_methodId, this);
 
     QObjectList authSessions;
     while (authSessions = children(), !authSessions.isEmpty()) {
@@ -885,5 +1312,7 @@ void SignonSessionCore::destroy()
 
 void SignonSessionCore::credentialsSystemReady()
 {
+    /* Secrets might have been read from the memory cache so far */
+    resetIdentityData();
     QMetaObject::invokeMethod(this, "startNewRequest", Qt::QueuedConnection);
 }
@@ -71,6 +71,17 @@ public:
 
     void destroy();
 
+    /* Limits to the requests accepted in the sessions' queues; 0 disables
+     * the corresponding limit. The queued bytes are only accounted while a
+     * byte limit is set */
+    static void setQueueLimits(uint maxLength, qint64 maxBytes);
+    static qint64 queuedBytes();
+    int queueLength() const;
+
+    /* Drops the identity data read by the sessions of the identity id, or of
+     * all identities if id is 0 */
+    static void identityChanged(quint32 id);
+
     typedef std::function<void(const QVariantMap &map, const Error &error)>
         ProcessCb;
 
@@ -111,6 +122,9 @@ private Q_SLOTS:
                           const QString &message);
 
     void queryUiSlot(QDBusPendingCallWatcher *call);
+    void checkDeadlines();
+    void onAbortTimeout();
+    void onCredentialsUpdated(quint32 id);
 
 protected:
     SignonSessionCore(quint32 id,
@@ -122,12 +136,24 @@ protected:
     void customEvent(QEvent *event);
 
 private:
-    void startProcess();
+    void onRequestScheduled();
+    void loadIdentityData();
+    void resetIdentityData();
+    SignonIdentityInfo identityInfo();
+    QVariantMap storedParams();
+    bool startProcess();
+    bool coalesceRequest(const RequestData &request);
+    QVariantMap resultCacheKey(const PeerContext &peerContext,
+                               const QVariantMap &params);
     void replyError(const RequestData &request,
                     int err,
                     const QString &message);
+    void insertRequest(int index, const RequestData &request);
+    RequestData takeRequest(int index);
     void processStoreOperation(const StoreOperation &operation);
     void requestDone();
+    void expireRequest(int index);
+    void updateDeadlineTimer();
 
 private:
     PluginProxy *m_plugin;
@@ -136,18 +162,30 @@ private:
 
     QDBusPendingCallWatcher *m_watcher;
 
-    bool m_requestIsActive;
-    bool m_canceled;
+    /* Fires when the first request deadline expires */
+    QTimer m_deadlineTimer;
+    /* Fires if the plugin doesn't reply to the cancellation of a request
+     * which timed out */
+    QTimer m_abortTimer;
+
+    /* The first m_activeRequests items of m_listOfRequests have been sent
+     * to the plugin; the plugin replies to them in order */
+    int m_activeRequests;
+    /* The next request has been submitted to the RequestScheduler */
+    bool m_waitingForScheduler;
 
     uint m_id;
     QString m_method;
-    /* the original request parameters, for the request currently being
-     * processed */
-    QVariantMap m_clientData;
-
-    //Temporary caching
-    QString m_tmpUsername;
-    QString m_tmpPassword;
+    /* ID of m_method in the session index */
+    quint32 m_methodId;
+
+    /* Data of the identity, read from the DB by the first request which
+     * needs it and kept until the identity is changed by someone else */
+    bool m_identityDataLoaded;
+    SignonIdentityInfo m_identityInfo;
+    QVariantMap m_storedParams;
+    /* Set while this object writes the credentials to the DB */
+    bool m_isStoringCredentials;
 
     /* Flag used for handling post ui querying results' processing.
      * Secure storage not available events won't be posted if the current
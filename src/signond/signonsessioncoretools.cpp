@@ -23,26 +23,33 @@
 
 #include "signonsessioncoretools.h"
 
+#include <QDataStream>
 #include <QDebug>
 #include "signond-common.h"
 
 using namespace SignonDaemonNS;
 
-QVariantMap SignonDaemonNS::mergeVariantMaps(const QVariantMap &map1,
-                                             const QVariantMap &map2)
+void SignonDaemonNS::addMissingKeys(QVariantMap &map,
+                                    const QVariantMap &defaults)
 {
-    if (map1.isEmpty()) return map2;
-    if (map2.isEmpty()) return map1;
+    if (map.isEmpty()) {
+        map = defaults;
+        return;
+    }
 
-    QVariantMap map = map1;
-    //map2 values will overwrite map1 values for the same keys.
-    QMapIterator<QString, QVariant> it(map2);
-    while (it.hasNext()) {
-        it.next();
-        if (map.contains(it.key()))
-            map.remove(it.key());
+    QVariantMap::const_iterator it;
+    for (it = defaults.constBegin(); it != defaults.constEnd(); it++) {
+        if (!map.contains(it.key()))
+            map.insert(it.key(), it.value());
     }
-    return map.unite(map2);
+}
+
+qint64 SignonDaemonNS::variantMapSize(const QVariantMap &map)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << map;
+    return data.size();
 }
 
 /* --------------------- StoreOperation ---------------------- */
@@ -75,8 +82,13 @@ RequestData::RequestData(const PeerContext &peerContext,
     m_callback(callback),
     m_params(params),
     m_mechanism(mechanism),
-    m_cancelKey(cancelKey)
+    m_cancelKey(cancelKey),
+    m_canceled(false),
+    m_timeout(0),
+    m_timedOut(false),
+    m_size(0)
 {
+    m_queuedTime.start();
 }
 
 RequestData::RequestData(const RequestData &other):
@@ -84,7 +96,16 @@ RequestData::RequestData(const RequestData &other):
     m_callback(other.m_callback),
     m_params(other.m_params),
     m_mechanism(other.m_mechanism),
-    m_cancelKey(other.m_cancelKey)
+    m_cancelKey(other.m_cancelKey),
+    m_clientData(other.m_clientData),
+    m_tmpUsername(other.m_tmpUsername),
+    m_tmpPassword(other.m_tmpPassword),
+    m_canceled(other.m_canceled),
+    m_timeout(other.m_timeout),
+    m_queuedTime(other.m_queuedTime),
+    m_timedOut(other.m_timedOut),
+    m_size(other.m_size),
+    m_coalesced(other.m_coalesced)
 {
 }
 
@@ -24,6 +24,7 @@
 #ifndef SIGNONSESSIONCORETOOLS_H
 #define SIGNONSESSIONCORETOOLS_H
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QVariantMap>
 
@@ -37,13 +38,18 @@ namespace SignonDaemonNS {
 class Error;
 
 /*!
- * @brief Helper method which unites two variant maps.
- * @param map1 base map to be united with
- * @param map2 map to be united with base. If map2 and map1 contain common
- *        keys, the values in map1 will be overwritten by map2 values
- * @returns a union of the map1 and map2 with unique keys,
+ * @brief Helper method which merges a variant map into another one, in place.
+ * @param map map to be completed; its values are never overwritten
+ * @param defaults map whose values are added to map, for the keys which are
+ *        not in map already
  */
-QVariantMap mergeVariantMaps(const QVariantMap &map1, const QVariantMap &map2);
+void addMissingKeys(QVariantMap &map, const QVariantMap &defaults);
+
+/*!
+ * @brief Computes the memory taken by a variant map, approximated by the size
+ * of its serialization.
+ */
+qint64 variantMapSize(const QVariantMap &map);
 
 /*!
  * @class StoreOperation
@@ -67,6 +73,29 @@ public:
     QVariantMap m_blobData;
 };
 
+/*!
+ * @class CoalescedRequest
+ * A client request which is served by the result of an equivalent request
+ * already queued in the same session.
+ */
+struct CoalescedRequest
+{
+    typedef std::function<void(const QVariantMap &map, const Error &error)>
+        ProcessCb;
+
+    CoalescedRequest(const PeerContext &peerContext,
+                     const QString &cancelKey,
+                     const ProcessCb &callback):
+        m_peerContext(peerContext),
+        m_callback(callback),
+        m_cancelKey(cancelKey) {}
+
+public:
+    PeerContext m_peerContext;
+    ProcessCb m_callback;
+    QString m_cancelKey;
+};
+
 /*!
  * @class RequestData
  * Request data.
@@ -92,6 +121,21 @@ public:
     QVariantMap m_params;
     QString m_mechanism;
     QString m_cancelKey;
+    /* the original request parameters, set when the request is started */
+    QVariantMap m_clientData;
+    //Temporary caching
+    QString m_tmpUsername;
+    QString m_tmpPassword;
+    bool m_canceled;
+    /* time allowed for processing the request, in msecs (0 = unlimited),
+     * measured since the request was queued */
+    qint64 m_timeout;
+    QElapsedTimer m_queuedTime;
+    bool m_timedOut;
+    /* size of m_params when the request was queued, in bytes */
+    qint64 m_size;
+    /* other clients waiting for the result of this request */
+    QList<CoalescedRequest> m_coalesced;
 };
 
 } //SignonDaemonNS
@@ -487,6 +487,95 @@ void TestAuthSession::process_many_times_before_auth()
     QCOMPARE(spyResponse.count(), 1);
 }
 
+void TestAuthSession::process_coalesced()
+{
+    MechanismsList mechs;
+    mechs.append("mech1");
+    QMap<MethodName,MechanismsList> methods;
+    methods.insert(QLatin1String("ssotest"), mechs);
+    IdentityInfo info("test_caption", "test_user_name", methods);
+    info.setSecret("test_secret");
+    info.setAccessControlList(QStringList() << "*");
+    Identity *id = Identity::newIdentity(info, this);
+
+    QSignalSpy spyStored(id, SIGNAL(credentialsStored(const quint32)));
+    QEventLoop loopStoreCreds;
+    QObject::connect(id, SIGNAL(error(const SignOn::Error &)),
+                     &loopStoreCreds, SLOT(quit()), Qt::QueuedConnection);
+    QObject::connect(id, SIGNAL(credentialsStored(const quint32)),
+                     &loopStoreCreds, SLOT(quit()));
+    QTimer::singleShot(10*1000, &loopStoreCreds, SLOT(quit()));
+    id->storeCredentials();
+    loopStoreCreds.exec();
+    QCOMPARE(spyStored.count(), 1);
+
+    /* Identical requests from different sessions on the same identity are
+     * served by the same plugin invocation; all of them must get a reply */
+    AuthSession *as1 = id->createSession(QLatin1String("ssotest"));
+    AuthSession *as2 = id->createSession(QLatin1String("ssotest"));
+    AuthSession *as3 = id->createSession(QLatin1String("ssotest"));
+
+    QSignalSpy spyResponse1(as1, SIGNAL(response(const SignOn::SessionData&)));
+    QSignalSpy spyResponse2(as2, SIGNAL(response(const SignOn::SessionData&)));
+    QSignalSpy spyError3(as3, SIGNAL(error(const SignOn::Error &)));
+    QSignalSpy spyResponse3(as3, SIGNAL(response(const SignOn::SessionData&)));
+
+    SessionData inData;
+    inData.setUserName("testUsername");
+
+    as1->process(inData, "mech1");
+    as2->process(inData, "mech1");
+    as3->process(inData, "mech1");
+    /* Canceling one of the requests must not affect the others */
+    as3->cancel();
+
+    QTRY_COMPARE_WITH_TIMEOUT(spyResponse1.count(), 1, 10*1000);
+    QTRY_COMPARE_WITH_TIMEOUT(spyResponse2.count(), 1, 10*1000);
+    QTRY_COMPARE(spyError3.count(), 1);
+    QCOMPARE(spyResponse3.count(), 0);
+
+    SessionData data1 = spyResponse1.at(0).at(0).value<SignOn::SessionData>();
+    SessionData data2 = spyResponse2.at(0).at(0).value<SignOn::SessionData>();
+    QCOMPARE(data1.Realm(), data2.Realm());
+}
+
+void TestAuthSession::process_after_identity_update()
+{
+    MechanismsList mechs;
+    mechs.append("mech1");
+    QMap<MethodName,MechanismsList> methods;
+    methods.insert(QLatin1String("ssotest"), mechs);
+    IdentityInfo info("test_caption", "test_user_name", methods);
+    info.setSecret("test_secret");
+    info.setAccessControlList(QStringList() << "*");
+    Identity *id = Identity::newIdentity(info, this);
+
+    QSignalSpy spyStored(id, SIGNAL(credentialsStored(const quint32)));
+    id->storeCredentials();
+    QTRY_COMPARE_WITH_TIMEOUT(spyStored.count(), 1, 10*1000);
+
+    /* The session reads the identity data when it's created... */
+    AuthSession *as = id->createSession(QLatin1String("ssotest"));
+    QSignalSpy spyResponse(as, SIGNAL(response(const SignOn::SessionData&)));
+
+    as->process(SessionData(), "mech1");
+    QTRY_COMPARE_WITH_TIMEOUT(spyResponse.count(), 1, 10*1000);
+    SessionData data = spyResponse.at(0).at(0).value<SignOn::SessionData>();
+    QCOMPARE(data.UserName(), QString("test_user_name"));
+
+    /* ...and must not use it anymore once the identity has changed */
+    info.setUserName("other_user_name");
+    id->storeCredentials(info);
+    QTRY_COMPARE_WITH_TIMEOUT(spyStored.count(), 2, 10*1000);
+
+    as->process(SessionData(), "mech1");
+    QTRY_COMPARE_WITH_TIMEOUT(spyResponse.count(), 2, 10*1000);
+    data = spyResponse.at(1).at(0).value<SignOn::SessionData>();
+    QCOMPARE(data.UserName(), QString("other_user_name"));
+
+    id->destroySession(as);
+}
+
 void TestAuthSession::process_with_big_session_data()
 {
     //TODO once bug Bug#222200 is fixed, this test case can be enabled
@@ -565,6 +654,53 @@ void TestAuthSession::process_after_timeout()
     QCOMPARE(spyError.count(), 0);
 }
 
+void TestAuthSession::process_one_shot_fallback()
+{
+    AuthSession *as;
+    SSO_TEST_CREATE_AUTH_SESSION(as, "ssotest");
+
+    /* Simulate a daemon which does not implement processOneShot; nothing
+     * must be connected to stateChanged, or the one-shot path is skipped */
+    AuthSessionImpl *impl = as->findChild<AuthSessionImpl *>();
+    QVERIFY(impl != 0);
+    impl->m_oneShotOperation = QLatin1String("processOneShotMissing");
+
+    QSignalSpy spyResponse(as, SIGNAL(response(const SignOn::SessionData&)));
+    QSignalSpy spyError(as, SIGNAL(error(const SignOn::Error &)));
+    QEventLoop loop;
+
+    QObject::connect(as, SIGNAL(response(const SignOn::SessionData&)),
+                     &loop, SLOT(quit()));
+    QObject::connect(as, SIGNAL(error(const SignOn::Error &)),
+                     &loop, SLOT(quit()));
+    QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+
+    SessionData inData;
+
+    inData.setSecret("testSecret");
+    inData.setUserName("testUsername");
+
+    as->process(inData, "mech1");
+    QVERIFY(impl->m_isOneShot);
+
+    loop.exec();
+
+    QCOMPARE(spyResponse.count(), 1);
+    QCOMPARE(spyError.count(), 0);
+    QVERIFY(!impl->m_isOneShotSupported);
+    QVERIFY(impl->m_hasSessionObject);
+    spyResponse.clear();
+
+    /* The session remembers it, and goes through the session object */
+    as->process(inData, "mech1");
+    QVERIFY(!impl->m_isOneShot);
+
+    loop.exec();
+
+    QCOMPARE(spyResponse.count(), 1);
+    QCOMPARE(spyError.count(), 0);
+}
+
 void TestAuthSession::cancel_immediately()
 {
     AuthSession *as;
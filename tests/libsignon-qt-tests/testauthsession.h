@@ -87,8 +87,11 @@ private Q_SLOTS:
     void process_with_unauthorized_method();
     void process_many_times_after_auth();
     void process_many_times_before_auth();
+    void process_coalesced();
+    void process_after_identity_update();
     void process_with_big_session_data();
     void process_after_timeout();
+    void process_one_shot_fallback();
 
     void cancel_immediately();
     void cancel_with_delay();
@@ -28,6 +28,7 @@
 #include "credentialsdb.h"
 #include "signonidentityinfo.cpp"
 #include "signonsecuritycontext.cpp"
+#include "databasereaders.h"
 
 const QString dbFile = QLatin1String("/tmp/signon_test.db");
 const QString secretsDbFile = QLatin1String("/tmp/signon_test_secrets.db");
@@ -662,4 +663,155 @@ void TestDatabase::credentialsOwnerSecurityTokenTest()
 
 }
 
+void TestDatabase::identitiesByIdTest()
+{
+    m_db->openSecretsDB(secretsDbFile);
+    m_db->clear();
+
+    SignonIdentityInfo info;
+    info.setCaption(QLatin1String("First"));
+    info.setUserName(QLatin1String("User"));
+    info.setMethods(testMethods);
+    info.setRealms(testRealms);
+    info.setAccessControlList(testAcl);
+    info.setOwnerList(QStringList() << QLatin1String("AID::12345678"));
+    quint32 id1 = m_db->insertCredentials(info);
+    QVERIFY(id1 != 0);
+
+    info.setCaption(QLatin1String("Second"));
+    info.setAccessControlList(QStringList() << QLatin1String("*"));
+    info.setOwnerList(QStringList());
+    info.setRealms(QStringList());
+    quint32 id2 = m_db->insertCredentials(info);
+    QVERIFY(id2 != 0);
+
+    QHash<quint32, SignonIdentityInfo> infos =
+        m_db->credentials(QList<quint32>() << id2 << 4321 << id1 << id2);
+    QVERIFY(!m_db->errorOccurred());
+    QCOMPARE(infos.count(), 2);
+    QVERIFY(!infos.contains(4321));
+
+    /* Same data as when reading the identities one by one */
+    foreach (quint32 id, QList<quint32>() << id1 << id2) {
+        SignonIdentityInfo expected = m_db->credentials(id, false);
+        SignonIdentityInfo actual = infos.value(id);
+        QCOMPARE(actual.id(), id);
+        QCOMPARE(actual.caption(), expected.caption());
+        QCOMPARE(actual.userName(), expected.userName());
+        QCOMPARE(actual.methods().keys(), expected.methods().keys());
+        foreach (const QString &method, expected.methods().keys()) {
+            QCOMPARE(actual.methods().value(method).toSet(),
+                     expected.methods().value(method).toSet());
+        }
+        QCOMPARE(actual.realms().toSet(), expected.realms().toSet());
+        QCOMPARE(actual.accessControlList().toSet(),
+                 expected.accessControlList().toSet());
+        QCOMPARE(actual.ownerList(), expected.ownerList());
+        QCOMPARE(actual.validated(), expected.validated());
+        QCOMPARE(actual.storePassword(), expected.storePassword());
+    }
+
+    QVERIFY(m_db->credentials(QList<quint32>()).isEmpty());
+}
+
+void TestDatabase::readerThreadsTest()
+{
+    m_db->openSecretsDB(secretsDbFile);
+    m_db->clear();
+
+    SignonIdentityInfo info;
+    info.setCaption(QLatin1String("Caption"));
+    info.setMethods(testMethods);
+    quint32 id = m_db->insertCredentials(info);
+    QVERIFY(id != 0);
+
+    DatabaseReaders *readers = DatabaseReaders::instance();
+    QVERIFY(!readers->run(dbFile, [](MetaDataDB *) {}));
+    readers->setThreadCount(2);
+
+    const int numQueries = 8;
+    QList<SignonIdentityInfo> results[numQueries];
+    bool connected[numQueries];
+    for (int i = 0; i < numQueries; i++) {
+        QVERIFY(readers->run(m_db->metaDataDbName(),
+                             [&results, &connected, i](MetaDataDB *db) {
+            connected[i] = (db != 0);
+            if (db) results[i] = db->identities(QMap<QString, QString>());
+        }));
+    }
+    readers->waitForDone();
+
+    for (int i = 0; i < numQueries; i++) {
+        QVERIFY(connected[i]);
+        QCOMPARE(results[i].count(), 1);
+        QCOMPARE(results[i].first().id(), id);
+        QCOMPARE(results[i].first().caption(), QLatin1String("Caption"));
+        QCOMPARE(results[i].first().methods().keys(), testMethods.keys());
+    }
+
+    /* Changes committed by the main connection are seen by the readers */
+    info.setId(id);
+    info.setCaption(QLatin1String("New caption"));
+    QCOMPARE(m_db->updateCredentials(info), id);
+
+    QString caption;
+    QVERIFY(readers->run(m_db->metaDataDbName(), [&caption, id](MetaDataDB *db) {
+        if (db) caption = db->identity(id).caption();
+    }));
+    readers->waitForDone();
+    QCOMPARE(caption, QLatin1String("New caption"));
+
+    readers->setThreadCount(0);
+}
+
+void TestDatabase::readerThreadsRestoreTest()
+{
+    m_db->openSecretsDB(secretsDbFile);
+    m_db->clear();
+
+    SignonIdentityInfo info;
+    info.setCaption(QLatin1String("Backed up"));
+    info.setMethods(testMethods);
+    quint32 id = m_db->insertCredentials(info);
+    QVERIFY(id != 0);
+
+    const QString backupFile = dbFile + QLatin1String(".backup");
+    QFile::remove(backupFile);
+    QVERIFY(QFile::copy(dbFile, backupFile));
+
+    info.setId(id);
+    info.setCaption(QLatin1String("Changed"));
+    QCOMPARE(m_db->updateCredentials(info), id);
+
+    /* A single thread, so that the same connection is used throughout */
+    DatabaseReaders *readers = DatabaseReaders::instance();
+    readers->setThreadCount(1);
+
+    QString caption;
+    QVERIFY(readers->run(m_db->metaDataDbName(), [&caption, id](MetaDataDB *db) {
+        if (db) caption = db->identity(id).caption();
+    }));
+    readers->waitForDone();
+    QCOMPARE(caption, QLatin1String("Changed"));
+
+    /* Restore the backup the way Backup::restoreFinished() does: the files
+     * are replaced under the same name while the DB is closed */
+    const QString movedFile = dbFile + QLatin1String(".bak");
+    QFile::remove(movedFile);
+    QVERIFY(QFile::rename(dbFile, movedFile));
+    QVERIFY(QFile::copy(backupFile, dbFile));
+    readers->invalidateConnections();
+
+    caption.clear();
+    QVERIFY(readers->run(m_db->metaDataDbName(), [&caption, id](MetaDataDB *db) {
+        if (db) caption = db->identity(id).caption();
+    }));
+    readers->waitForDone();
+    QCOMPARE(caption, QLatin1String("Backed up"));
+
+    readers->setThreadCount(0);
+    QFile::remove(backupFile);
+    QFile::remove(movedFile);
+}
+
 QTEST_MAIN(TestDatabase)
@@ -63,6 +63,9 @@ private Q_SLOTS:
 
     void accessControlListTest();
     void credentialsOwnerSecurityTokenTest();
+    void identitiesByIdTest();
+    void readerThreadsTest();
+    void readerThreadsRestoreTest();
 
 private:
     CredentialsDB *m_db;
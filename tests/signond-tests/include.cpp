@@ -27,7 +27,9 @@
 #define PLUGINPROXY_EXTERNAL_INCLUDED_
 
 #include "pluginproxy.cpp"
+#include "inprocessplugin.cpp"
 #include "blobiohandler.cpp"
+#include "frameiohandler.cpp"
 
 #endif //_EXTERNAL_INCLUDED_
 
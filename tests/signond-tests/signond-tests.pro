@@ -4,6 +4,13 @@ SUBDIRS = \
     tst_access_control_manager_helper.pro \
     tst_timeouts.pro \
     tst_pluginproxy.pro \
+    tst_resultcache.pro \
+    tst_requestscheduler.pro \
+    tst_ratelimiter.pro \
+    tst_peercache.pro \
+    tst_sessionindex.pro \
+    tst_disposable.pro \
+    tst_idlepolicy.pro \
     tst_database.pro \
     access-control.pro \
 
@@ -20,8 +20,13 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
  * 02110-1301 USA
  */
+#include <QBuffer>
 #include <QVariant>
 #include "testpluginproxy.h"
+#include "blobiohandler.h"
+#include "frameiohandler.h"
+#include "inprocessplugin.h"
+#include "ipc.h"
 
 #include <sys/types.h>
 #include <pwd.h>
@@ -83,6 +88,12 @@ void TestPluginProxy::mechanisms_for_dummy()
     QVERIFY(mechs == pattern);
 }
 
+void TestPluginProxy::concurrency_for_dummy()
+{
+    /* The test plugin doesn't support concurrent requests */
+    QCOMPARE(m_proxy->maxConcurrentRequests(), 1);
+}
+
 void TestPluginProxy::process_for_dummy()
 {
     // Build up the session data.  It will include a value
@@ -306,6 +317,351 @@ void TestPluginProxy::wrong_user_for_dummy()
 #endif
 }
 
+void TestPluginProxy::recycle_after_max_requests()
+{
+    PluginRecyclingPolicy policy;
+    policy.m_maxRequests = 1;
+    PluginProxy::setRecyclingPolicy(policy);
+
+    PluginProxy *pp = PluginProxy::createNewPluginProxy("ssotest");
+    QVERIFY(pp != NULL);
+
+    QSignalSpy spyResult(pp,
+                         SIGNAL(processResultReply(const QVariantMap&)));
+    QVariantMap inData;
+    inData.insert("UserName", "testUsername");
+    QVERIFY(pp->process(inData, "mech1"));
+    QTRY_COMPARE_WITH_TIMEOUT(spyResult.count(), 1, 10000);
+    QCOMPARE(pp->requestCount(), 1u);
+
+    /* The process is replaced once the request has been served */
+    QTRY_COMPARE(pp->requestCount(), 0u);
+
+    /* and the new one is able to serve requests */
+    QVERIFY(pp->process(inData, "mech1"));
+    QTRY_COMPARE_WITH_TIMEOUT(spyResult.count(), 2, 10000);
+
+    PluginProxy::setRecyclingPolicy(PluginRecyclingPolicy());
+    delete pp;
+}
+
+void TestPluginProxy::delete_does_not_block()
+{
+    PluginProxy *pp = PluginProxy::createNewPluginProxy("ssotest");
+    QVERIFY(pp != NULL);
+
+    QElapsedTimer timer;
+    timer.start();
+    delete pp;
+    QVERIFY(timer.elapsed() < 500);
+
+    /* The process is still terminated, in the background */
+    QCOMPARE(PluginReaper::instance()->count(), 1);
+    QTRY_COMPARE_WITH_TIMEOUT(PluginReaper::instance()->count(), 0, 5000);
+}
+
+void TestPluginProxy::abort_while_processing()
+{
+    PluginProxy *pp = PluginProxy::createNewPluginProxy("ssotest");
+    QVERIFY(pp != NULL);
+
+    QSignalSpy spyResult(pp, SIGNAL(processResultReply(const QVariantMap&)));
+    QSignalSpy spyError(pp, SIGNAL(processError(int, const QString&)));
+    QVariantMap inData;
+    inData.insert("UserName", "testUsername");
+    QVERIFY(pp->process(inData, "mech1"));
+    QVERIFY(pp->isProcessing());
+
+    /* The pending request fails right away, and the old process gets
+     * terminated in the background */
+    pp->abort();
+    QCOMPARE(spyError.count(), 1);
+    QVERIFY(!pp->isProcessing());
+    QVERIFY(PluginReaper::instance()->count() > 0);
+
+    /* A new process serves the next requests */
+    QVERIFY(pp->process(inData, "mech1"));
+    QTRY_COMPARE_WITH_TIMEOUT(spyResult.count(), 1, 10000);
+    QCOMPARE(spyError.count(), 1);
+
+    delete pp;
+}
+
+void TestPluginProxy::process_in_process()
+{
+    PluginProxy::setInProcessPlugins(qgetenv("SSO_PLUGINS_DIR"),
+                                     QStringList("ssotest"));
+    PluginProxy *pp = PluginProxy::createNewPluginProxy("ssotest");
+    PluginProxy::setInProcessPlugins(QString(), QStringList());
+    QVERIFY(pp != NULL);
+    QVERIFY(pp->isInProcess());
+    QCOMPARE(pp->mechanisms(), m_proxy->mechanisms());
+
+    QSignalSpy spyResult(pp,
+                         SIGNAL(processResultReply(const QVariantMap&)));
+    QSignalSpy spyState(pp, SIGNAL(stateChanged(int, const QString&)));
+    QVariantMap inData;
+    inData.insert("UserName", "testUsername");
+    QVERIFY(pp->process(inData, "mech1"));
+    QTRY_COMPARE_WITH_TIMEOUT(spyResult.count(), 1, 10000);
+    QCOMPARE(spyState.count(), 10);
+
+    QVariantMap outData = spyResult.at(0).at(0).toMap();
+    QCOMPARE(outData.value("UserName").toString(), QString("testUsername"));
+    QCOMPARE(outData.value("Realm").toString(),
+             QString("testRealm_after_test"));
+
+    /* An error reply, delivered only to the right proxy */
+    PluginProxy::setInProcessPlugins(qgetenv("SSO_PLUGINS_DIR"),
+                                     QStringList("ssotest"));
+    PluginProxy *other = PluginProxy::createNewPluginProxy("ssotest");
+    PluginProxy::setInProcessPlugins(QString(), QStringList());
+    QVERIFY(other != NULL);
+    QSignalSpy spyError(pp, SIGNAL(processError(int, const QString&)));
+    QSignalSpy spyOtherError(other,
+                             SIGNAL(processError(int, const QString&)));
+    QVERIFY(pp->process(inData, "wrong"));
+    QTRY_COMPARE(spyError.count(), 1);
+    QCOMPARE(spyError.at(0).at(0).toInt(), int(Error::MechanismNotAvailable));
+    QCOMPARE(spyOtherError.count(), 0);
+
+    delete other;
+    delete pp;
+}
+
+void TestPluginProxy::process_latency_data()
+{
+    QTest::addColumn<bool>("inProcess");
+
+    QTest::newRow("plugin process") << false;
+    QTest::newRow("in process") << true;
+}
+
+void TestPluginProxy::process_latency()
+{
+    QFETCH(bool, inProcess);
+
+    if (inProcess) {
+        PluginProxy::setInProcessPlugins(qgetenv("SSO_PLUGINS_DIR"),
+                                         QStringList("ssotest"));
+    }
+    PluginProxy *pp = PluginProxy::createNewPluginProxy("ssotest");
+    PluginProxy::setInProcessPlugins(QString(), QStringList());
+    QVERIFY(pp != NULL);
+    QCOMPARE(pp->isInProcess(), inProcess);
+
+    /* The test plugin replies immediately to unknown mechanisms, so that
+     * the IPC overhead is what gets measured */
+    QVariantMap inData;
+    inData.insert("UserName", "testUsername");
+    QSignalSpy spyError(pp, SIGNAL(processError(int, const QString&)));
+    QEventLoop loop;
+    QObject::connect(pp, SIGNAL(processError(int, const QString&)),
+                     &loop, SLOT(quit()));
+    int iterations = 0;
+    QBENCHMARK {
+        QVERIFY(pp->process(inData, "wrong"));
+        loop.exec();
+        iterations++;
+    }
+    QCOMPARE(spyError.count(), iterations);
+
+    delete pp;
+}
+
+void TestPluginProxy::process_oauth_request()
+{
+    PluginProxy *pp = PluginProxy::createNewPluginProxy("ssotest");
+    QVERIFY(pp != NULL);
+
+    /* A typical OAuth 2.0 request */
+    QVariantMap inData;
+    inData.insert("UserName", "testUsername");
+    inData.insert("Secret", "testSecret");
+    inData.insert("Host", "accounts.example.com");
+    inData.insert("AuthPath", "/o/oauth2/auth");
+    inData.insert("TokenPath", "/o/oauth2/token");
+    inData.insert("RedirectUri", "https://localhost/oauth2callback");
+    inData.insert("ClientId", "client-id");
+    inData.insert("ClientSecret", "client-secret");
+    inData.insert("ResponseType", QStringList("code"));
+    inData.insert("Scope", QStringList() <<
+                  "https://example.com/auth/email" <<
+                  "https://example.com/auth/calendar" <<
+                  "https://example.com/auth/contacts" <<
+                  "https://example.com/auth/drive");
+    inData.insert("UiPolicy", 0);
+    inData.insert("WindowId", 0x3c00007);
+
+    /* The test plugin replies immediately to unknown mechanisms */
+    QSignalSpy spyError(pp, SIGNAL(processError(int, const QString&)));
+    QEventLoop loop;
+    QObject::connect(pp, SIGNAL(processError(int, const QString&)),
+                     &loop, SLOT(quit()));
+
+    /* Nothing along the way needs to modify the client's data */
+    QVariantMap filtered = filterOutComplexTypes(inData);
+    QVERIFY(filtered.isSharedWith(inData));
+
+    int iterations = 0;
+    QBENCHMARK {
+        QVERIFY(pp->process(inData, "wrong"));
+        loop.exec();
+        iterations++;
+    }
+    QCOMPARE(spyError.count(), iterations);
+
+    delete pp;
+}
+
+void TestPluginProxy::blob_transfer_1mb()
+{
+    QVariantMap data;
+    data.insert("UserName", "testUsername");
+    data.insert("Payload", QByteArray(1024 * 1024, 'x'));
+
+    QVariantMap received;
+    QBENCHMARK {
+        QBuffer channel;
+        channel.open(QIODevice::ReadWrite);
+
+        BlobIOHandler writer(0, &channel);
+        QVERIFY(writer.sendData(data));
+
+        channel.seek(0);
+        int expectedDataSize = 0;
+        QDataStream(&channel) >> expectedDataSize;
+
+        BlobIOHandler reader(&channel, 0);
+        QSignalSpy spyData(&reader,
+                           SIGNAL(dataReceived(const QVariantMap&)));
+        QSignalSpy spyError(&reader, SIGNAL(error()));
+        reader.receiveData(expectedDataSize);
+
+        QCOMPARE(spyError.count(), 0);
+        QCOMPARE(spyData.count(), 1);
+        received = spyData.at(0).at(0).toMap();
+    }
+
+    QCOMPARE(received, data);
+}
+
+void TestPluginProxy::blob_read_timeout()
+{
+    QVariantMap data;
+    data.insert("Payload", QByteArray(1024, 'x'));
+
+    QBuffer channel;
+    channel.open(QIODevice::ReadWrite);
+    BlobIOHandler writer(0, &channel);
+    QVERIFY(writer.sendData(data));
+
+    /* Only part of the BLOB ever arrives */
+    QByteArray wire = channel.data();
+    QBuffer input;
+    input.setData(wire.left(wire.size() / 2));
+    input.open(QIODevice::ReadOnly);
+    int expectedDataSize = 0;
+    QDataStream(&input) >> expectedDataSize;
+
+    BlobIOHandler reader(&input, 0);
+    reader.setReadTimeout(50);
+    QCOMPARE(reader.readTimeout(), 50);
+    QSignalSpy spyData(&reader, SIGNAL(dataReceived(const QVariantMap&)));
+    QSignalSpy spyError(&reader, SIGNAL(error()));
+    reader.receiveData(expectedDataSize);
+    QCOMPARE(spyError.count(), 0);
+    QVERIFY(reader.isReading());
+
+    QVERIFY(spyError.wait(2000));
+    QCOMPARE(spyError.count(), 1);
+    QCOMPARE(spyData.count(), 0);
+    QVERIFY(!reader.isReading());
+}
+
+void TestPluginProxy::blob_oversized_header()
+{
+    QBuffer input;
+    input.open(QIODevice::ReadOnly);
+
+    BlobIOHandler reader(&input, 0);
+    QSignalSpy spyData(&reader, SIGNAL(dataReceived(const QVariantMap&)));
+    QSignalSpy spyError(&reader, SIGNAL(error()));
+
+    /* The announced size is rejected before anything is allocated */
+    reader.receiveData(SIGNON_IPC_MAX_FRAME_SIZE + 1);
+    QCOMPARE(spyError.count(), 1);
+    QCOMPARE(spyData.count(), 0);
+    QVERIFY(!reader.isReading());
+    QVERIFY(reader.m_blobBuffer.isEmpty());
+
+    reader.receiveData(-1);
+    QCOMPARE(spyError.count(), 2);
+}
+
+void TestPluginProxy::filter_does_not_copy()
+{
+    QVariantMap data;
+    data.insert("UserName", "testUsername");
+    data.insert("Scope", QStringList() << "read" << "write");
+
+    QVariantMap filtered = filterOutComplexTypes(data);
+    QCOMPARE(filtered, data);
+    QVERIFY(filtered.isSharedWith(data));
+}
+
+void TestPluginProxy::frame_reader()
+{
+    QVariantMap data;
+    data.insert("UserName", "testUsername");
+
+    QBuffer channel;
+    channel.open(QIODevice::ReadWrite);
+    FrameIOHandler writer(0, &channel, SIGNON_IPC_PROTOCOL_VERSION);
+    QVERIFY(writer.sendFrame(PLUGIN_OP_CANCEL, 3));
+    QVERIFY(writer.sendFrame(PLUGIN_OP_PROCESS_UI, 4,
+                             FrameIOHandler::encodeMap(data)));
+    QByteArray wire = channel.data();
+
+    /* Feed the frames byte by byte: no frame must be returned until it's
+     * complete */
+    QBuffer input;
+    input.open(QIODevice::ReadWrite);
+    FrameIOHandler reader(&input, 0, SIGNON_IPC_PROTOCOL_VERSION);
+    QList<FrameIOHandler::Frame> frames;
+    for (int i = 0; i < wire.size(); i++) {
+        qint64 pos = input.pos();
+        input.seek(input.size());
+        input.write(wire.constData() + i, 1);
+        input.seek(pos);
+        QCOMPARE(reader.readAvailableData(), qint64(1));
+
+        FrameIOHandler::Frame frame;
+        while (reader.takeFrame(frame))
+            frames.append(frame);
+        QVERIFY(!reader.hasError());
+    }
+
+    QCOMPARE(frames.count(), 2);
+    QCOMPARE(int(frames[0].opcode), int(PLUGIN_OP_CANCEL));
+    QCOMPARE(frames[0].requestId, quint32(3));
+    QVERIFY(frames[0].payload.isEmpty());
+    QCOMPARE(int(frames[1].opcode), int(PLUGIN_OP_PROCESS_UI));
+    QCOMPARE(frames[1].requestId, quint32(4));
+    QCOMPARE(FrameIOHandler::decodeMap(frames[1].payload), data);
+
+    /* An impossible frame size must be detected */
+    QBuffer garbage;
+    garbage.setData(QByteArray("\xff\xff\xff\xff\x02\x00\x00\x01", 8));
+    garbage.open(QIODevice::ReadOnly);
+    FrameIOHandler garbageReader(&garbage, 0,
+                                 SIGNON_IPC_PROTOCOL_VERSION);
+    garbageReader.readAvailableData();
+    FrameIOHandler::Frame frame;
+    QVERIFY(!garbageReader.takeFrame(frame));
+    QVERIFY(garbageReader.hasError());
+}
+
 #if !defined(SSO_CI_TESTMANAGEMENT)
 QTEST_MAIN(TestPluginProxy)
 #endif
@@ -47,11 +47,24 @@ private Q_SLOTS:
     void create_dummy();
     void type_for_dummy();
     void mechanisms_for_dummy();
+    void concurrency_for_dummy();
     void process_for_dummy();
     void processUi_for_dummy();
     void process_wrong_mech_for_dummy();
     void process_and_cancel_for_dummy();
     void wrong_user_for_dummy();
+    void recycle_after_max_requests();
+    void delete_does_not_block();
+    void abort_while_processing();
+    void process_in_process();
+    void process_latency_data();
+    void process_latency();
+    void process_oauth_request();
+    void blob_transfer_1mb();
+    void blob_read_timeout();
+    void blob_oversized_header();
+    void filter_does_not_copy();
+    void frame_reader();
 
 private:
     PluginProxy *m_proxy;
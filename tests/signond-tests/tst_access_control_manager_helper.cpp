@@ -71,6 +71,43 @@ private:
     QMap<QString,QStringList> m_permissions;
     QString m_keychainWidgetAppId;
 };
+
+class BulkAcmPlugin: public AcmPlugin,
+                     public SignOn::BulkAccessControlInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(SignOn::BulkAccessControlInterface)
+
+public:
+    BulkAcmPlugin(QObject *parent = 0):
+        AcmPlugin(parent), m_bulkCalls(0), m_singleCalls(0) {}
+
+    bool isPeerAllowedToAccess(const QDBusConnection &peerConnection,
+                               const QDBusMessage &peerMessage,
+                               const QString &securityContext) {
+        m_singleCalls++;
+        return AcmPlugin::isPeerAllowedToAccess(peerConnection, peerMessage,
+                                                securityContext);
+    }
+
+    QStringList allowedContexts(const QDBusConnection &peerConnection,
+                                const QDBusMessage &peerMessage,
+                                const QStringList &securityContexts) {
+        m_bulkCalls++;
+        QStringList allowed;
+        foreach(const QString &securityContext, securityContexts) {
+            if (AcmPlugin::isPeerAllowedToAccess(peerConnection, peerMessage,
+                                                 securityContext))
+                allowed.append(securityContext);
+        }
+        return allowed;
+    }
+
+private:
+    friend class AccessControlManagerHelperTest;
+    int m_bulkCalls;
+    int m_singleCalls;
+};
 // } mock AbstractAccessControlManager
 
 class AccessControlManagerHelperTest: public QObject
@@ -86,6 +123,8 @@ private Q_SLOTS:
     void testOwnership();
     void testIdentityAccess_data();
     void testIdentityAccess();
+    void testAllowedContexts();
+    void testBulkAllowedContexts();
 
 public:
     static AccessControlManagerHelperTest *instance() { return m_instance; }
@@ -317,5 +356,47 @@ void AccessControlManagerHelperTest::testIdentityAccess()
     QCOMPARE(isAllowed, expectedIsAllowed);
 }
 
+void AccessControlManagerHelperTest::testAllowedContexts()
+{
+    m_acmPlugin.m_permissions["tom"] = QStringList() << "tom" << "Tom";
+
+    QDBusMessage msg =
+        QDBusMessage::createMethodCall("tom", "/", "interface", "hi");
+    PeerContext peerContext(m_conn, msg);
+
+    SignonDaemonNS::AccessControlManagerHelper helper(&m_acmPlugin);
+
+    QStringList contexts = QStringList() << "bob" << "Tom" << "*" << "tom";
+    QCOMPARE(helper.allowedContexts(peerContext, contexts),
+             QStringList() << "Tom" << "tom");
+    QVERIFY(helper.allowedContexts(peerContext, QStringList()).isEmpty());
+    QVERIFY(helper.peerHasOneOfAccesses(peerContext, contexts));
+    QVERIFY(!helper.peerHasOneOfAccesses(peerContext,
+                                         QStringList() << "bob" << "*"));
+}
+
+void AccessControlManagerHelperTest::testBulkAllowedContexts()
+{
+    BulkAcmPlugin bulkPlugin;
+    bulkPlugin.m_permissions["tom"] = QStringList() << "tom" << "Tom";
+
+    QDBusMessage msg =
+        QDBusMessage::createMethodCall("tom", "/", "interface", "hi");
+    PeerContext peerContext(m_conn, msg);
+
+    SignonDaemonNS::AccessControlManagerHelper helper(&bulkPlugin);
+
+    QStringList contexts = QStringList() << "bob" << "Tom" << "*" << "tom";
+    QCOMPARE(helper.allowedContexts(peerContext, contexts),
+             QStringList() << "Tom" << "tom");
+    QCOMPARE(bulkPlugin.m_bulkCalls, 1);
+    QCOMPARE(bulkPlugin.m_singleCalls, 0);
+
+    QVERIFY(!helper.peerHasOneOfAccesses(peerContext,
+                                         QStringList() << "bob" << "*"));
+    QCOMPARE(bulkPlugin.m_bulkCalls, 2);
+    QCOMPARE(bulkPlugin.m_singleCalls, 0);
+}
+
 QTEST_MAIN(AccessControlManagerHelperTest)
 #include "tst_access_control_manager_helper.moc"
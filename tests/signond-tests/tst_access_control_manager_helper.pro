@@ -4,10 +4,12 @@ include(signond-tests.pri)
 
 SOURCES = \
     $${SIGNOND_SRC}/accesscontrolmanagerhelper.cpp \
+    $${SIGNOND_SRC}/peercache.cpp \
     tst_access_control_manager_helper.cpp
 
 HEADERS = \
     $${SIGNOND_SRC}/accesscontrolmanagerhelper.h \
-    $${SIGNOND_SRC}/credentialsdb.h
+    $${SIGNOND_SRC}/credentialsdb.h \
+    $${SIGNOND_SRC}/peercache.h
 
 check.commands = "./$$TARGET"
@@ -0,0 +1,144 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QSignalSpy>
+#include <QTest>
+
+#include "signondisposable.h"
+
+using namespace SignonDaemonNS;
+
+class Disposable: public SignonDisposable
+{
+    Q_OBJECT
+
+public:
+    Disposable(int maxInactivity, QObject *parent = 0):
+        SignonDisposable(maxInactivity, parent),
+        destroyCount(0)
+    {
+    }
+    ~Disposable() {}
+
+    void destroy() { destroyCount++; deleteLater(); }
+
+    int destroyCount;
+};
+
+class DisposableTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testExpiry();
+    void testKeepInUse();
+    void testAutoDestruct();
+    void benchmarkKeepInUse();
+    void benchmarkDestroyUnused();
+};
+
+void DisposableTest::testExpiry()
+{
+    QPointer<Disposable> shortLived = new Disposable(0);
+    QPointer<Disposable> longLived = new Disposable(60);
+
+    QTest::qWait(1100);
+    SignonDisposable::destroyUnused();
+    QCOMPARE(shortLived->destroyCount, 1);
+    QCOMPARE(longLived->destroyCount, 0);
+
+    /* Once disposed, objects are not considered again */
+    SignonDisposable::destroyUnused();
+    QCOMPARE(shortLived->destroyCount, 1);
+
+    QTRY_VERIFY(shortLived.isNull());
+    delete longLived;
+}
+
+void DisposableTest::testKeepInUse()
+{
+    Disposable *first = new Disposable(2);
+    Disposable *second = new Disposable(2);
+
+    QTest::qWait(1500);
+    first->keepInUse();
+    QTest::qWait(1600);
+
+    /* Only the object which has not been used for more than two seconds is
+     * destroyed, even though it's now after the other one in the list */
+    SignonDisposable::destroyUnused();
+    QCOMPARE(first->destroyCount, 0);
+    QCOMPARE(second->destroyCount, 1);
+
+    delete first;
+    delete second;
+}
+
+void DisposableTest::testAutoDestruct()
+{
+    Disposable *object = new Disposable(0);
+    object->setAutoDestruct(false);
+
+    QTest::qWait(1100);
+    SignonDisposable::destroyUnused();
+    QCOMPARE(object->destroyCount, 0);
+
+    object->setAutoDestruct(true);
+    QTest::qWait(1100);
+    SignonDisposable::destroyUnused();
+    QCOMPARE(object->destroyCount, 1);
+
+    delete object;
+}
+
+void DisposableTest::benchmarkKeepInUse()
+{
+    const int count = 100000;
+    QObject parent;
+    QList<Disposable *> objects;
+    for (int i = 0; i < count; i++)
+        objects.append(new Disposable(300, &parent));
+
+    QBENCHMARK {
+        foreach (Disposable *object, objects)
+            object->keepInUse();
+    }
+}
+
+void DisposableTest::benchmarkDestroyUnused()
+{
+    const int count = 100000;
+    QObject parent;
+    QList<Disposable *> objects;
+    for (int i = 0; i < count; i++)
+        objects.append(new Disposable(300, &parent));
+
+    /* None of the objects is expired: the sweep must not visit them */
+    QBENCHMARK {
+        SignonDisposable::destroyUnused();
+    }
+    QCOMPARE(objects.first()->destroyCount, 0);
+}
+
+QTEST_MAIN(DisposableTest)
+#include "tst_disposable.moc"
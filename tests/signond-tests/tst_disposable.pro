@@ -0,0 +1,13 @@
+TARGET = tst_disposable
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/idlepolicy.cpp \
+    $${SIGNOND_SRC}/signondisposable.cpp \
+    tst_disposable.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/signondisposable.h
+
+check.commands = "./$$TARGET"
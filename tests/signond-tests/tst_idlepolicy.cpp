@@ -0,0 +1,128 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QTest>
+
+#include "idlepolicy.h"
+
+using namespace SignonDaemonNS;
+
+class IdlePolicyTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testNotAdaptive();
+    void testShortIdlePeriods();
+    void testLongIdlePeriods();
+    void testRestore();
+};
+
+void IdlePolicyTest::testNotAdaptive()
+{
+    IdlePolicy policy;
+    policy.setTimeouts(5, 0);
+    QVERIFY(!policy.isAdaptive());
+
+    policy.idleStarted(1000);
+    policy.idleEnded(31000);
+    QCOMPARE(policy.timeout(), 5u);
+}
+
+void IdlePolicyTest::testShortIdlePeriods()
+{
+    IdlePolicy policy;
+    policy.setTimeouts(5, 300);
+    QVERIFY(policy.isAdaptive());
+    QCOMPARE(policy.timeout(), 5u);
+
+    /* Clients come back 30 seconds after the daemon gets idle */
+    qint64 time = 1000000;
+    for (int i = 0; i < 3; i++) {
+        policy.idleStarted(time);
+        QVERIFY(policy.isIdle());
+        /* Nested notifications don't reset the start of the idle period */
+        policy.idleStarted(time + 1000);
+        time += 30000;
+        policy.idleEnded(time);
+        QVERIFY(!policy.isIdle());
+        time += 2000;
+    }
+    QCOMPARE(policy.averageIdleTime(), qint64(30000));
+    QCOMPARE(policy.timeout(), 60u);
+
+    /* Very short idle periods never shorten the default timeout */
+    for (int i = 0; i < 20; i++) {
+        policy.idleStarted(time);
+        time += 100;
+        policy.idleEnded(time);
+    }
+    QCOMPARE(policy.timeout(), 5u);
+
+    /* ... and the timeout never exceeds the maximum */
+    policy.setTimeouts(5, 40);
+    policy.restore(0, 30000);
+    QCOMPARE(policy.timeout(), 40u);
+}
+
+void IdlePolicyTest::testLongIdlePeriods()
+{
+    IdlePolicy policy;
+    policy.setTimeouts(5, 60);
+
+    /* Waiting is pointless if clients come back after more than the
+     * maximum timeout */
+    policy.idleStarted(1000);
+    policy.idleEnded(1000 + 3600 * 1000);
+    QCOMPARE(policy.averageIdleTime(), qint64(120000));
+    QCOMPARE(policy.timeout(), 5u);
+
+    /* A single long idle period (which is capped) doesn't prevent the
+     * adaptation for long */
+    qint64 time = 10000000;
+    for (int i = 0; i < 5; i++) {
+        policy.idleStarted(time);
+        time += 10000;
+        policy.idleEnded(time);
+    }
+    QVERIFY(policy.timeout() > 5u);
+    QVERIFY(policy.timeout() <= 60u);
+}
+
+void IdlePolicyTest::testRestore()
+{
+    IdlePolicy policy;
+    policy.setTimeouts(5, 300);
+    policy.restore(1000, 20000);
+    QVERIFY(policy.isIdle());
+    QCOMPARE(policy.idleSince(), qint64(1000));
+
+    /* The daemon is restarted 40 seconds after its predecessor got idle */
+    policy.idleEnded(41000);
+    QVERIFY(!policy.isIdle());
+    QCOMPARE(policy.averageIdleTime(), qint64(25000));
+    QCOMPARE(policy.timeout(), 50u);
+}
+
+QTEST_MAIN(IdlePolicyTest)
+#include "tst_idlepolicy.moc"
@@ -0,0 +1,12 @@
+TARGET = tst_idlepolicy
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/idlepolicy.cpp \
+    tst_idlepolicy.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/idlepolicy.h
+
+check.commands = "./$$TARGET"
@@ -0,0 +1,143 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QTest>
+#include <unistd.h>
+
+#include "peercache.h"
+#include "peercontext.h"
+
+using namespace SignonDaemonNS;
+
+class PeerCacheTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testBusPeer();
+    void testUnknownPeer();
+    void testAccess();
+    void testPeerGone();
+
+private:
+    PeerContext peerContext(const QDBusConnection &connection) {
+        QDBusMessage msg =
+            QDBusMessage::createMethodCall(connection.baseService(),
+                                           "/", "interface", "hi");
+        return PeerContext(connection, msg);
+    }
+};
+
+void PeerCacheTest::initTestCase()
+{
+    if (!QDBusConnection::sessionBus().isConnected()) {
+        QSKIP("No D-Bus session bus");
+    }
+}
+
+void PeerCacheTest::testBusPeer()
+{
+    PeerCache *cache = PeerCache::instance();
+    PeerContext context = peerContext(QDBusConnection::sessionBus());
+
+    int count = cache->count();
+    QCOMPARE(cache->peer(context).m_pid, getpid());
+    QCOMPARE(cache->count(), count + 1);
+
+    /* The second time, the data comes from the cache */
+    cache->peer(context).m_appId = "my-app";
+    cache->peer(context).m_hasAppId = true;
+    QCOMPARE(cache->peer(context).m_appId, QString("my-app"));
+    QCOMPARE(cache->count(), count + 1);
+}
+
+void PeerCacheTest::testUnknownPeer()
+{
+    PeerCache *cache = PeerCache::instance();
+    QDBusMessage msg =
+        QDBusMessage::createMethodCall(":1.99999", "/", "interface", "hi");
+    PeerContext context(QDBusConnection::sessionBus(), msg);
+
+    int count = cache->count();
+    QCOMPARE(cache->peer(context).m_pid, pid_t(0));
+    QCOMPARE(cache->count(), count);
+
+    /* Access cannot be remembered for unidentified peers */
+    cache->addAccess(context, 3);
+    QVERIFY(!cache->hasAccess(context, 3));
+}
+
+void PeerCacheTest::testAccess()
+{
+    PeerCache *cache = PeerCache::instance();
+    PeerContext context = peerContext(QDBusConnection::sessionBus());
+
+    QVariantMap stats = cache->statistics();
+    quint64 hits = stats.value("AccessHits").toULongLong();
+    quint64 misses = stats.value("AccessMisses").toULongLong();
+
+    QVERIFY(!cache->hasAccess(context, 5));
+    cache->addAccess(context, 5);
+    cache->addAccess(context, 6);
+    QVERIFY(cache->hasAccess(context, 5));
+    QVERIFY(cache->hasAccess(context, 6));
+
+    /* Changing an identity only affects the decisions on that identity */
+    cache->invalidateAccess(6);
+    QVERIFY(cache->hasAccess(context, 5));
+    QVERIFY(!cache->hasAccess(context, 6));
+
+    /* Clearing the DB drops all of them */
+    cache->invalidateAccess(0);
+    QVERIFY(!cache->hasAccess(context, 5));
+
+    stats = cache->statistics();
+    QCOMPARE(stats.value("AccessHits").toULongLong(), hits + 3);
+    QCOMPARE(stats.value("AccessMisses").toULongLong(), misses + 3);
+}
+
+void PeerCacheTest::testPeerGone()
+{
+    PeerCache *cache = PeerCache::instance();
+    QString name("peer-gone");
+    int count = cache->count();
+
+    {
+        QDBusConnection connection =
+            QDBusConnection::connectToBus(QDBusConnection::SessionBus, name);
+        QVERIFY(connection.isConnected());
+        PeerContext context = peerContext(connection);
+        cache->addAccess(context, 5);
+        QCOMPARE(cache->count(), count + 1);
+    }
+    QDBusConnection::disconnectFromBus(name);
+
+    /* The peer is forgotten when its name goes away */
+    QTRY_COMPARE(cache->count(), count);
+}
+
+QTEST_MAIN(PeerCacheTest)
+#include "tst_peercache.moc"
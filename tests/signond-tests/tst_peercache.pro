@@ -0,0 +1,12 @@
+TARGET = tst_peercache
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/peercache.cpp \
+    tst_peercache.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/peercache.h
+
+check.commands = "$$RUN_WITH_SIGNOND ./$$TARGET"
@@ -5,7 +5,12 @@ include(signond-tests.pri)
 HEADERS += \
     testpluginproxy.h \
     $$TOP_SRC_DIR/src/signond/pluginproxy.h \
-    $${TOP_SRC_DIR}/lib/plugins/signon-plugins-common/SignOn/blobiohandler.h
+    $$TOP_SRC_DIR/src/signond/inprocessplugin.h \
+    $${TOP_SRC_DIR}/lib/plugins/signon-plugins-common/SignOn/blobiohandler.h \
+    $${TOP_SRC_DIR}/lib/plugins/signon-plugins-common/SignOn/frameiohandler.h
+
+LIBS += -lsignon-plugins
+QMAKE_LIBDIR += $${TOP_BUILD_DIR}/lib/plugins
 
 SOURCES = \
     testpluginproxy.cpp \
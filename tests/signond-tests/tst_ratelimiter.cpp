@@ -0,0 +1,108 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QTest>
+
+#include "accesscontrolmanagerhelper.h"
+#include "ratelimiter.h"
+
+using namespace SignonDaemonNS;
+
+// mock AccessControlManagerHelper {
+AccessControlManagerHelper *AccessControlManagerHelper::instance()
+{
+    return 0;
+}
+
+QString AccessControlManagerHelper::appIdOfPeer(const PeerContext &)
+{
+    return QString();
+}
+
+pid_t AccessControlManagerHelper::pidOfPeer(const PeerContext &)
+{
+    return 0;
+}
+// } mock AccessControlManagerHelper
+
+class RateLimiterTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testDisabled();
+    void testBurst();
+    void testRefill();
+    void testPeersAreIndependent();
+};
+
+void RateLimiterTest::testDisabled()
+{
+    RateLimiter *limiter = RateLimiter::instance();
+    limiter->setLimits(0, 1);
+    QVERIFY(!limiter->isEnabled());
+
+    for (int i = 0; i < 100; i++)
+        QVERIFY(limiter->admit(QString("peer")));
+}
+
+void RateLimiterTest::testBurst()
+{
+    RateLimiter *limiter = RateLimiter::instance();
+    limiter->setLimits(1, 5);
+    QVERIFY(limiter->isEnabled());
+
+    for (int i = 0; i < 5; i++)
+        QVERIFY(limiter->admit(QString("peer")));
+    QVERIFY(!limiter->admit(QString("peer")));
+}
+
+void RateLimiterTest::testRefill()
+{
+    RateLimiter *limiter = RateLimiter::instance();
+    limiter->setLimits(20, 2);
+
+    QVERIFY(limiter->admit(QString("peer")));
+    QVERIFY(limiter->admit(QString("peer")));
+    QVERIFY(!limiter->admit(QString("peer")));
+
+    /* At 20 requests per second, a token is added every 50 msecs */
+    QTest::qWait(120);
+    QVERIFY(limiter->admit(QString("peer")));
+    QVERIFY(limiter->admit(QString("peer")));
+    QVERIFY(!limiter->admit(QString("peer")));
+}
+
+void RateLimiterTest::testPeersAreIndependent()
+{
+    RateLimiter *limiter = RateLimiter::instance();
+    limiter->setLimits(1, 1);
+
+    QVERIFY(limiter->admit(QString("flooder")));
+    QVERIFY(!limiter->admit(QString("flooder")));
+    QVERIFY(limiter->admit(QString("polite")));
+    QVERIFY(!limiter->admit(QString("flooder")));
+}
+
+QTEST_MAIN(RateLimiterTest)
+#include "tst_ratelimiter.moc"
@@ -0,0 +1,12 @@
+TARGET = tst_ratelimiter
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/ratelimiter.cpp \
+    tst_ratelimiter.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/ratelimiter.h
+
+check.commands = "./$$TARGET"
@@ -0,0 +1,185 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QTest>
+
+#include "SignOn/sessiondata.h"
+#include "SignOn/uisessiondata_priv.h"
+#include "requestscheduler.h"
+
+using namespace SignonDaemonNS;
+
+class RequestSchedulerTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testPriorityFor();
+    void testUnlimited();
+    void testPriorities();
+    void testFairness();
+    void testWithdraw();
+
+private:
+    void submit(QObject *owner, RequestScheduler::Priority priority,
+                const QString &peer, const QString &name);
+
+private:
+    RequestScheduler *m_scheduler;
+    QObject m_owner1;
+    QObject m_owner2;
+    QObject m_owner3;
+    QStringList m_started;
+};
+
+void RequestSchedulerTest::init()
+{
+    m_scheduler = RequestScheduler::instance();
+    m_scheduler->setMaxActiveRequests(0);
+    m_started.clear();
+}
+
+void RequestSchedulerTest::cleanup()
+{
+    m_scheduler->withdraw(&m_owner1);
+    m_scheduler->withdraw(&m_owner2);
+    m_scheduler->withdraw(&m_owner3);
+    QCOMPARE(m_scheduler->activeRequests(), 0);
+}
+
+void RequestSchedulerTest::submit(QObject *owner,
+                                  RequestScheduler::Priority priority,
+                                  const QString &peer, const QString &name)
+{
+    m_scheduler->submit(owner, priority, peer, [this, name]() {
+        m_started.append(name);
+    });
+}
+
+void RequestSchedulerTest::testPriorityFor()
+{
+    QVariantMap params;
+    QCOMPARE(RequestScheduler::priorityFor(params),
+             RequestScheduler::Interactive);
+
+    params[SSOUI_KEY_UIPOLICY] = int(SignOn::RequestPasswordPolicy);
+    QCOMPARE(RequestScheduler::priorityFor(params),
+             RequestScheduler::Interactive);
+
+    params[SSOUI_KEY_UIPOLICY] = int(SignOn::NoUserInteractionPolicy);
+    QCOMPARE(RequestScheduler::priorityFor(params),
+             RequestScheduler::Background);
+}
+
+void RequestSchedulerTest::testUnlimited()
+{
+    submit(&m_owner1, RequestScheduler::Background, "a", "a1");
+    submit(&m_owner2, RequestScheduler::Interactive, "b", "b1");
+    submit(&m_owner3, RequestScheduler::Interactive, "c", "c1");
+
+    /* Nothing is started synchronously */
+    QVERIFY(m_started.isEmpty());
+    QCOMPARE(m_scheduler->queueLength(RequestScheduler::Interactive), 2);
+    QCOMPARE(m_scheduler->queueLength(RequestScheduler::Background), 1);
+
+    QTRY_COMPARE(m_started.count(), 3);
+    QCOMPARE(m_started, QStringList() << "b1" << "c1" << "a1");
+    QCOMPARE(m_scheduler->activeRequests(), 3);
+    QCOMPARE(m_scheduler->queueLength(RequestScheduler::Interactive), 0);
+
+    m_scheduler->release(&m_owner1);
+    m_scheduler->release(&m_owner2);
+    m_scheduler->release(&m_owner3);
+    QCOMPARE(m_scheduler->activeRequests(), 0);
+}
+
+void RequestSchedulerTest::testPriorities()
+{
+    m_scheduler->setMaxActiveRequests(1);
+
+    submit(&m_owner1, RequestScheduler::Background, "a", "a1");
+    QTRY_COMPARE(m_started, QStringList() << "a1");
+
+    /* The interactive request overtakes the background one */
+    submit(&m_owner2, RequestScheduler::Background, "b", "b1");
+    submit(&m_owner3, RequestScheduler::Interactive, "c", "c1");
+    QTest::qWait(10);
+    QCOMPARE(m_started.count(), 1);
+
+    m_scheduler->release(&m_owner1);
+    QTRY_COMPARE(m_started.count(), 2);
+    QCOMPARE(m_started.last(), QString("c1"));
+
+    m_scheduler->release(&m_owner3);
+    QTRY_COMPARE(m_started.count(), 3);
+    QCOMPARE(m_started.last(), QString("b1"));
+    m_scheduler->release(&m_owner2);
+
+    QVariantMap stats = m_scheduler->statistics();
+    QCOMPARE(stats.value("MaxActiveRequests").toInt(), 1);
+    QVariantMap background = stats.value("Background").toMap();
+    QVERIFY(background.value("Granted").toLongLong() >= 2);
+    QVERIFY(background.value("MaxWait").toLongLong() >= 10);
+}
+
+void RequestSchedulerTest::testFairness()
+{
+    m_scheduler->setMaxActiveRequests(1);
+
+    /* Peer "a" submits many requests before "b" */
+    submit(&m_owner1, RequestScheduler::Interactive, "a", "a1");
+    submit(&m_owner2, RequestScheduler::Interactive, "a", "a2");
+    submit(&m_owner3, RequestScheduler::Interactive, "a", "a3");
+    submit(&m_owner1, RequestScheduler::Interactive, "b", "b1");
+
+    QTRY_COMPARE(m_started, QStringList() << "a1");
+    m_scheduler->release(&m_owner1);
+    QTRY_COMPARE(m_started, QStringList() << "a1" << "b1");
+    m_scheduler->release(&m_owner1);
+    QTRY_COMPARE(m_started, QStringList() << "a1" << "b1" << "a2");
+    m_scheduler->release(&m_owner2);
+    QTRY_COMPARE(m_started, QStringList() << "a1" << "b1" << "a2" << "a3");
+    m_scheduler->release(&m_owner3);
+}
+
+void RequestSchedulerTest::testWithdraw()
+{
+    m_scheduler->setMaxActiveRequests(1);
+
+    submit(&m_owner1, RequestScheduler::Interactive, "a", "a1");
+    submit(&m_owner2, RequestScheduler::Interactive, "b", "b1");
+    submit(&m_owner3, RequestScheduler::Interactive, "c", "c1");
+    QTRY_COMPARE(m_started, QStringList() << "a1");
+
+    /* Withdrawing releases the started request and drops the waiting one */
+    m_scheduler->withdraw(&m_owner2);
+    m_scheduler->withdraw(&m_owner1);
+    QCOMPARE(m_scheduler->queueLength(RequestScheduler::Interactive), 1);
+    QTRY_COMPARE(m_started, QStringList() << "a1" << "c1");
+    m_scheduler->release(&m_owner3);
+}
+
+QTEST_MAIN(RequestSchedulerTest)
+#include "tst_requestscheduler.moc"
@@ -0,0 +1,12 @@
+TARGET = tst_requestscheduler
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/requestscheduler.cpp \
+    tst_requestscheduler.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/requestscheduler.h
+
+check.commands = "./$$TARGET"
@@ -0,0 +1,230 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QTest>
+
+#include "SignOn/sessiondata.h"
+#include "resultcache.h"
+
+using namespace SignonDaemonNS;
+
+class ResultCacheTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void testDisabledMethod();
+    void testLookup();
+    void testExpiry();
+    void testNormalization();
+    void testBypass();
+    void testInvalidate();
+    void testEviction();
+};
+
+void ResultCacheTest::init()
+{
+    ResultCache *cache = ResultCache::instance();
+    cache->clear();
+    cache->setCachedMethods(QStringList() << "oauth2");
+    cache->setDefaultLifetime(0);
+    cache->setMaxEntries(100);
+}
+
+void ResultCacheTest::testDisabledMethod()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap result { { "AccessToken", "abc" }, { "ExpiresIn", 3600 } };
+
+    cache->insert(1, "password", "password", QVariantMap(), result);
+    QCOMPARE(cache->count(), 0);
+
+    QVariantMap found;
+    QVERIFY(!cache->lookup(1, "password", "password", QVariantMap(), found));
+}
+
+void ResultCacheTest::testLookup()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap params { { "ClientId", "app" } };
+    QVariantMap result { { "AccessToken", "abc" }, { "ExpiresIn", 3600 } };
+
+    cache->insert(1, "oauth2", "web_server", params, result);
+    QCOMPARE(cache->count(), 1);
+
+    QVariantMap found;
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", params, found));
+    QCOMPARE(found.value("AccessToken").toString(), QString("abc"));
+    QVERIFY(found.value("ExpiresIn").toInt() <= 3600);
+    QVERIFY(found.value("ExpiresIn").toInt() > 3500);
+
+    /* Any difference in the key must give a miss */
+    QVERIFY(!cache->lookup(2, "oauth2", "web_server", params, found));
+    QVERIFY(!cache->lookup(1, "oauth2", "user_agent", params, found));
+    QVariantMap otherParams { { "ClientId", "other" } };
+    QVERIFY(!cache->lookup(1, "oauth2", "web_server", otherParams, found));
+
+    /* A new result replaces the old one */
+    result["AccessToken"] = "def";
+    cache->insert(1, "oauth2", "web_server", params, result);
+    QCOMPARE(cache->count(), 1);
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", params, found));
+    QCOMPARE(found.value("AccessToken").toString(), QString("def"));
+}
+
+void ResultCacheTest::testExpiry()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap found;
+
+    /* Without an expiry field, results are cached only if a default
+     * lifetime is set */
+    QVariantMap result { { "AccessToken", "abc" } };
+    cache->insert(1, "oauth2", "web_server", QVariantMap(), result);
+    QCOMPARE(cache->count(), 0);
+
+    cache->setDefaultLifetime(60);
+    cache->insert(1, "oauth2", "web_server", QVariantMap(), result);
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", QVariantMap(), found));
+
+    /* Expired tokens are not cached */
+    result["ExpiresIn"] = 0;
+    cache->insert(2, "oauth2", "web_server", QVariantMap(), result);
+    QVERIFY(!cache->lookup(2, "oauth2", "web_server", QVariantMap(), found));
+
+    result["ExpiresIn"] = 1;
+    cache->insert(3, "oauth2", "web_server", QVariantMap(), result);
+    QVERIFY(cache->lookup(3, "oauth2", "web_server", QVariantMap(), found));
+    QTest::qWait(1100);
+    QVERIFY(!cache->lookup(3, "oauth2", "web_server", QVariantMap(), found));
+}
+
+void ResultCacheTest::testNormalization()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap params { { "ClientId", "app" }, { "WindowId", 3 } };
+    QVariantMap result { { "AccessToken", "abc" }, { "ExpiresIn", 3600 } };
+
+    cache->insert(1, "oauth2", "web_server", params, result);
+
+    QVariantMap lookupParams {
+        { "ClientId", "app" },
+        { "WindowId", 5 },
+        { "NetworkTimeout", 100 },
+        { "Empty", QVariant() },
+    };
+    QVariantMap found;
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", lookupParams, found));
+}
+
+void ResultCacheTest::testBypass()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap params { { "ClientId", "app" } };
+    QVariantMap result { { "AccessToken", "abc" }, { "ExpiresIn", 3600 } };
+    QVariantMap found;
+
+    cache->insert(1, "oauth2", "web_server", params, result);
+
+    QVariantMap renewParams = params;
+    renewParams["RenewToken"] = true;
+    QVERIFY(!cache->lookup(1, "oauth2", "web_server", renewParams, found));
+
+    /* The renewed token replaces the cached one */
+    result["AccessToken"] = "renewed";
+    cache->insert(1, "oauth2", "web_server", renewParams, result);
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", params, found));
+    QCOMPARE(found.value("AccessToken").toString(), QString("renewed"));
+
+    QVariantMap uiParams = params;
+    uiParams["UiPolicy"] = int(SignOn::RequestPasswordPolicy);
+    QVERIFY(!cache->lookup(1, "oauth2", "web_server", uiParams, found));
+    cache->insert(1, "oauth2", "web_server", uiParams, result);
+    QCOMPARE(cache->count(), 1);
+}
+
+void ResultCacheTest::testInvalidate()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap result { { "AccessToken", "abc" }, { "ExpiresIn", 3600 } };
+    QVariantMap found;
+
+    cache->insert(1, "oauth2", "web_server", QVariantMap(), result);
+    cache->insert(1, "oauth2", "user_agent", QVariantMap(), result);
+    cache->insert(2, "oauth2", "web_server", QVariantMap(), result);
+    QCOMPARE(cache->count(), 3);
+
+    cache->invalidate(1);
+    QCOMPARE(cache->count(), 1);
+    QVERIFY(!cache->lookup(1, "oauth2", "web_server", QVariantMap(), found));
+    QVERIFY(cache->lookup(2, "oauth2", "web_server", QVariantMap(), found));
+
+    cache->setCachedMethods(QStringList());
+    QCOMPARE(cache->count(), 0);
+}
+
+void ResultCacheTest::testEviction()
+{
+    ResultCache *cache = ResultCache::instance();
+    QVariantMap result { { "AccessToken", "abc" }, { "ExpiresIn", 3600 } };
+    QVariantMap found;
+
+    cache->setMaxEntries(3);
+    cache->insert(1, "oauth2", "web_server", QVariantMap(), result);
+    cache->insert(2, "oauth2", "web_server", QVariantMap(), result);
+    cache->insert(3, "oauth2", "web_server", QVariantMap(), result);
+    QCOMPARE(cache->count(), 3);
+
+    /* Using 1 makes 2 the least recently used result */
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", QVariantMap(), found));
+    cache->insert(4, "oauth2", "web_server", QVariantMap(), result);
+    QCOMPARE(cache->count(), 3);
+    QVERIFY(!cache->lookup(2, "oauth2", "web_server", QVariantMap(), found));
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", QVariantMap(), found));
+    QVERIFY(cache->lookup(3, "oauth2", "web_server", QVariantMap(), found));
+    QVERIFY(cache->lookup(4, "oauth2", "web_server", QVariantMap(), found));
+
+    /* Replacing a result doesn't evict anything */
+    cache->insert(4, "oauth2", "web_server", QVariantMap(), result);
+    QCOMPARE(cache->count(), 3);
+
+    /* Expired results go first, even if recently used */
+    QVariantMap shortResult { { "AccessToken", "abc" }, { "ExpiresIn", 1 } };
+    cache->invalidate(4);
+    cache->insert(5, "oauth2", "web_server", QVariantMap(), shortResult);
+    QVERIFY(cache->lookup(5, "oauth2", "web_server", QVariantMap(), found));
+    QTest::qWait(1100);
+    cache->insert(6, "oauth2", "web_server", QVariantMap(), result);
+    QCOMPARE(cache->count(), 3);
+    QVERIFY(cache->lookup(1, "oauth2", "web_server", QVariantMap(), found));
+    QVERIFY(cache->lookup(3, "oauth2", "web_server", QVariantMap(), found));
+
+    /* Lowering the limit trims the cache */
+    cache->setMaxEntries(1);
+    QCOMPARE(cache->count(), 1);
+    QVERIFY(cache->lookup(3, "oauth2", "web_server", QVariantMap(), found));
+}
+
+QTEST_MAIN(ResultCacheTest)
+#include "tst_resultcache.moc"
@@ -0,0 +1,12 @@
+TARGET = tst_resultcache
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/resultcache.cpp \
+    tst_resultcache.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/resultcache.h
+
+check.commands = "./$$TARGET"
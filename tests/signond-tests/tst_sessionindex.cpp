@@ -0,0 +1,174 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of signon
+ *
+ * Copyright (C) 2020 UBports Foundation
+ *
+ * Contact: Alberto Mardegan <mardy@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <QTest>
+
+#include "sessionindex.h"
+
+using namespace SignonDaemonNS;
+
+/* The index never dereferences the sessions: fake pointers will do */
+static SignonSessionCore *fakeCore(quintptr n)
+{
+    return reinterpret_cast<SignonSessionCore *>(n * 8);
+}
+
+class SessionIndexTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testMethodIds();
+    void testStoredSessions();
+    void testNonStoredSessions();
+    void testChangeId();
+    void testTakeAll();
+    void benchmarkLookup();
+};
+
+void SessionIndexTest::testMethodIds()
+{
+    SessionIndex index;
+
+    QCOMPARE(index.methodId("oauth2"), 0u);
+    quint32 oauth = index.registerMethod("oauth2");
+    QVERIFY(oauth != 0);
+    QCOMPARE(index.methodId("oauth2"), oauth);
+    QCOMPARE(index.registerMethod("oauth2"), oauth);
+
+    quint32 password = index.registerMethod("password");
+    QVERIFY(password != 0);
+    QVERIFY(password != oauth);
+}
+
+void SessionIndexTest::testStoredSessions()
+{
+    SessionIndex index;
+    quint32 oauth = index.registerMethod("oauth2");
+    quint32 password = index.registerMethod("password");
+
+    QVERIFY(index.insert(1, oauth, fakeCore(1)));
+    QVERIFY(index.insert(1, password, fakeCore(2)));
+    QVERIFY(index.insert(2, oauth, fakeCore(3)));
+    QVERIFY(!index.insert(1, oauth, fakeCore(4)));
+    QCOMPARE(index.count(), 3);
+
+    QCOMPARE(index.find(1, oauth), fakeCore(1));
+    QCOMPARE(index.find(1, password), fakeCore(2));
+    QCOMPARE(index.find(2, oauth), fakeCore(3));
+    QVERIFY(!index.find(2, password));
+    QVERIFY(!index.find(1, index.methodId("unknown")));
+
+    /* Removing another session with the same key has no effect */
+    index.remove(1, oauth, fakeCore(4));
+    QCOMPARE(index.find(1, oauth), fakeCore(1));
+
+    index.remove(1, oauth, fakeCore(1));
+    QVERIFY(!index.find(1, oauth));
+    QCOMPARE(index.count(), 2);
+    QCOMPARE(index.storedSessions().count(), 2);
+}
+
+void SessionIndexTest::testNonStoredSessions()
+{
+    SessionIndex index;
+    quint32 oauth = index.registerMethod("oauth2");
+
+    /* Sessions of new identities are never shared */
+    QVERIFY(index.insert(0, oauth, fakeCore(1)));
+    QVERIFY(index.insert(0, oauth, fakeCore(2)));
+    QCOMPARE(index.count(), 2);
+    QVERIFY(!index.find(0, oauth));
+    QVERIFY(index.storedSessions().isEmpty());
+
+    index.remove(0, oauth, fakeCore(1));
+    QCOMPARE(index.count(), 1);
+}
+
+void SessionIndexTest::testChangeId()
+{
+    SessionIndex index;
+    quint32 oauth = index.registerMethod("oauth2");
+
+    /* What SignonSessionCore::setId() does */
+    QVERIFY(index.insert(0, oauth, fakeCore(1)));
+    index.remove(0, oauth, fakeCore(1));
+    QVERIFY(index.insert(5, oauth, fakeCore(1)));
+    QCOMPARE(index.find(5, oauth), fakeCore(1));
+    QCOMPARE(index.count(), 1);
+
+    index.remove(5, oauth, fakeCore(1));
+    QVERIFY(index.insert(0, oauth, fakeCore(1)));
+    QVERIFY(!index.find(5, oauth));
+    QCOMPARE(index.count(), 1);
+}
+
+void SessionIndexTest::testTakeAll()
+{
+    SessionIndex index;
+    quint32 oauth = index.registerMethod("oauth2");
+
+    index.insert(1, oauth, fakeCore(1));
+    index.insert(0, oauth, fakeCore(2));
+    QList<SignonSessionCore *> sessions = index.takeAll();
+    QCOMPARE(sessions.count(), 2);
+    QVERIFY(sessions.contains(fakeCore(1)));
+    QVERIFY(sessions.contains(fakeCore(2)));
+    QCOMPARE(index.count(), 0);
+}
+
+void SessionIndexTest::benchmarkLookup()
+{
+    const int numIdentities = 2500;
+    const QStringList methods = QStringList() <<
+        "oauth2" << "password" << "sasl" << "google";
+
+    SessionIndex index;
+    QList<quint32> methodIds;
+    foreach (const QString &method, methods)
+        methodIds.append(index.registerMethod(method));
+
+    /* 10k sessions, half of them on new identities */
+    quintptr n = 1;
+    for (int id = 1; id <= numIdentities; id++) {
+        foreach (quint32 methodId, methodIds) {
+            QVERIFY(index.insert(id, methodId, fakeCore(n++)));
+            index.insert(0, methodId, fakeCore(n++));
+        }
+    }
+    QCOMPARE(index.count(), numIdentities * methods.count() * 2);
+
+    int found = 0;
+    QBENCHMARK {
+        found = 0;
+        for (int id = 1; id <= numIdentities; id++) {
+            foreach (const QString &method, methods) {
+                if (index.find(id, index.methodId(method))) found++;
+            }
+        }
+    }
+    QCOMPARE(found, numIdentities * methods.count());
+}
+
+QTEST_MAIN(SessionIndexTest)
+#include "tst_sessionindex.moc"
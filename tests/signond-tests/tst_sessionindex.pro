@@ -0,0 +1,12 @@
+TARGET = tst_sessionindex
+
+include(signond-tests.pri)
+
+SOURCES = \
+    $${SIGNOND_SRC}/sessionindex.cpp \
+    tst_sessionindex.cpp
+
+HEADERS = \
+    $${SIGNOND_SRC}/sessionindex.h
+
+check.commands = "./$$TARGET"
@@ -22,6 +22,7 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QProcess>
 #include <QSignalSpy>
 #include <QTemporaryDir>
@@ -130,10 +131,14 @@ private Q_SLOTS:
     void testIdentityCreation();
     void testIdentityRemoval();
     void testIdentityReferences();
+    void testGetIdentities();
     void testAuthSessionMechanisms_data();
     void testAuthSessionMechanisms();
     void testAuthSessionProcess();
+    void testProcessOneShot();
     void testAuthSessionProcessFromOtherProcess();
+    void testAuthSessionQueueLength();
+    void testAuthSessionTimeout();
     void testAuthSessionProcessUi();
     void testAuthSessionCloseUi_data();
     void testAuthSessionCloseUi();
@@ -497,6 +502,40 @@ void SignondTest::testIdentityReferences()
     QCOMPARE(storedData.value(SIGNOND_IDENTITY_INFO_REFCOUNT).toInt(), 1);
 }
 
+void SignondTest::testGetIdentities()
+{
+    SignondSecurityContextTestList acl = { SignondSecurityContextTest() };
+    QVariantMap identityData {
+        { SIGNOND_IDENTITY_INFO_USERNAME, "John" },
+        { SIGNOND_IDENTITY_INFO_CAPTION, "John's account" },
+        { SIGNOND_IDENTITY_INFO_ACL, QVariant::fromValue(acl) },
+    };
+    uint id1, id2;
+    QVERIFY(createIdentity(identityData, &id1).startsWith('/'));
+    identityData[SIGNOND_IDENTITY_INFO_USERNAME] = "Jane";
+    QVERIFY(createIdentity(identityData, &id2).startsWith('/'));
+
+    /* Unknown and duplicate IDs are skipped */
+    QList<uint> ids = { id1, 0xfffffff, id2, id1 };
+    QDBusMessage msg = methodCall(SIGNOND_DAEMON_OBJECTPATH,
+                                  SIGNOND_DAEMON_INTERFACE,
+                                  "getIdentities");
+    msg << QVariant::fromValue(ids);
+    msg << QString("application_security_context");
+    QDBusMessage reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+
+    QCOMPARE(reply.arguments().count(), 1);
+    QList<QVariantMap> identities =
+        qdbus_cast<QList<QVariantMap>>(reply.arguments()[0].value<QDBusArgument>());
+    QCOMPARE(identities.count(), 2);
+    QCOMPARE(identities[0].value(SIGNOND_IDENTITY_INFO_ID).toUInt(), id1);
+    QCOMPARE(identities[0].value(SIGNOND_IDENTITY_INFO_USERNAME).toString(),
+             QString("John"));
+    QCOMPARE(identities[1].value(SIGNOND_IDENTITY_INFO_ID).toUInt(), id2);
+    QVERIFY(mapIsSuperset(identities[1], identityData));
+}
+
 void SignondTest::testAuthSessionMechanisms_data()
 {
     QTest::addColumn<QString>("method");
@@ -585,6 +624,39 @@ void SignondTest::testAuthSessionProcess()
     QCOMPARE(response, expectedResponse);
 }
 
+void SignondTest::testProcessOneShot()
+{
+    QVariantMap sessionData {
+        { "Some key", "its value" },
+        { "height", 123 },
+    };
+    QDBusMessage msg = methodCall(SIGNOND_DAEMON_OBJECTPATH,
+                                  SIGNOND_DAEMON_INTERFACE,
+                                  "processOneShot");
+    msg << uint(0);
+    msg << QString("ssotest");
+    msg << QString("mech1");
+    msg << sessionData;
+    QDBusMessage reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+
+    QVariantMap response = QDBusReply<QVariantMap>(reply).value();
+    QVariantMap expectedResponse = sessionData;
+    expectedResponse["Realm"] = "testRealm_after_test";
+    QCOMPARE(response, expectedResponse);
+
+    /* Unknown methods are reported as errors */
+    msg = methodCall(SIGNOND_DAEMON_OBJECTPATH, SIGNOND_DAEMON_INTERFACE,
+                     "processOneShot");
+    msg << uint(0);
+    msg << QString("nonexisting");
+    msg << QString("mech1");
+    msg << sessionData;
+    reply = connection().call(msg);
+    QCOMPARE(reply.type(), QDBusMessage::ErrorMessage);
+    QCOMPARE(reply.errorName(), QString(SIGNOND_METHOD_NOT_KNOWN_ERR_NAME));
+}
+
 void SignondTest::testAuthSessionProcessFromOtherProcess()
 {
     QDBusMessage msg = methodCall(SIGNOND_DAEMON_OBJECTPATH,
@@ -615,6 +687,90 @@ void SignondTest::testAuthSessionProcessFromOtherProcess()
     QCOMPARE(errorName, SIGNOND_PERMISSION_DENIED_ERR_NAME);
 }
 
+void SignondTest::testAuthSessionQueueLength()
+{
+    QDBusMessage msg = methodCall(SIGNOND_DAEMON_OBJECTPATH,
+                                  SIGNOND_DAEMON_INTERFACE,
+                                  "getAuthSessionObjectPath");
+    msg << uint(0);
+    msg << QString("*");
+    msg << QString("ssotest");
+    QDBusMessage reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+    QString objectPath = reply.arguments()[0].value<QDBusObjectPath>().path();
+    QVERIFY(objectPath.startsWith('/'));
+
+    msg = methodCall(objectPath, SIGNOND_AUTH_SESSION_INTERFACE,
+                     "queueLength");
+    reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+    QCOMPARE(QDBusReply<uint>(reply).value(), 0u);
+
+    /* Queue a request, and check the length while it's being processed */
+    QVariantMap sessionData {
+        { "Some key", "its value" },
+    };
+    msg = methodCall(objectPath, SIGNOND_AUTH_SESSION_INTERFACE, "process");
+    msg << sessionData;
+    msg << QString("mech1");
+    QDBusPendingCall processCall = connection().asyncCall(msg);
+
+    msg = methodCall(objectPath, SIGNOND_AUTH_SESSION_INTERFACE,
+                     "queueLength");
+    reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+    QCOMPARE(QDBusReply<uint>(reply).value(), 1u);
+
+    processCall.waitForFinished();
+    QVERIFY(replyIsValid(processCall.reply()));
+
+    msg = methodCall(objectPath, SIGNOND_AUTH_SESSION_INTERFACE,
+                     "queueLength");
+    reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+    QCOMPARE(QDBusReply<uint>(reply).value(), 0u);
+}
+
+void SignondTest::testAuthSessionTimeout()
+{
+    QDBusMessage msg = methodCall(SIGNOND_DAEMON_OBJECTPATH,
+                                  SIGNOND_DAEMON_INTERFACE,
+                                  "getAuthSessionObjectPath");
+    msg << uint(0);
+    msg << QString("*");
+    msg << QString("ssotest");
+    QDBusMessage reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+    QString objectPath = reply.arguments()[0].value<QDBusObjectPath>().path();
+    QVERIFY(objectPath.startsWith('/'));
+
+    /* The test plugin takes about one second to reply */
+    QVariantMap sessionData {
+        { "Some key", "its value" },
+        { "Timeout", 200 },
+    };
+    msg = methodCall(objectPath, SIGNOND_AUTH_SESSION_INTERFACE, "process");
+    msg << sessionData;
+    msg << QString("mech1");
+    QElapsedTimer timer;
+    timer.start();
+    reply = connection().call(msg);
+    QCOMPARE(reply.type(), QDBusMessage::ErrorMessage);
+    QCOMPARE(reply.errorName(), QString(SIGNOND_TIMED_OUT_ERR_NAME));
+    QVERIFY(timer.elapsed() < 900);
+
+    /* The session is still usable afterwards */
+    sessionData.remove("Timeout");
+    msg = methodCall(objectPath, SIGNOND_AUTH_SESSION_INTERFACE, "process");
+    msg << sessionData;
+    msg << QString("mech1");
+    reply = connection().call(msg);
+    QVERIFY(replyIsValid(reply));
+    QVariantMap response = QDBusReply<QVariantMap>(reply).value();
+    QCOMPARE(response.value("Realm").toString(),
+             QString("testRealm_after_test"));
+}
+
 void SignondTest::testAuthSessionProcessUi()
 {
     QDBusMessage msg = methodCall(SIGNOND_DAEMON_OBJECTPATH,